@@ -0,0 +1,230 @@
+// compiles every GLSL source under the shader directory to SPIR-V and embeds the results
+// into one generated header, so the framework never loads shaders from disk at startup
+// the embedded copies are stripped of debug info, the .spv files keep it for debuggers
+//
+// usage: ShaderBuilder.exe <shader directory>
+// writes <name>_<stage>.spv next to each source and <shader directory>\embeddedshaders.inl
+#include <Windows.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "spirvstrip.h"
+
+namespace
+{
+  const uint32_t spirv_magic = 0x07230203;
+  const char* const shader_stages[] = { "vert", "frag", "comp", "geom", "tesc", "tese" };
+  const char* const output_name = "embeddedshaders.inl";
+
+  struct ShaderSource
+  {
+    std::string name;   // path relative to the shader directory with forward slashes, "t6/t6.vert"
+    std::string source; // full paths
+    std::string binary;
+  };
+
+  bool is_shader_stage(const std::string& extension)
+  {
+    for (const char* stage : shader_stages)
+      if (extension == stage)
+        return true;
+    return false;
+  }
+
+  void find_shader_sources(const std::string& root, const std::string& relative, std::vector<ShaderSource>& sources)
+  {
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = FindFirstFileA((root + relative + "*").c_str(), &find_data);
+    if (find == INVALID_HANDLE_VALUE)
+      return;
+
+    do
+    {
+      std::string file_name = find_data.cFileName;
+      if ((file_name == ".") || (file_name == ".."))
+        continue;
+
+      if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+      {
+        find_shader_sources(root, relative + file_name + "\\", sources);
+        continue;
+      }
+
+      size_t dot = file_name.rfind('.');
+      if ((dot == std::string::npos) || !is_shader_stage(file_name.substr(dot + 1)))
+        continue;
+
+      ShaderSource shader;
+      shader.name = relative + file_name;
+      for (char& c : shader.name)
+        if (c == '\\')
+          c = '/';
+      shader.source = root + relative + file_name;
+      shader.binary = root + relative + file_name.substr(0, dot) + "_" + file_name.substr(dot + 1) + ".spv";
+      sources.push_back(shader);
+    } while (FindNextFileA(find, &find_data));
+
+    FindClose(find);
+  }
+
+  uint64_t write_time(const std::string& file_name)
+  {
+    WIN32_FILE_ATTRIBUTE_DATA file_attributes;
+    if (!GetFileAttributesExA(file_name.c_str(), GetFileExInfoStandard, &file_attributes))
+      return 0;
+    return (static_cast<uint64_t>(file_attributes.ftLastWriteTime.dwHighDateTime) << 32) | file_attributes.ftLastWriteTime.dwLowDateTime;
+  }
+
+  size_t file_size(const std::string& file_name)
+  {
+    WIN32_FILE_ATTRIBUTE_DATA file_attributes;
+    if (!GetFileAttributesExA(file_name.c_str(), GetFileExInfoStandard, &file_attributes))
+      return 0;
+    return static_cast<size_t>((static_cast<uint64_t>(file_attributes.nFileSizeHigh) << 32) | file_attributes.nFileSizeLow);
+  }
+
+  bool compile_shader(const std::string& compiler, const ShaderSource& shader)
+  {
+    uint64_t binary_time = write_time(shader.binary);
+    if ((binary_time != 0) && (binary_time >= write_time(shader.source)))
+      return true;
+
+    // cmd strips the outermost quotes, so the whole line gets one more pair
+    std::string command = "\"\"" + compiler + "\" -V -o \"" + shader.binary + "\" \"" + shader.source + "\"\"";
+    printf("%s\n", shader.name.c_str());
+    fflush(stdout);
+    if (system(command.c_str()) != 0)
+    {
+      // glslangValidator already printed the errors, the stale binary must not be embedded
+      DeleteFileA(shader.binary.c_str());
+      fprintf(stderr, "%s: error: could not compile shader\n", shader.source.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  bool read_spirv(const std::string& file_name, std::vector<uint32_t>& words)
+  {
+    std::ifstream file(file_name, std::ios::binary | std::ios::ate);
+    if (file.fail())
+      return false;
+
+    std::streamoff size = file.tellg();
+    if ((size < 20) || (size % 4 != 0))
+      return false;
+
+    words.resize(static_cast<size_t>(size / 4));
+    file.seekg(0, std::ios::beg);
+    file.read(reinterpret_cast<char*>(words.data()), size);
+    return !file.fail() && (words[0] == spirv_magic);
+  }
+
+  std::string identifier(const std::string& name)
+  {
+    std::string result = "embedded_shader_";
+    for (char c : name)
+      result += isalnum(static_cast<unsigned char>(c)) ? c : '_';
+    return result;
+  }
+
+  bool write_if_changed(const std::string& file_name, const std::string& text)
+  {
+    // an untouched header keeps everything that includes it from recompiling
+    std::ifstream old_file(file_name, std::ios::binary);
+    if (!old_file.fail())
+    {
+      std::stringstream old_text;
+      old_text << old_file.rdbuf();
+      if (old_text.str() == text)
+        return true;
+    }
+    old_file.close();
+
+    std::ofstream file(file_name, std::ios::binary | std::ios::trunc);
+    file << text;
+    return !file.fail();
+  }
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: ShaderBuilder <shader directory>\n");
+    return 1;
+  }
+
+  std::string root = argv[1];
+  if (!root.empty() && (root.back() != '\\') && (root.back() != '/'))
+    root += '\\';
+  std::string compiler = root + "glslangValidator.exe";
+
+  std::vector<ShaderSource> shaders;
+  find_shader_sources(root, "", shaders);
+  std::sort(shaders.begin(), shaders.end(), [](const ShaderSource& a, const ShaderSource& b) { return a.name < b.name; });
+
+  std::ostringstream output;
+  output << "// generated by ShaderBuilder from the GLSL sources under shaders, do not edit\n\n";
+
+  bool succeeded = true;
+  size_t original_size = 0;
+  size_t embedded_size = 0;
+  for (const ShaderSource& shader : shaders)
+  {
+    std::vector<uint32_t> words;
+    if (!compile_shader(compiler, shader))
+    {
+      succeeded = false;
+      continue;
+    }
+    if (!read_spirv(shader.binary, words))
+    {
+      fprintf(stderr, "%s: error: not a SPIR-V module\n", shader.binary.c_str());
+      succeeded = false;
+      continue;
+    }
+
+    // a module the stripper does not fully understand, or one that comes out different, is embedded as is
+    std::vector<uint32_t> stripped;
+    if (strip_spirv(words, stripped) && validate_stripped_spirv(words, stripped))
+      words.swap(stripped);
+    else
+      fprintf(stderr, "%s: warning: could not strip, embedding the module unchanged\n", shader.binary.c_str());
+    original_size += file_size(shader.binary);
+    embedded_size += words.size() * sizeof(uint32_t);
+
+    output << "constexpr uint32_t " << identifier(shader.name) << "[] = {";
+    char word[16];
+    for (size_t i = 0; i < words.size(); ++i)
+    {
+      snprintf(word, sizeof(word), "0x%08x", words[i]);
+      output << ((i % 8 == 0) ? "\n  " : " ") << word << ((i + 1 < words.size()) ? "," : "");
+    }
+    output << "\n};\n\n";
+  }
+
+  if (!succeeded)
+    return 1;
+  printf("%zu shaders embedded, %zu of %zu bytes after stripping\n", shaders.size(), embedded_size, original_size);
+
+  output << "constexpr EmbeddedShader embedded_shaders[] = {\n";
+  for (const ShaderSource& shader : shaders)
+    output << "  { \"" << shader.name << "\", " << identifier(shader.name) << ", sizeof(" << identifier(shader.name) << ") },\n";
+  if (shaders.empty())
+    output << "  { nullptr, nullptr, 0 },\n";
+  output << "};\n";
+
+  if (!write_if_changed(root + output_name, output.str()))
+  {
+    fprintf(stderr, "%s%s: error: could not write\n", root.c_str(), output_name);
+    return 1;
+  }
+  return 0;
+}
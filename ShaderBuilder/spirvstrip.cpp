@@ -0,0 +1,526 @@
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "spirvstrip.h"
+
+namespace
+{
+  const uint32_t spirv_magic = 0x07230203;
+  const size_t   header_size = 5;
+
+  const uint16_t op_source_continued = 2;
+  const uint16_t op_source = 3;
+  const uint16_t op_source_extension = 4;
+  const uint16_t op_name = 5;
+  const uint16_t op_member_name = 6;
+  const uint16_t op_string = 7;
+  const uint16_t op_line = 8;
+  const uint16_t op_no_line = 317;
+  const uint16_t op_module_processed = 330;
+  const uint16_t op_undef = 1;
+  const uint16_t op_entry_point = 15;
+  const uint16_t op_execution_mode = 16;
+  const uint16_t op_capability = 17;
+  const uint16_t op_function = 54;
+  const uint16_t op_function_end = 56;
+  const uint16_t op_function_call = 57;
+  const uint16_t op_variable = 59;
+  const uint16_t op_decorate = 71;
+  const uint16_t op_member_decorate = 72;
+  const uint16_t op_switch = 251;
+  const uint16_t op_decorate_id = 332;
+
+  const uint32_t capability_int64 = 11;
+
+  struct Instruction
+  {
+    size_t   offset;
+    uint16_t opcode;
+    uint16_t word_count;
+    bool     in_function;
+    uint32_t result_position;        // 0 without a result id
+    std::vector<size_t> id_positions; // every word holding an id, the result included
+  };
+
+  bool is_debug(uint16_t opcode)
+  {
+    return (opcode == op_source_continued) || (opcode == op_source) || (opcode == op_source_extension) ||
+      (opcode == op_name) || (opcode == op_member_name) || (opcode == op_string) || (opcode == op_line) ||
+      (opcode == op_no_line) || (opcode == op_module_processed);
+  }
+
+  bool is_decoration(uint16_t opcode)
+  {
+    return (opcode == op_decorate) || (opcode == op_member_decorate) || (opcode == op_decorate_id);
+  }
+
+  // types, constants and undefs are dropped when nothing uses them, spec constants stay specializable
+  bool is_removable_definition(uint16_t opcode)
+  {
+    return ((opcode >= 19) && (opcode <= 33)) || ((opcode >= 41) && (opcode <= 46)) || (opcode == op_undef);
+  }
+
+  // T result type, R result id, i id, l literal, s string, I remaining ids, L remaining literals,
+  // P remaining literal/id pairs, M operand mask followed by ids
+  // only the core instructions glslang emits for graphics and compute shaders are listed,
+  // anything else makes the pass give up instead of guessing where ids are
+  const char* operand_layout(uint16_t opcode)
+  {
+    if (((opcode >= 109) && (opcode <= 122)) || (opcode == 124) || (opcode == 126) || (opcode == 127) ||
+      ((opcode >= 154) && (opcode <= 160)) || (opcode == 168) || (opcode == 200) || (opcode == 204) || (opcode == 205) ||
+      ((opcode >= 207) && (opcode <= 215)))
+      return "TRi";
+    if (((opcode >= 128) && (opcode <= 152)) || ((opcode >= 161) && (opcode <= 167)) || ((opcode >= 170) && (opcode <= 191)) ||
+      ((opcode >= 194) && (opcode <= 199)))
+      return "TRii";
+    if ((opcode >= 234) && (opcode <= 242))
+      return "TRiiii";
+
+    switch (opcode)
+    {
+    case 1:   return "TR";       // OpUndef
+    case 10:  return "L";        // OpExtension
+    case 11:  return "RL";       // OpExtInstImport
+    case 12:  return "TRilI";    // OpExtInst
+    case 14:  return "L";        // OpMemoryModel
+    case 15:  return "lisI";     // OpEntryPoint
+    case 16:  return "ilL";      // OpExecutionMode
+    case 17:  return "L";        // OpCapability
+    case 19: case 20: case 21: case 22: case 26:
+      return "RL";               // OpTypeVoid, Bool, Int, Float, Sampler
+    case 23: case 24: return "Ril"; // OpTypeVector, OpTypeMatrix
+    case 25:  return "RiL";      // OpTypeImage
+    case 27:  return "Ri";       // OpTypeSampledImage
+    case 28:  return "Rii";      // OpTypeArray
+    case 29:  return "Ri";       // OpTypeRuntimeArray
+    case 30:  return "RI";       // OpTypeStruct
+    case 32:  return "Rli";      // OpTypePointer
+    case 33:  return "RiI";      // OpTypeFunction
+    case 41: case 42: case 46: case 48: case 49:
+      return "TR";               // OpConstantTrue, False, Null, OpSpecConstantTrue, False
+    case 43: case 50: return "TRL"; // OpConstant, OpSpecConstant
+    case 44: case 51: return "TRI"; // OpConstantComposite, OpSpecConstantComposite
+    case 54:  return "TRli";     // OpFunction
+    case 55:  return "TR";       // OpFunctionParameter
+    case 56:  return "";         // OpFunctionEnd
+    case 57:  return "TRiI";     // OpFunctionCall
+    case 59:  return "TRli";     // OpVariable
+    case 60:  return "TRiii";    // OpImageTexelPointer
+    case 61:  return "TRiL";     // OpLoad
+    case 62:  return "iiL";      // OpStore
+    case 63:  return "iiL";      // OpCopyMemory
+    case 65: case 66: case 67: return "TRiI"; // OpAccessChain, InBounds, Ptr
+    case 68:  return "TRil";     // OpArrayLength
+    case 71:  return "ilL";      // OpDecorate
+    case 72:  return "illL";     // OpMemberDecorate
+    case 77:  return "TRii";     // OpVectorExtractDynamic
+    case 78:  return "TRiii";    // OpVectorInsertDynamic
+    case 79:  return "TRiiL";    // OpVectorShuffle
+    case 80:  return "TRI";      // OpCompositeConstruct
+    case 81:  return "TRiL";     // OpCompositeExtract
+    case 82:  return "TRiiL";    // OpCompositeInsert
+    case 83: case 84: return "TRi"; // OpCopyObject, OpTranspose
+    case 86:  return "TRii";     // OpSampledImage
+    case 87: case 88: case 91: case 92: case 95: case 98:
+      return "TRiiM";            // sample, fetch and read without a reference value
+    case 89: case 90: case 93: case 94: case 96: case 97:
+      return "TRiiiM";           // sample with depth reference, gathers
+    case 99:  return "iiiM";     // OpImageWrite
+    case 100: return "TRi";      // OpImage
+    case 103: return "TRii";     // OpImageQuerySizeLod
+    case 104: return "TRi";      // OpImageQuerySize
+    case 105: return "TRii";     // OpImageQueryLod
+    case 106: case 107: return "TRi"; // OpImageQueryLevels, Samples
+    case 169: return "TRiii";    // OpSelect
+    case 201: return "TRiiii";   // OpBitFieldInsert
+    case 202: case 203: return "TRiii"; // OpBitFieldSExtract, UExtract
+    case 218: case 219: return ""; // OpEmitVertex, OpEndPrimitive
+    case 224: return "iii";      // OpControlBarrier
+    case 225: return "ii";       // OpMemoryBarrier
+    case 227: return "TRiii";    // OpAtomicLoad
+    case 228: return "iiii";     // OpAtomicStore
+    case 229: return "TRiiii";   // OpAtomicExchange
+    case 230: return "TRiiiiii"; // OpAtomicCompareExchange
+    case 232: case 233: return "TRiii"; // OpAtomicIIncrement, IDecrement
+    case 245: return "TRI";      // OpPhi
+    case 246: return "iiL";      // OpLoopMerge
+    case 247: return "il";       // OpSelectionMerge
+    case 248: return "R";        // OpLabel
+    case 249: return "i";        // OpBranch
+    case 250: return "iiiL";     // OpBranchConditional
+    case 251: return "iiP";      // OpSwitch, 32 bit selectors only
+    case 252: case 253: case 255: return ""; // OpKill, OpReturn, OpUnreachable
+    case 254: return "i";        // OpReturnValue
+    case 332: return "ilI";      // OpDecorateId
+    }
+    return nullptr;
+  }
+
+  size_t skip_string(const std::vector<uint32_t>& module, size_t word, size_t end)
+  {
+    while (word < end)
+    {
+      uint32_t characters = module[word++];
+      if (((characters & 0xff) == 0) || ((characters & 0xff00) == 0) || ((characters & 0xff0000) == 0) || ((characters & 0xff000000) == 0))
+        break;
+    }
+    return word;
+  }
+
+  bool find_ids(const std::vector<uint32_t>& module, Instruction& instruction)
+  {
+    const char* layout = operand_layout(instruction.opcode);
+    if (layout == nullptr)
+      return false;
+
+    size_t word = instruction.offset + 1;
+    size_t end = instruction.offset + instruction.word_count;
+    for (const char* kind = layout; (*kind != '\0') && (word < end); ++kind)
+    {
+      switch (*kind)
+      {
+      case 'R':
+        instruction.result_position = static_cast<uint32_t>(word);
+        instruction.id_positions.push_back(word++);
+        break;
+      case 'T':
+      case 'i':
+        instruction.id_positions.push_back(word++);
+        break;
+      case 'l':
+        ++word;
+        break;
+      case 's':
+        word = skip_string(module, word, end);
+        break;
+      case 'M':
+        ++word;
+        // fall through
+      case 'I':
+        while (word < end)
+          instruction.id_positions.push_back(word++);
+        break;
+      case 'P':
+        for (; word + 1 < end; word += 2)
+          instruction.id_positions.push_back(word + 1);
+        word = end;
+        break;
+      case 'L':
+        word = end;
+        break;
+      }
+    }
+    return true;
+  }
+
+  // debug instructions are only split into words, their operands are never looked at
+  bool parse_module(const std::vector<uint32_t>& module, std::vector<Instruction>& instructions)
+  {
+    if ((module.size() < header_size) || (module[0] != spirv_magic))
+      return false;
+
+    uint32_t bound = module[3];
+    bool in_function = false;
+    bool has_int64 = false;
+    for (size_t offset = header_size; offset < module.size();)
+    {
+      Instruction instruction = {};
+      instruction.offset = offset;
+      instruction.opcode = static_cast<uint16_t>(module[offset] & 0xffff);
+      instruction.word_count = static_cast<uint16_t>(module[offset] >> 16);
+      if ((instruction.word_count == 0) || (offset + instruction.word_count > module.size()))
+        return false;
+
+      if (instruction.opcode == op_function)
+        in_function = true;
+      instruction.in_function = in_function;
+      if (instruction.opcode == op_function_end)
+        in_function = false;
+
+      if ((instruction.opcode == op_capability) && (instruction.word_count > 1) && (module[offset + 1] == capability_int64))
+        has_int64 = true;
+      if ((instruction.opcode == op_switch) && has_int64)
+        return false;
+
+      if (!is_debug(instruction.opcode))
+      {
+        if (!find_ids(module, instruction))
+          return false;
+        for (size_t position : instruction.id_positions)
+          if ((module[position] == 0) || (module[position] >= bound))
+            return false;
+      }
+
+      instructions.push_back(std::move(instruction));
+      offset += instructions.back().word_count;
+    }
+    return !in_function;
+  }
+}
+
+bool strip_spirv(const std::vector<uint32_t>& module, std::vector<uint32_t>& stripped)
+{
+  std::vector<Instruction> instructions;
+  if (!parse_module(module, instructions))
+    return false;
+
+  uint32_t bound = module[3];
+  std::vector<bool> kept(instructions.size(), true);
+  for (size_t i = 0; i < instructions.size(); ++i)
+    if (is_debug(instructions[i].opcode))
+      kept[i] = false;
+
+  // functions nothing calls starting from the entry points go away with their whole body
+  struct Function
+  {
+    size_t                first;
+    size_t                last;
+    std::vector<uint32_t> callees;
+  };
+  std::unordered_map<uint32_t, Function> functions;
+  std::vector<uint32_t> reachable;
+  uint32_t current_function = 0;
+  for (size_t i = 0; i < instructions.size(); ++i)
+  {
+    const Instruction& instruction = instructions[i];
+    if (instruction.opcode == op_entry_point)
+      reachable.push_back(module[instruction.offset + 2]);
+    else if (instruction.opcode == op_function)
+    {
+      current_function = module[instruction.result_position];
+      functions[current_function].first = i;
+    }
+    else if (instruction.opcode == op_function_end)
+      functions[current_function].last = i;
+    else if (instruction.opcode == op_function_call)
+      functions[current_function].callees.push_back(module[instruction.offset + 3]);
+  }
+
+  std::unordered_set<uint32_t> live_functions(reachable.begin(), reachable.end());
+  while (!reachable.empty())
+  {
+    uint32_t function = reachable.back();
+    reachable.pop_back();
+    auto found = functions.find(function);
+    if (found == functions.end())
+      return false;
+    for (uint32_t callee : found->second.callees)
+      if (live_functions.insert(callee).second)
+        reachable.push_back(callee);
+  }
+
+  for (const auto& function : functions)
+    if (live_functions.count(function.first) == 0)
+      std::fill(kept.begin() + function.second.first, kept.begin() + function.second.last + 1, false);
+
+  // drop definitions nobody uses anymore, decorations do not count as uses
+  std::vector<uint32_t> use_count(bound, 0);
+  for (size_t i = 0; i < instructions.size(); ++i)
+    if (kept[i] && !is_decoration(instructions[i].opcode))
+      for (size_t position : instructions[i].id_positions)
+        if (position != instructions[i].result_position)
+          ++use_count[module[position]];
+
+  // definitions come before their users, so walking backwards releases whole chains in one pass
+  for (size_t i = instructions.size(); i-- > 0;)
+  {
+    const Instruction& instruction = instructions[i];
+    if (!kept[i] || instruction.in_function || !is_removable_definition(instruction.opcode) ||
+      (use_count[module[instruction.result_position]] != 0))
+      continue;
+
+    kept[i] = false;
+    for (size_t position : instruction.id_positions)
+      if (position != instruction.result_position)
+        --use_count[module[position]];
+  }
+
+  std::vector<bool> defined(bound, false);
+  for (size_t i = 0; i < instructions.size(); ++i)
+    if (kept[i] && (instructions[i].result_position != 0))
+      defined[module[instructions[i].result_position]] = true;
+
+  for (size_t i = 0; i < instructions.size(); ++i)
+    if (kept[i] && is_decoration(instructions[i].opcode))
+      for (size_t position : instructions[i].id_positions)
+        if (!defined[module[position]])
+          kept[i] = false;
+
+  // ids are handed out in order of first appearance, so the bound ends up as small as possible
+  std::vector<uint32_t> remap(bound, 0);
+  uint32_t next_id = 1;
+  std::vector<uint32_t> output(module.begin(), module.begin() + header_size);
+  for (size_t i = 0; i < instructions.size(); ++i)
+  {
+    if (!kept[i])
+      continue;
+
+    const Instruction& instruction = instructions[i];
+    size_t base = output.size();
+    output.insert(output.end(), module.begin() + instruction.offset, module.begin() + instruction.offset + instruction.word_count);
+    for (size_t position : instruction.id_positions)
+    {
+      uint32_t& id = remap[module[position]];
+      if (id == 0)
+        id = next_id++;
+      output[base + (position - instruction.offset)] = id;
+    }
+  }
+  output[3] = next_id;
+
+  stripped.swap(output);
+  return true;
+}
+
+namespace
+{
+  struct ModuleInfo
+  {
+    std::vector<Instruction>                                       instructions;
+    std::unordered_map<uint32_t, size_t>                           definitions;
+    std::unordered_map<uint32_t, std::vector<std::string>>         decorations;
+    std::map<std::pair<uint32_t, uint32_t>, std::vector<std::string>> member_decorations;
+  };
+
+  std::string words_text(const std::vector<uint32_t>& module, size_t first, size_t end)
+  {
+    std::string text;
+    for (size_t word = first; word < end; ++word)
+      text += " " + std::to_string(module[word]);
+    return text;
+  }
+
+  bool analyze_module(const std::vector<uint32_t>& module, ModuleInfo& info)
+  {
+    if (!parse_module(module, info.instructions))
+      return false;
+
+    for (size_t i = 0; i < info.instructions.size(); ++i)
+    {
+      const Instruction& instruction = info.instructions[i];
+      size_t end = instruction.offset + instruction.word_count;
+      if ((instruction.result_position != 0) && !info.definitions.emplace(module[instruction.result_position], i).second)
+        return false;
+      if (instruction.opcode == op_decorate)
+        info.decorations[module[instruction.offset + 1]].push_back(words_text(module, instruction.offset + 2, end));
+      else if (instruction.opcode == op_member_decorate)
+        info.member_decorations[std::make_pair(module[instruction.offset + 1], module[instruction.offset + 2])].push_back(words_text(module, instruction.offset + 3, end));
+    }
+
+    // every id used has to be defined somewhere
+    for (const Instruction& instruction : info.instructions)
+      for (size_t position : instruction.id_positions)
+        if (info.definitions.count(module[position]) == 0)
+          return false;
+    return true;
+  }
+
+  // spells out a type, constant or variable with everything it references and its decorations,
+  // so the same declaration compares equal no matter which ids it got
+  std::string describe(const std::vector<uint32_t>& module, const ModuleInfo& info, uint32_t id, int depth)
+  {
+    auto definition = info.definitions.find(id);
+    if ((definition == info.definitions.end()) || (depth > 32))
+      return "?";
+
+    const Instruction& instruction = info.instructions[definition->second];
+    std::string text = std::to_string(instruction.opcode) + "(";
+    size_t end = instruction.offset + instruction.word_count;
+    for (size_t word = instruction.offset + 1; word < end; ++word)
+    {
+      if (word == instruction.result_position)
+        continue;
+      if (std::find(instruction.id_positions.begin(), instruction.id_positions.end(), word) != instruction.id_positions.end())
+        text += " " + describe(module, info, module[word], depth + 1);
+      else
+        text += " " + std::to_string(module[word]);
+    }
+    text += ")";
+
+    auto decorations = info.decorations.find(id);
+    if (decorations != info.decorations.end())
+    {
+      std::vector<std::string> sorted = decorations->second;
+      std::sort(sorted.begin(), sorted.end());
+      for (const std::string& decoration : sorted)
+        text += "[" + decoration + "]";
+    }
+    for (auto member = info.member_decorations.lower_bound(std::make_pair(id, 0u));
+      (member != info.member_decorations.end()) && (member->first.first == id); ++member)
+    {
+      std::vector<std::string> sorted = member->second;
+      std::sort(sorted.begin(), sorted.end());
+      text += "{" + std::to_string(member->first.second);
+      for (const std::string& decoration : sorted)
+        text += "[" + decoration + "]";
+      text += "}";
+    }
+    return text;
+  }
+
+  std::vector<std::string> interface_signature(const std::vector<uint32_t>& module, const ModuleInfo& info)
+  {
+    std::vector<std::string> header;
+    std::vector<std::string> variables;
+    std::unordered_map<uint32_t, std::string> entry_names;
+
+    for (const Instruction& instruction : info.instructions)
+    {
+      size_t end = instruction.offset + instruction.word_count;
+      switch (instruction.opcode)
+      {
+      case 10: case 11: case 14: case op_capability:
+        header.push_back(std::to_string(instruction.opcode) + words_text(module, instruction.offset + 1, end));
+        break;
+      case op_entry_point:
+      {
+        uint32_t function = module[instruction.offset + 2];
+        size_t name_end = skip_string(module, instruction.offset + 3, end);
+        std::string entry = "entry" + words_text(module, instruction.offset + 1, instruction.offset + 2) + words_text(module, instruction.offset + 3, name_end);
+        for (size_t word = name_end; word < end; ++word)
+          entry += " " + describe(module, info, module[word], 0);
+        entry_names[function] = entry;
+        header.push_back(entry);
+
+        // the entry point's own body has to keep its exact shape
+        std::string body = "body";
+        auto definition = info.definitions.find(function);
+        if (definition != info.definitions.end())
+          for (size_t i = definition->second; (i < info.instructions.size()) && (info.instructions[i].opcode != op_function_end); ++i)
+            if (!is_debug(info.instructions[i].opcode))
+              body += " " + std::to_string(info.instructions[i].opcode) + "/" + std::to_string(info.instructions[i].word_count);
+        header.push_back(body);
+        break;
+      }
+      case op_execution_mode:
+        header.push_back("mode " + entry_names[module[instruction.offset + 1]] + words_text(module, instruction.offset + 2, end));
+        break;
+      case op_variable:
+        if (!instruction.in_function)
+          variables.push_back(describe(module, info, module[instruction.result_position], 0));
+        break;
+      }
+    }
+
+    std::sort(variables.begin(), variables.end());
+    header.insert(header.end(), variables.begin(), variables.end());
+    return header;
+  }
+}
+
+bool validate_stripped_spirv(const std::vector<uint32_t>& original, const std::vector<uint32_t>& stripped)
+{
+  ModuleInfo original_info;
+  ModuleInfo stripped_info;
+  if (!analyze_module(original, original_info) || !analyze_module(stripped, stripped_info))
+    return false;
+
+  // the header's version and generator words carry over untouched
+  if ((original[1] != stripped[1]) || (original[2] != stripped[2]) || (stripped[3] > original[3]))
+    return false;
+
+  return interface_signature(original, original_info) == interface_signature(stripped, stripped_info);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// removes debug info (OpName, OpSource, OpLine, ...), functions unreachable from the entry points,
+// unused types and constants and the decorations left without a target, then renumbers ids densely
+// variables are always kept, so the module's interface does not change
+// fails without touching stripped when the module uses instructions the pass does not know
+bool strip_spirv(const std::vector<uint32_t>& module, std::vector<uint32_t>& stripped);
+
+// true when stripped is well formed and has the same capabilities, entry points, execution modes,
+// global variables with their decorations and types, and entry point bodies as original
+bool validate_stripped_spirv(const std::vector<uint32_t>& original, const std::vector<uint32_t>& stripped);
@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#include "atlaspacker.h"
+
+SkylinePacker::SkylinePacker(int width, int height)
+  : m_width(width), m_height(height), m_used_area(0)
+{
+  m_skyline.push_back({ 0, 0, width });
+}
+
+int SkylinePacker::FindY(size_t node_index, int width, int height) const
+{
+  int x = m_skyline[node_index].x;
+  if (x + width > m_width)
+    return -1;
+
+  // the rectangle rests on the highest node it spans
+  int y = 0;
+  int width_left = width;
+  for (size_t i = node_index; width_left > 0; ++i)
+  {
+    if (i == m_skyline.size())
+      return -1;
+
+    y = std::max(y, m_skyline[i].y);
+    if (y + height > m_height)
+      return -1;
+
+    width_left -= m_skyline[i].width;
+  }
+  return y;
+}
+
+bool SkylinePacker::Insert(int width, int height, AtlasRect& rect)
+{
+  size_t best_index = m_skyline.size();
+  int    best_top = INT32_MAX;
+  int    best_width = INT32_MAX;
+  int    best_y = 0;
+
+  for (size_t i = 0; i < m_skyline.size(); ++i)
+  {
+    int y = FindY(i, width, height);
+    if (y < 0)
+      continue;
+
+    // lowest top edge first, narrower node on ties so wide gaps stay open for wide rectangles
+    if ((y + height < best_top) || ((y + height == best_top) && (m_skyline[i].width < best_width)))
+    {
+      best_index = i;
+      best_top = y + height;
+      best_width = m_skyline[i].width;
+      best_y = y;
+    }
+  }
+
+  if (best_index == m_skyline.size())
+    return false;
+
+  rect = { m_skyline[best_index].x, best_y, width, height };
+
+  m_skyline.insert(m_skyline.begin() + best_index, { rect.x, best_y + height, width });
+
+  // nodes now covered by the new one shrink or go away
+  for (size_t i = best_index + 1; i < m_skyline.size();)
+  {
+    const SkylineNode& previous = m_skyline[i - 1];
+    int overlap = previous.x + previous.width - m_skyline[i].x;
+    if (overlap <= 0)
+      break;
+
+    if (overlap >= m_skyline[i].width)
+    {
+      m_skyline.erase(m_skyline.begin() + i);
+      continue;
+    }
+
+    m_skyline[i].x += overlap;
+    m_skyline[i].width -= overlap;
+    break;
+  }
+
+  // neighbours at the same height are one node
+  for (size_t i = 0; i + 1 < m_skyline.size();)
+  {
+    if (m_skyline[i].y == m_skyline[i + 1].y)
+    {
+      m_skyline[i].width += m_skyline[i + 1].width;
+      m_skyline.erase(m_skyline.begin() + i + 1);
+    }
+    else
+      ++i;
+  }
+
+  m_used_area += static_cast<int64_t>(width) * height;
+  return true;
+}
+
+float SkylinePacker::Occupancy() const
+{
+  return static_cast<float>(static_cast<double>(m_used_area) / (static_cast<double>(m_width) * m_height));
+}
+
+// copies the image into the page and repeats its border texels into the padding
+static void blit_padded(const AtlasImage& image, const AtlasRect& rect, int padding, AtlasPage& page)
+{
+  for (int y = 0; y < rect.height; ++y)
+  {
+    int source_y = std::min(std::max(y - padding, 0), image.height - 1);
+    const char* source_row = image.rgba + static_cast<size_t>(source_y) * image.width * 4;
+    char* page_row = page.rgba.data() + (static_cast<size_t>(rect.y + y) * page.width + rect.x) * 4;
+
+    for (int x = 0; x < padding; ++x)
+    {
+      memcpy(page_row + x * 4, source_row, 4);
+      memcpy(page_row + (padding + image.width + x) * 4, source_row + (image.width - 1) * 4, 4);
+    }
+    memcpy(page_row + padding * 4, source_row, static_cast<size_t>(image.width) * 4);
+  }
+}
+
+bool build_atlas(const std::vector<AtlasImage>& images, int page_size, int padding, std::vector<AtlasPage>& pages, std::vector<AtlasRegion>& regions)
+{
+  pages.clear();
+  regions.assign(images.size(), AtlasRegion());
+
+  // tall images first, skyline packing wastes the least space that way
+  std::vector<size_t> order(images.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&images](size_t a, size_t b)
+  {
+    if (images[a].height != images[b].height)
+      return images[a].height > images[b].height;
+    return images[a].width > images[b].width;
+  });
+
+  std::vector<SkylinePacker> packers;
+  std::vector<AtlasRect>     rects(images.size());
+  std::vector<uint32_t>      image_pages(images.size());
+
+  for (size_t index : order)
+  {
+    int width = images[index].width + padding * 2;
+    int height = images[index].height + padding * 2;
+    if ((width > page_size) || (height > page_size))
+      return false;
+
+    size_t page = 0;
+    while ((page < packers.size()) && !packers[page].Insert(width, height, rects[index]))
+      ++page;
+
+    if (page == packers.size())
+    {
+      packers.emplace_back(page_size, page_size);
+      packers.back().Insert(width, height, rects[index]);
+    }
+    image_pages[index] = static_cast<uint32_t>(page);
+  }
+
+  pages.resize(packers.size());
+  for (size_t i = 0; i < pages.size(); ++i)
+  {
+    pages[i].width = page_size;
+    pages[i].height = page_size;
+    pages[i].rgba.assign(static_cast<size_t>(page_size) * page_size * 4, 0);
+    pages[i].occupancy = packers[i].Occupancy();
+  }
+
+  float texel_size = 1.0f / page_size;
+  for (size_t i = 0; i < images.size(); ++i)
+  {
+    const AtlasRect& rect = rects[i];
+    blit_padded(images[i], rect, padding, pages[image_pages[i]]);
+
+    regions[i] = {
+      image_pages[i],
+      (rect.x + padding) * texel_size,
+      (rect.y + padding) * texel_size,
+      (rect.x + padding + images[i].width) * texel_size,
+      (rect.y + padding + images[i].height) * texel_size
+    };
+  }
+
+  return true;
+}
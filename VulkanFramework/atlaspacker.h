@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// texture atlas building, no Vulkan dependency
+// images are tightly packed 4 component RGBA8, pages come out the same way
+
+struct AtlasRect
+{
+  int x, y;
+  int width, height;
+};
+
+// skyline bottom-left packer, keeps the top outline of everything placed so far
+// and puts each rectangle where its top edge ends up lowest
+class SkylinePacker
+{
+private:
+  struct SkylineNode
+  {
+    int x, y;
+    int width;
+  };
+  std::vector<SkylineNode> m_skyline;
+  int                      m_width;
+  int                      m_height;
+  int64_t                  m_used_area;
+
+  int FindY(size_t node_index, int width, int height) const; // -1 when the rectangle does not fit there
+
+public:
+  SkylinePacker(int width, int height);
+
+  bool Insert(int width, int height, AtlasRect& rect);
+  float Occupancy() const;
+};
+
+struct AtlasImage
+{
+  const char* rgba;
+  int         width;
+  int         height;
+};
+
+struct AtlasRegion
+{
+  uint32_t page;
+  float    u0, v0;
+  float    u1, v1;
+};
+
+struct AtlasPage
+{
+  int               width;
+  int               height;
+  std::vector<char> rgba;
+  float             occupancy;
+};
+
+// packs all images into as few page_size x page_size pages as it can, regions come back in input order
+// padding texels around each image repeat its edge, so bilinear filtering never picks up a neighbour
+bool build_atlas(const std::vector<AtlasImage>& images, int page_size, int padding, std::vector<AtlasPage>& pages, std::vector<AtlasRegion>& regions);
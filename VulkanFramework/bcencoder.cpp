@@ -0,0 +1,605 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BC_ENCODER_SSE2
+#endif
+
+#include "bcencoder.h"
+#include "threadpool.h"
+
+// pixels of one 4x4 block split by channel, so four pixels fit in one SSE register
+struct alignas(16) BlockPixels
+{
+  float r[16];
+  float g[16];
+  float b[16];
+  float a[16];
+};
+
+struct alignas(16) BlockPalette
+{
+  float r[16];
+  float g[16];
+  float b[16];
+  float a[16];
+  int   size;
+};
+
+constexpr float bc1_weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+constexpr int   bc7_weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static void load_block(const uint8_t* rgba, int width, int height, int block_x, int block_y, BlockPixels& block)
+{
+  // blocks hanging over the image edge repeat the last row / column
+  for (int y = 0; y < 4; ++y)
+    for (int x = 0; x < 4; ++x)
+    {
+      int source_x = std::min(block_x * 4 + x, width - 1);
+      int source_y = std::min(block_y * 4 + y, height - 1);
+      const uint8_t* pixel = rgba + (static_cast<size_t>(source_y) * width + source_x) * 4;
+
+      block.r[y * 4 + x] = pixel[0];
+      block.g[y * 4 + x] = pixel[1];
+      block.b[y * 4 + x] = pixel[2];
+      block.a[y * 4 + x] = pixel[3];
+    }
+}
+
+static float channel(const BlockPixels& block, int c, int i)
+{
+  switch (c)
+  {
+  case 0: return block.r[i];
+  case 1: return block.g[i];
+  case 2: return block.b[i];
+  default: return block.a[i];
+  }
+}
+
+// nearest palette entry for each pixel, returns summed squared error
+static float assign_indices(const BlockPixels& block, const BlockPalette& palette, bool use_alpha, uint8_t indices[16])
+{
+  float total_error = 0.0f;
+
+#ifdef BC_ENCODER_SSE2
+  __m128 alpha_mask = use_alpha ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : _mm_setzero_ps();
+
+  for (int p = 0; p < 16; p += 4)
+  {
+    __m128 pr = _mm_load_ps(block.r + p);
+    __m128 pg = _mm_load_ps(block.g + p);
+    __m128 pb = _mm_load_ps(block.b + p);
+    __m128 pa = _mm_load_ps(block.a + p);
+
+    __m128  best_error = _mm_set1_ps(FLT_MAX);
+    __m128i best_index = _mm_setzero_si128();
+
+    for (int i = 0; i < palette.size; ++i)
+    {
+      __m128 dr = _mm_sub_ps(pr, _mm_set1_ps(palette.r[i]));
+      __m128 dg = _mm_sub_ps(pg, _mm_set1_ps(palette.g[i]));
+      __m128 db = _mm_sub_ps(pb, _mm_set1_ps(palette.b[i]));
+      __m128 da = _mm_and_ps(_mm_sub_ps(pa, _mm_set1_ps(palette.a[i])), alpha_mask);
+
+      __m128 error = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)),
+                                _mm_add_ps(_mm_mul_ps(db, db), _mm_mul_ps(da, da)));
+
+      __m128i closer = _mm_castps_si128(_mm_cmplt_ps(error, best_error));
+      best_error = _mm_min_ps(error, best_error);
+      best_index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(i)), _mm_andnot_si128(closer, best_index));
+    }
+
+    alignas(16) int32_t lane_index[4];
+    alignas(16) float   lane_error[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lane_index), best_index);
+    _mm_store_ps(lane_error, best_error);
+
+    for (int lane = 0; lane < 4; ++lane)
+    {
+      indices[p + lane] = static_cast<uint8_t>(lane_index[lane]);
+      total_error += lane_error[lane];
+    }
+  }
+#else
+  for (int p = 0; p < 16; ++p)
+  {
+    float best_error = FLT_MAX;
+    for (int i = 0; i < palette.size; ++i)
+    {
+      float dr = block.r[p] - palette.r[i];
+      float dg = block.g[p] - palette.g[i];
+      float db = block.b[p] - palette.b[i];
+      float da = use_alpha ? block.a[p] - palette.a[i] : 0.0f;
+      float error = dr * dr + dg * dg + db * db + da * da;
+      if (error < best_error)
+      {
+        best_error = error;
+        indices[p] = static_cast<uint8_t>(i);
+      }
+    }
+    total_error += best_error;
+  }
+#endif
+
+  return total_error;
+}
+
+// min/max box, with the diagonal flipped per channel when it runs against the dominant channel
+static void bounding_box_endpoints(const BlockPixels& block, int channels, float e0[4], float e1[4])
+{
+  float mean[4] = {};
+  for (int c = 0; c < channels; ++c)
+  {
+    e0[c] = 255.0f;
+    e1[c] = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+      float value = channel(block, c, i);
+      e0[c] = std::min(e0[c], value);
+      e1[c] = std::max(e1[c], value);
+      mean[c] += value;
+    }
+    mean[c] /= 16.0f;
+  }
+
+  int dominant = 0;
+  for (int c = 1; c < channels; ++c)
+    if (e1[c] - e0[c] > e1[dominant] - e0[dominant])
+      dominant = c;
+
+  for (int c = 0; c < channels; ++c)
+  {
+    if (c == dominant)
+      continue;
+
+    float covariance = 0.0f;
+    for (int i = 0; i < 16; ++i)
+      covariance += (channel(block, dominant, i) - mean[dominant]) * (channel(block, c, i) - mean[c]);
+    if (covariance < 0.0f)
+      std::swap(e0[c], e1[c]);
+  }
+}
+
+// endpoints at the extent of the block along its principal axis
+static void principal_axis_endpoints(const BlockPixels& block, int channels, float e0[4], float e1[4])
+{
+  float mean[4] = {};
+  for (int c = 0; c < channels; ++c)
+  {
+    for (int i = 0; i < 16; ++i)
+      mean[c] += channel(block, c, i);
+    mean[c] /= 16.0f;
+  }
+
+  float covariance[4][4] = {};
+  for (int i = 0; i < 16; ++i)
+    for (int x = 0; x < channels; ++x)
+      for (int y = x; y < channels; ++y)
+        covariance[x][y] += (channel(block, x, i) - mean[x]) * (channel(block, y, i) - mean[y]);
+  for (int x = 0; x < channels; ++x)
+    for (int y = 0; y < x; ++y)
+      covariance[x][y] = covariance[y][x];
+
+  // power iteration, converges quickly for the 3x3 / 4x4 case
+  float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+  for (int iteration = 0; iteration < 8; ++iteration)
+  {
+    float next[4] = {};
+    float length = 0.0f;
+    for (int x = 0; x < channels; ++x)
+    {
+      for (int y = 0; y < channels; ++y)
+        next[x] += covariance[x][y] * axis[y];
+      length = std::max(length, std::fabs(next[x]));
+    }
+
+    // flat block, every pixel is the mean
+    if (length < 1e-6f)
+      break;
+
+    for (int c = 0; c < channels; ++c)
+      axis[c] = next[c] / length;
+  }
+
+  float axis_length_squared = 0.0f;
+  for (int c = 0; c < channels; ++c)
+    axis_length_squared += axis[c] * axis[c];
+
+  float min_t = 0.0f, max_t = 0.0f;
+  for (int i = 0; i < 16; ++i)
+  {
+    float t = 0.0f;
+    for (int c = 0; c < channels; ++c)
+      t += (channel(block, c, i) - mean[c]) * axis[c];
+    t /= axis_length_squared;
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+
+  for (int c = 0; c < channels; ++c)
+  {
+    e0[c] = std::min(std::max(mean[c] + axis[c] * min_t, 0.0f), 255.0f);
+    e1[c] = std::min(std::max(mean[c] + axis[c] * max_t, 0.0f), 255.0f);
+  }
+}
+
+// best endpoints for fixed indices, solves the 2x2 normal equations per channel
+static void least_squares_endpoints(const BlockPixels& block, const uint8_t indices[16], const float* weights, int channels, float e0[4], float e1[4])
+{
+  float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+  float ax[4] = {}, bx[4] = {};
+
+  for (int i = 0; i < 16; ++i)
+  {
+    float w = weights[indices[i]];
+    float a = 1.0f - w;
+    aa += a * a;
+    ab += a * w;
+    bb += w * w;
+    for (int c = 0; c < channels; ++c)
+    {
+      ax[c] += a * channel(block, c, i);
+      bx[c] += w * channel(block, c, i);
+    }
+  }
+
+  float determinant = aa * bb - ab * ab;
+  if (std::fabs(determinant) < 1e-6f)
+    return;
+
+  for (int c = 0; c < channels; ++c)
+  {
+    e0[c] = std::min(std::max((bb * ax[c] - ab * bx[c]) / determinant, 0.0f), 255.0f);
+    e1[c] = std::min(std::max((aa * bx[c] - ab * ax[c]) / determinant, 0.0f), 255.0f);
+  }
+}
+
+static uint16_t pack_565(const float color[4])
+{
+  int r = std::min(std::max(static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+  int g = std::min(std::max(static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+  int b = std::min(std::max(static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+  return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void unpack_565(uint16_t packed, float color[4])
+{
+  int r = (packed >> 11) & 31;
+  int g = (packed >> 5) & 63;
+  int b = packed & 31;
+  color[0] = static_cast<float>((r << 3) | (r >> 2));
+  color[1] = static_cast<float>((g << 2) | (g >> 4));
+  color[2] = static_cast<float>((b << 3) | (b >> 2));
+  color[3] = 255.0f;
+}
+
+// quantizes endpoints, writes the block and returns its error
+// endpoints are swapped in place when the packed order has to be flipped, so indices keep matching them
+static float write_color_block(const BlockPixels& block, float e0[4], float e1[4], uint8_t indices[16], uint8_t output[8])
+{
+  uint16_t c0 = pack_565(e0);
+  uint16_t c1 = pack_565(e1);
+
+  // four color mode needs c0 > c1
+  if (c0 < c1)
+  {
+    std::swap(c0, c1);
+    for (int c = 0; c < 3; ++c)
+      std::swap(e0[c], e1[c]);
+  }
+
+  BlockPalette palette;
+  float p0[4], p1[4];
+  unpack_565(c0, p0);
+  unpack_565(c1, p1);
+
+  palette.size = (c0 == c1) ? 1 : 4;
+  palette.r[0] = p0[0]; palette.g[0] = p0[1]; palette.b[0] = p0[2];
+  palette.r[1] = p1[0]; palette.g[1] = p1[1]; palette.b[1] = p1[2];
+  palette.r[2] = (2.0f * p0[0] + p1[0]) / 3.0f; palette.g[2] = (2.0f * p0[1] + p1[1]) / 3.0f; palette.b[2] = (2.0f * p0[2] + p1[2]) / 3.0f;
+  palette.r[3] = (p0[0] + 2.0f * p1[0]) / 3.0f; palette.g[3] = (p0[1] + 2.0f * p1[1]) / 3.0f; palette.b[3] = (p0[2] + 2.0f * p1[2]) / 3.0f;
+
+  float error = assign_indices(block, palette, false, indices);
+
+  uint32_t packed_indices = 0;
+  for (int i = 0; i < 16; ++i)
+    packed_indices |= static_cast<uint32_t>(indices[i]) << (i * 2);
+
+  output[0] = static_cast<uint8_t>(c0 & 0xff);
+  output[1] = static_cast<uint8_t>(c0 >> 8);
+  output[2] = static_cast<uint8_t>(c1 & 0xff);
+  output[3] = static_cast<uint8_t>(c1 >> 8);
+  memcpy(output + 4, &packed_indices, sizeof(packed_indices)); // block data is little endian, like every target we run on
+
+  return error;
+}
+
+static void encode_color_block(const BlockPixels& block, BCQuality quality, uint8_t output[8])
+{
+  float e0[4], e1[4];
+  uint8_t indices[16];
+
+  if (quality == BCQuality::Fast)
+  {
+    bounding_box_endpoints(block, 3, e0, e1);
+
+    // pull endpoints inside the box a bit, the extremes are rarely hit exactly
+    for (int c = 0; c < 3; ++c)
+    {
+      float inset = (e1[c] - e0[c]) / 16.0f;
+      e0[c] += inset;
+      e1[c] -= inset;
+    }
+
+    write_color_block(block, e0, e1, indices, output);
+    return;
+  }
+
+  principal_axis_endpoints(block, 3, e0, e1);
+
+  uint8_t candidate[8];
+  float best_error = write_color_block(block, e0, e1, indices, output);
+  for (int iteration = 0; iteration < 2; ++iteration)
+  {
+    least_squares_endpoints(block, indices, bc1_weights, 3, e0, e1);
+
+    float error = write_color_block(block, e0, e1, indices, candidate);
+    if (error >= best_error)
+      break;
+
+    best_error = error;
+    memcpy(output, candidate, sizeof(candidate));
+  }
+}
+
+static void encode_alpha_block(const BlockPixels& block, uint8_t output[8])
+{
+  float min_alpha = 255.0f, max_alpha = 0.0f;
+  for (int i = 0; i < 16; ++i)
+  {
+    min_alpha = std::min(min_alpha, block.a[i]);
+    max_alpha = std::max(max_alpha, block.a[i]);
+  }
+
+  int a0 = static_cast<int>(max_alpha + 0.5f);
+  int a1 = static_cast<int>(min_alpha + 0.5f);
+
+  // a0 > a1 selects the eight value mode
+  int palette[8] = { a0, a1 };
+  for (int i = 2; i < 8; ++i)
+    palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+
+  uint64_t packed_indices = 0;
+  if (a0 != a1)
+    for (int p = 0; p < 16; ++p)
+    {
+      int best_index = 0;
+      float best_error = FLT_MAX;
+      for (int i = 0; i < 8; ++i)
+      {
+        float error = std::fabs(block.a[p] - palette[i]);
+        if (error < best_error)
+        {
+          best_error = error;
+          best_index = i;
+        }
+      }
+      packed_indices |= static_cast<uint64_t>(best_index) << (p * 3);
+    }
+
+  output[0] = static_cast<uint8_t>(a0);
+  output[1] = static_cast<uint8_t>(a1);
+  for (int i = 0; i < 6; ++i)
+    output[2 + i] = static_cast<uint8_t>(packed_indices >> (i * 8));
+}
+
+struct BC7Endpoint
+{
+  int color[4]; // 7 bits per channel
+  int p_bit;
+};
+
+static BC7Endpoint quantize_bc7_endpoint(const float value[4], int p_bit)
+{
+  BC7Endpoint endpoint;
+  endpoint.p_bit = p_bit;
+  for (int c = 0; c < 4; ++c)
+    endpoint.color[c] = std::min(std::max(static_cast<int>((value[c] - p_bit) / 2.0f + 0.5f), 0), 127);
+  return endpoint;
+}
+
+static float bc7_endpoint_error(const BC7Endpoint& endpoint, const float value[4])
+{
+  float error = 0.0f;
+  for (int c = 0; c < 4; ++c)
+  {
+    float difference = static_cast<float>((endpoint.color[c] << 1) | endpoint.p_bit) - value[c];
+    error += difference * difference;
+  }
+  return error;
+}
+
+static float evaluate_bc7(const BlockPixels& block, const BC7Endpoint& e0, const BC7Endpoint& e1, uint8_t indices[16])
+{
+  BlockPalette palette;
+  palette.size = 16;
+
+  float* palette_channels[4] = { palette.r, palette.g, palette.b, palette.a };
+  for (int c = 0; c < 4; ++c)
+  {
+    int v0 = (e0.color[c] << 1) | e0.p_bit;
+    int v1 = (e1.color[c] << 1) | e1.p_bit;
+    for (int i = 0; i < 16; ++i)
+      palette_channels[c][i] = static_cast<float>(((64 - bc7_weights[i]) * v0 + bc7_weights[i] * v1 + 32) >> 6);
+  }
+
+  return assign_indices(block, palette, true, indices);
+}
+
+class BitWriter
+{
+private:
+  uint8_t* m_data;
+  int      m_position = 0;
+
+public:
+  BitWriter(uint8_t* data) : m_data(data) {}
+
+  void Write(uint32_t value, int bits)
+  {
+    for (int i = 0; i < bits; ++i, ++m_position)
+      if ((value >> i) & 1)
+        m_data[m_position >> 3] |= static_cast<uint8_t>(1 << (m_position & 7));
+  }
+};
+
+static void write_bc7_mode6(BC7Endpoint e0, BC7Endpoint e1, uint8_t indices[16], uint8_t output[16])
+{
+  // the anchor index only has 3 bits, so its top bit must be zero
+  if (indices[0] & 8)
+  {
+    std::swap(e0, e1);
+    for (int i = 0; i < 16; ++i)
+      indices[i] = static_cast<uint8_t>(15 - indices[i]);
+  }
+
+  memset(output, 0, 16);
+  BitWriter writer(output);
+
+  writer.Write(1 << 6, 7); // mode 6
+  for (int c = 0; c < 4; ++c)
+  {
+    writer.Write(e0.color[c], 7);
+    writer.Write(e1.color[c], 7);
+  }
+  writer.Write(e0.p_bit, 1);
+  writer.Write(e1.p_bit, 1);
+
+  writer.Write(indices[0], 3);
+  for (int i = 1; i < 16; ++i)
+    writer.Write(indices[i], 4);
+}
+
+static void encode_bc7_block(const BlockPixels& block, BCQuality quality, uint8_t output[16])
+{
+  float e0[4], e1[4];
+  uint8_t indices[16];
+
+  if (quality == BCQuality::Fast)
+  {
+    bounding_box_endpoints(block, 4, e0, e1);
+
+    // pick each p bit on its own endpoint, good enough for the fast path
+    BC7Endpoint q0 = quantize_bc7_endpoint(e0, 0), q0_odd = quantize_bc7_endpoint(e0, 1);
+    BC7Endpoint q1 = quantize_bc7_endpoint(e1, 0), q1_odd = quantize_bc7_endpoint(e1, 1);
+    if (bc7_endpoint_error(q0_odd, e0) < bc7_endpoint_error(q0, e0))
+      q0 = q0_odd;
+    if (bc7_endpoint_error(q1_odd, e1) < bc7_endpoint_error(q1, e1))
+      q1 = q1_odd;
+
+    evaluate_bc7(block, q0, q1, indices);
+    write_bc7_mode6(q0, q1, indices, output);
+    return;
+  }
+
+  principal_axis_endpoints(block, 4, e0, e1);
+
+  float weights[16];
+  for (int i = 0; i < 16; ++i)
+    weights[i] = bc7_weights[i] / 64.0f;
+
+  float       best_error = FLT_MAX;
+  BC7Endpoint best_e0 = {}, best_e1 = {};
+  uint8_t     best_indices[16] = {};
+
+  for (int iteration = 0; iteration < 3; ++iteration)
+  {
+    bool improved = false;
+
+    // all four p bit combinations, judged on the decoded block
+    for (int p_bits = 0; p_bits < 4; ++p_bits)
+    {
+      BC7Endpoint q0 = quantize_bc7_endpoint(e0, p_bits & 1);
+      BC7Endpoint q1 = quantize_bc7_endpoint(e1, p_bits >> 1);
+
+      float error = evaluate_bc7(block, q0, q1, indices);
+      if (error < best_error)
+      {
+        best_error = error;
+        best_e0 = q0;
+        best_e1 = q1;
+        memcpy(best_indices, indices, sizeof(indices));
+        improved = true;
+      }
+    }
+
+    if (!improved || best_error == 0.0f)
+      break;
+
+    least_squares_endpoints(block, best_indices, weights, 4, e0, e1);
+  }
+
+  write_bc7_mode6(best_e0, best_e1, best_indices, output);
+}
+
+size_t bc_block_size(BCFormat format)
+{
+  return format == BCFormat::BC1 ? 8 : 16;
+}
+
+size_t bc_encoded_size(BCFormat format, int width, int height)
+{
+  if ((width <= 0) || (height <= 0))
+    return 0;
+
+  size_t blocks_x = (width + 3) / 4;
+  size_t blocks_y = (height + 3) / 4;
+  return blocks_x * blocks_y * bc_block_size(format);
+}
+
+std::vector<char> encode_bc(const char* rgba, int width, int height, BCFormat format, BCQuality quality)
+{
+  if ((rgba == nullptr) || (width <= 0) || (height <= 0))
+    return std::vector<char>();
+
+  int    blocks_x = (width + 3) / 4;
+  int    blocks_y = (height + 3) / 4;
+  size_t block_size = bc_block_size(format);
+
+  std::vector<char> output(bc_encoded_size(format, width, height));
+  const uint8_t* pixels = reinterpret_cast<const uint8_t*>(rgba);
+  uint8_t* blocks = reinterpret_cast<uint8_t*>(output.data());
+
+  // blocks are independent, hand out whole block rows to the workers
+  threadPool.ParallelFor(blocks_y, [&](size_t begin, size_t end)
+  {
+    BlockPixels block;
+    for (size_t block_y = begin; block_y < end; ++block_y)
+      for (int block_x = 0; block_x < blocks_x; ++block_x)
+      {
+        load_block(pixels, width, height, block_x, static_cast<int>(block_y), block);
+        uint8_t* destination = blocks + (block_y * blocks_x + block_x) * block_size;
+
+        switch (format)
+        {
+        case BCFormat::BC1:
+          encode_color_block(block, quality, destination);
+          break;
+        case BCFormat::BC3:
+          encode_alpha_block(block, destination);
+          encode_color_block(block, quality, destination + 8);
+          break;
+        case BCFormat::BC7:
+          encode_bc7_block(block, quality, destination);
+          break;
+        }
+      }
+  });
+
+  return output;
+}
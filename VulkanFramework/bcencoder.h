@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+
+// CPU block compression encoder, no Vulkan dependency so offline tools can link it with threadpool.cpp only
+// input is always tightly packed 4 component RGBA8, output is block rows top to bottom
+
+enum class BCFormat
+{
+  BC1, // RGB, 8 bytes per 4x4 block, alpha is dropped
+  BC3, // RGBA, 16 bytes per 4x4 block, BC1 color + interpolated alpha
+  BC7  // RGBA, 16 bytes per 4x4 block, mode 6 only
+};
+
+enum class BCQuality
+{
+  Fast,   // bounding box endpoints, one index pass
+  Quality // principal axis endpoints with least squares refinement
+};
+
+size_t bc_block_size(BCFormat format);
+size_t bc_encoded_size(BCFormat format, int width, int height);
+std::vector<char> encode_bc(const char* rgba, int width, int height, BCFormat format, BCQuality quality);
@@ -3,6 +3,10 @@
 #include <fstream>
 
 #include "fileio.h"
+#include "hash.h"
+#include "imagecache.h"
+#include "mipmap.h"
+#include "pixelconvert.h"
 
 #include "assert.h"
 #define STB_IMAGE_IMPLEMENTATION
@@ -31,6 +35,57 @@ std::vector<char> read_binary_file(std::string const& file_name)
   return result;
 }
 
+bool read_image_info(std::string const& filename, int* width, int* height, int* components)
+{
+  int tmp_width = 0, tmp_height = 0, tmp_components = 0;
+  if (!stbi_info(filename.c_str(), &tmp_width, &tmp_height, &tmp_components))
+  {
+    assert(("Could not read image info of \"" + filename + "\"!").c_str(), "Vulkan", Assert::Error);
+    return false;
+  }
+
+  if (width)
+    *width = tmp_width;
+  if (height)
+    *height = tmp_height;
+  if (components)
+    *components = tmp_components;
+  return true;
+}
+
+static std::vector<char> decode_image(std::vector<char>& file_data, int requested_components, int* width, int* height, int* components)
+{
+  // RGB sources (every jpg) are decoded as RGB and widened with the SIMD kernel, stb's own expansion is scalar
+  int decode_components = requested_components;
+  int info_width = 0, info_height = 0, info_components = 0;
+  if ((requested_components == 4) &&
+    stbi_info_from_memory(reinterpret_cast<unsigned char*>(&file_data[0]), static_cast<int>(file_data.size()), &info_width, &info_height, &info_components) &&
+    (info_components == 3))
+    decode_components = 3;
+
+  int tmp_width = 0, tmp_height = 0, tmp_components = 0;
+  unsigned char* image_data = stbi_load_from_memory(reinterpret_cast<unsigned char*>(&file_data[0]), static_cast<int>(file_data.size()), &tmp_width, &tmp_height, &tmp_components, decode_components);
+  if ((image_data == nullptr) || (tmp_width <= 0) || (tmp_height <= 0) || (tmp_components <= 0))
+  {
+    assert("Could not read image data!", "Vulkan", Assert::Error);
+    return std::vector<char>();
+  }
+
+  int size = (tmp_width) * (tmp_height) * (requested_components <= 0 ? tmp_components : requested_components);
+  *width = tmp_width;
+  *height = tmp_height;
+  *components = tmp_components;
+
+  std::vector<char> output(size);
+  if (decode_components != requested_components)
+    rgb_to_rgba(reinterpret_cast<const char*>(image_data), output.data(), static_cast<size_t>(tmp_width) * tmp_height);
+  else
+    memcpy(output.data(), image_data, size);
+
+  stbi_image_free(image_data);
+  return output;
+}
+
 std::vector<char> read_image(std::string const& filename, int requested_components, int* width, int* height, int* components, int* data_size)
 {
   std::vector<char> file_data = read_binary_file(filename);
@@ -40,17 +95,23 @@ std::vector<char> read_image(std::string const& filename, int requested_componen
     return std::vector<char>();
   }
 
+  // decoded pixels are cached by source content, hashing the file costs a fraction of decoding it
+  uint64_t source_hash = hash_bytes(file_data.data(), file_data.size());
+  std::vector<std::vector<char>> levels;
   int tmp_width = 0, tmp_height = 0, tmp_components = 0;
-  unsigned char* image_data = stbi_load_from_memory(reinterpret_cast<unsigned char*>(&file_data[0]), static_cast<int>(file_data.size()), &tmp_width, &tmp_height, &tmp_components, requested_components);
-  if ((image_data == nullptr) || (tmp_width <= 0) || (tmp_height <= 0) || (tmp_components <= 0))
+
+  if ((requested_components <= 0) || !imageCache.Load(source_hash, requested_components, false, &tmp_width, &tmp_height, &tmp_components, levels))
   {
-    assert("Could not read image data!", "Vulkan", Assert::Error);
-    return std::vector<char>();
+    levels.assign(1, decode_image(file_data, requested_components, &tmp_width, &tmp_height, &tmp_components));
+    if (levels[0].empty())
+      return std::vector<char>();
+
+    if (requested_components > 0)
+      imageCache.Store(source_hash, requested_components, false, tmp_width, tmp_height, tmp_components, levels);
   }
 
-  int size = (tmp_width) * (tmp_height) * (requested_components <= 0 ? tmp_components : requested_components);
   if (data_size)
-    *data_size = size;
+    *data_size = static_cast<int>(levels[0].size());
   if (width)
     *width = tmp_width;
   if (height)
@@ -58,9 +119,40 @@ std::vector<char> read_image(std::string const& filename, int requested_componen
   if (components)
     *components = tmp_components;
 
-  std::vector<char> output(size);
-  memcpy(output.data(), image_data, size);
+  return std::move(levels[0]);
+}
 
-  stbi_image_free(image_data);
-  return output;
-}
\ No newline at end of file
+std::vector<std::vector<char>> read_image_mips(std::string const& filename, int* width, int* height)
+{
+  std::vector<char> file_data = read_binary_file(filename);
+  if (file_data.size() == 0)
+  {
+    assert("Could not read image data!", "Vulkan", Assert::Error);
+    return std::vector<std::vector<char>>();
+  }
+
+  uint64_t source_hash = hash_bytes(file_data.data(), file_data.size());
+  std::vector<std::vector<char>> levels;
+  int tmp_width = 0, tmp_height = 0, tmp_components = 0;
+
+  if (!imageCache.Load(source_hash, 4, true, &tmp_width, &tmp_height, &tmp_components, levels))
+  {
+    std::vector<char> image = decode_image(file_data, 4, &tmp_width, &tmp_height, &tmp_components);
+    if (image.empty())
+      return std::vector<std::vector<char>>();
+
+    uint32_t level_count = mip_level_count(tmp_width, tmp_height);
+    levels.resize(level_count);
+    levels[0] = std::move(image);
+    for (uint32_t i = 1; i < level_count; ++i)
+      levels[i] = downsample_rgba(levels[i - 1].data(), mip_level_extent(tmp_width, i - 1), mip_level_extent(tmp_height, i - 1));
+
+    imageCache.Store(source_hash, 4, true, tmp_width, tmp_height, tmp_components, levels);
+  }
+
+  if (width)
+    *width = tmp_width;
+  if (height)
+    *height = tmp_height;
+  return levels;
+}
@@ -4,4 +4,6 @@
 #include <vector>
 
 std::vector<char> read_binary_file(std::string const& file_name);
-std::vector<char> read_image(std::string const& filename, int requested_components, int* width, int* height, int* components, int* data_size);
\ No newline at end of file
+bool read_image_info(std::string const& filename, int* width, int* height, int* components); // header only, no decoding
+std::vector<char> read_image(std::string const& filename, int requested_components, int* width, int* height, int* components, int* data_size);
+std::vector<std::vector<char>> read_image_mips(std::string const& filename, int* width, int* height); // RGBA8, full chain down to 1x1
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include <cstring>
+
+#include "hash.h"
+
+namespace
+{
+  const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+  const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+  const uint64_t prime3 = 0x165667B19E3779F9ull;
+  const uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+  const uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+  inline uint64_t rotate_left(uint64_t value, int bits)
+  {
+    return (value << bits) | (value >> (64 - bits));
+  }
+
+  // unaligned little endian reads, memcpy compiles down to a plain load
+  inline uint64_t read64(const unsigned char* bytes)
+  {
+    uint64_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+  }
+
+  inline uint32_t read32(const unsigned char* bytes)
+  {
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+  }
+
+  inline uint64_t round(uint64_t accumulator, uint64_t input)
+  {
+    accumulator += input * prime2;
+    accumulator = rotate_left(accumulator, 31);
+    return accumulator * prime1;
+  }
+
+  inline uint64_t merge_round(uint64_t accumulator, uint64_t value)
+  {
+    accumulator ^= round(0, value);
+    return accumulator * prime1 + prime4;
+  }
+}
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  const unsigned char* end = bytes + size;
+  uint64_t hash;
+
+  if (size >= 32)
+  {
+    // four independent lanes keep the multipliers busy
+    uint64_t v1 = seed + prime1 + prime2;
+    uint64_t v2 = seed + prime2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - prime1;
+
+    const unsigned char* limit = end - 32;
+    do
+    {
+      v1 = round(v1, read64(bytes));
+      v2 = round(v2, read64(bytes + 8));
+      v3 = round(v3, read64(bytes + 16));
+      v4 = round(v4, read64(bytes + 24));
+      bytes += 32;
+    } while (bytes <= limit);
+
+    hash = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12) + rotate_left(v4, 18);
+    hash = merge_round(hash, v1);
+    hash = merge_round(hash, v2);
+    hash = merge_round(hash, v3);
+    hash = merge_round(hash, v4);
+  }
+  else
+    hash = seed + prime5;
+
+  hash += static_cast<uint64_t>(size);
+
+  for (; bytes + 8 <= end; bytes += 8)
+  {
+    hash ^= round(0, read64(bytes));
+    hash = rotate_left(hash, 27) * prime1 + prime4;
+  }
+
+  if (bytes + 4 <= end)
+  {
+    hash ^= static_cast<uint64_t>(read32(bytes)) * prime1;
+    hash = rotate_left(hash, 23) * prime2 + prime3;
+    bytes += 4;
+  }
+
+  for (; bytes < end; ++bytes)
+  {
+    hash ^= (*bytes) * prime5;
+    hash = rotate_left(hash, 11) * prime1;
+  }
+
+  // final avalanche
+  hash ^= hash >> 33;
+  hash *= prime2;
+  hash ^= hash >> 29;
+  hash *= prime3;
+  hash ^= hash >> 32;
+  return hash;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 64 bit content hash (XXH64), fast enough to key caches by whole source files
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
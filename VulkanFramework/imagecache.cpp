@@ -0,0 +1,277 @@
+#include <Windows.h>
+#include <cstdio>
+#include <cstring>
+
+#include "imagecache.h"
+#include "mipmap.h"
+
+ImageCache imageCache;
+
+namespace
+{
+  const uint32_t cache_magic = 0x43494656; // "VFIC"
+  const uint32_t cache_version = 1;
+
+  struct CacheHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_hash;
+    uint32_t width;
+    uint32_t height;
+    uint32_t components;
+    uint32_t source_components; // what the file had before conversion
+    uint32_t level_count;
+    uint32_t reserved0;
+    uint64_t data_size;
+    uint8_t  reserved[16];
+  };
+  static_assert(sizeof(CacheHeader) == 64, "pixel data has to start 64 byte aligned");
+
+  uint64_t filetime_ticks(const FILETIME& time)
+  {
+    return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+  }
+
+  uint64_t level_size(uint32_t width, uint32_t height, uint32_t components, uint32_t level)
+  {
+    return static_cast<uint64_t>(mip_level_extent(width, level)) * mip_level_extent(height, level) * components;
+  }
+
+  bool ends_with(const std::string& text, const char* suffix)
+  {
+    size_t length = strlen(suffix);
+    return (text.size() >= length) && (text.compare(text.size() - length, length, suffix) == 0);
+  }
+}
+
+void ImageCache::Initialize()
+{
+  CreateDirectoryA("cache", nullptr);
+  CreateDirectoryA(m_directory.c_str(), nullptr);
+
+  m_entries.clear();
+  m_total_size = 0;
+
+  WIN32_FIND_DATAA find_data;
+  HANDLE find = FindFirstFileA((m_directory + "*").c_str(), &find_data);
+  if (find == INVALID_HANDLE_VALUE)
+  {
+    OutputDebugString("Image cache directory is not accessible, caching is off\n");
+    m_enabled = false;
+    return;
+  }
+
+  do
+  {
+    if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+      continue;
+
+    std::string name = find_data.cFileName;
+
+    // leftovers of a write that never got renamed
+    if (ends_with(name, ".tmp"))
+    {
+      DeleteFileA((m_directory + name).c_str());
+      continue;
+    }
+
+    if (!ends_with(name, ".img"))
+      continue;
+
+    Entry entry = {
+      (static_cast<uint64_t>(find_data.nFileSizeHigh) << 32) | find_data.nFileSizeLow,
+      filetime_ticks(find_data.ftLastWriteTime)
+    };
+    m_entries[name] = entry;
+    m_total_size += entry.size;
+  } while (FindNextFileA(find, &find_data));
+  FindClose(find);
+
+  m_enabled = true;
+
+  // the limit may have shrunk since the last run
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Evict();
+}
+
+void ImageCache::Terminate()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries.clear();
+  m_enabled = false;
+}
+
+std::string ImageCache::EntryName(uint64_t source_hash, int components, bool mipped) const
+{
+  char name[64];
+  snprintf(name, sizeof(name), "%016llx_%d%s.img", static_cast<unsigned long long>(source_hash), components, mipped ? "m" : "");
+  return name;
+}
+
+void ImageCache::Touch(const std::string& name)
+{
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+
+  // write time survives restarts, so it doubles as LRU stamp without a separate index file
+  HANDLE file = CreateFileA((m_directory + name).c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file != INVALID_HANDLE_VALUE)
+  {
+    SetFileTime(file, nullptr, nullptr, &now);
+    CloseHandle(file);
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto entry = m_entries.find(name);
+  if (entry != m_entries.end())
+    entry->second.last_use = filetime_ticks(now);
+}
+
+void ImageCache::Evict()
+{
+  // caller holds m_mutex
+  while ((m_total_size > m_size_limit) && !m_entries.empty())
+  {
+    auto oldest = m_entries.begin();
+    for (auto entry = m_entries.begin(); entry != m_entries.end(); ++entry)
+      if (entry->second.last_use < oldest->second.last_use)
+        oldest = entry;
+
+    // a file someone still has mapped stays on disk, the next launch picks it up again
+    DeleteFileA((m_directory + oldest->first).c_str());
+    m_total_size -= oldest->second.size;
+    m_entries.erase(oldest);
+  }
+}
+
+void ImageCache::SetSizeLimit(uint64_t bytes)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_size_limit = bytes;
+  Evict();
+}
+
+bool ImageCache::Load(uint64_t source_hash, int components, bool mipped, int* width, int* height, int* source_components, std::vector<std::vector<char>>& levels)
+{
+  std::string name = EntryName(source_hash, components, mipped);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_enabled || (m_entries.find(name) == m_entries.end()))
+      return false;
+  }
+
+  HANDLE file = CreateFileA((m_directory + name).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER file_size;
+  HANDLE mapping = nullptr;
+  const unsigned char* view = nullptr;
+  if (GetFileSizeEx(file, &file_size) && (static_cast<uint64_t>(file_size.QuadPart) >= sizeof(CacheHeader)))
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping)
+    view = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+
+  bool valid = false;
+  if (view)
+  {
+    CacheHeader header;
+    memcpy(&header, view, sizeof(header));
+
+    uint32_t expected_levels = mipped ? mip_level_count(header.width, header.height) : 1;
+    valid = (header.magic == cache_magic) && (header.version == cache_version) && (header.source_hash == source_hash) &&
+      (header.components == static_cast<uint32_t>(components)) && (header.level_count == expected_levels) &&
+      (header.data_size + sizeof(CacheHeader) == static_cast<uint64_t>(file_size.QuadPart));
+
+    if (valid)
+    {
+      uint64_t data_size = 0;
+      for (uint32_t level = 0; level < header.level_count; ++level)
+        data_size += level_size(header.width, header.height, header.components, level);
+      valid = data_size == header.data_size;
+    }
+
+    if (valid)
+    {
+      const unsigned char* data = view + sizeof(CacheHeader);
+      levels.resize(header.level_count);
+      for (uint32_t level = 0; level < header.level_count; ++level)
+      {
+        size_t size = static_cast<size_t>(level_size(header.width, header.height, header.components, level));
+        levels[level].assign(data, data + size);
+        data += size;
+      }
+
+      if (width)
+        *width = static_cast<int>(header.width);
+      if (height)
+        *height = static_cast<int>(header.height);
+      if (source_components)
+        *source_components = static_cast<int>(header.source_components);
+    }
+
+    UnmapViewOfFile(view);
+  }
+
+  if (mapping)
+    CloseHandle(mapping);
+  CloseHandle(file);
+
+  if (valid)
+    Touch(name);
+  return valid;
+}
+
+void ImageCache::Store(uint64_t source_hash, int components, bool mipped, int width, int height, int source_components, const std::vector<std::vector<char>>& levels)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_enabled)
+      return;
+  }
+
+  CacheHeader header = {};
+  header.magic = cache_magic;
+  header.version = cache_version;
+  header.source_hash = source_hash;
+  header.width = static_cast<uint32_t>(width);
+  header.height = static_cast<uint32_t>(height);
+  header.components = static_cast<uint32_t>(components);
+  header.source_components = static_cast<uint32_t>(source_components);
+  header.level_count = static_cast<uint32_t>(levels.size());
+  for (const std::vector<char>& level : levels)
+    header.data_size += level.size();
+
+  std::string name = EntryName(source_hash, components, mipped);
+  std::string path = m_directory + name;
+  std::string temp_path = path + "." + std::to_string(GetCurrentThreadId()) + ".tmp";
+
+  HANDLE file = CreateFileA(temp_path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return;
+
+  DWORD written = 0;
+  bool written_all = WriteFile(file, &header, sizeof(header), &written, nullptr) && (written == sizeof(header));
+  for (size_t i = 0; written_all && (i < levels.size()); ++i)
+    written_all = WriteFile(file, levels[i].data(), static_cast<DWORD>(levels[i].size()), &written, nullptr) && (written == levels[i].size());
+  CloseHandle(file);
+
+  // readers only ever see complete files, a failed rename (file mapped by a reader) keeps the old entry
+  if (!written_all || !MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+  {
+    DeleteFileA(temp_path.c_str());
+    return;
+  }
+
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Entry& entry = m_entries[name];
+  m_total_size -= entry.size;
+  entry.size = sizeof(header) + header.data_size;
+  entry.last_use = filetime_ticks(now);
+  m_total_size += entry.size;
+  Evict();
+}
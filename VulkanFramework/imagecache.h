@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// decoded pixels on disk, keyed by a hash of the source file bytes and the component count,
+// so a second launch skips the image decoder entirely
+// each entry is one file: a 64 byte header followed by every level tightly packed, which maps straight into memory
+// files are written under a temporary name and renamed, a crash never leaves half an entry behind
+extern class ImageCache
+{
+private:
+  struct Entry
+  {
+    uint64_t size;
+    uint64_t last_use; // FILETIME ticks, the file's write time doubles as LRU stamp across runs
+  };
+
+  std::string                            m_directory = "cache/images/";
+  uint64_t                               m_size_limit = 512ull * 1024 * 1024;
+  uint64_t                               m_total_size = 0;
+  std::unordered_map<std::string, Entry> m_entries;
+  std::mutex                             m_mutex;
+  bool                                   m_enabled = false;
+
+  void Initialize();
+  void Terminate();
+  std::string EntryName(uint64_t source_hash, int components, bool mipped) const;
+  void Touch(const std::string& name);
+  void Evict();
+
+public:
+  // mipped entries hold the whole chain down to 1x1, others only the base level
+  bool Load(uint64_t source_hash, int components, bool mipped, int* width, int* height, int* source_components, std::vector<std::vector<char>>& levels);
+  void Store(uint64_t source_hash, int components, bool mipped, int width, int height, int source_components, const std::vector<std::vector<char>>& levels);
+  void SetSizeLimit(uint64_t bytes);
+
+  friend bool Initialize();
+  friend void Terminate();
+} imageCache;
@@ -0,0 +1,157 @@
+#include <algorithm>
+
+#include "imagestatetracker.h"
+
+namespace
+{
+  const VkAccessFlags write_accesses = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+  uint32_t level_count(const VkImageSubresourceRange& range, uint32_t mip_levels)
+  {
+    return range.levelCount == VK_REMAINING_MIP_LEVELS ? mip_levels - range.baseMipLevel : range.levelCount;
+  }
+
+  uint32_t layer_count(const VkImageSubresourceRange& range, uint32_t array_layers)
+  {
+    return range.layerCount == VK_REMAINING_ARRAY_LAYERS ? array_layers - range.baseArrayLayer : range.layerCount;
+  }
+}
+
+void ImageStateTracker::Track(VkImage image, uint32_t mip_levels, uint32_t array_layers, VkImageLayout layout)
+{
+  TrackedImage& tracked = m_images[image];
+  tracked.mip_levels = mip_levels;
+  tracked.array_layers = array_layers;
+  tracked.subresources.assign(static_cast<size_t>(mip_levels) * array_layers, { layout, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0 });
+}
+
+void ImageStateTracker::Forget(VkImage image)
+{
+  m_images.erase(image);
+  m_barriers.erase(std::remove_if(m_barriers.begin(), m_barriers.end(), [image](const VkImageMemoryBarrier& barrier) { return barrier.image == image; }),
+    m_barriers.end());
+}
+
+void ImageStateTracker::Clear()
+{
+  m_images.clear();
+  m_barriers.clear();
+  m_src_stage = 0;
+  m_dst_stage = 0;
+}
+
+bool ImageStateTracker::GetState(VkImage image, const VkImageSubresourceRange& range, State& state) const
+{
+  auto tracked = m_images.find(image);
+  if (tracked == m_images.end())
+  {
+    state = { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0 };
+    return true;
+  }
+
+  const TrackedImage& info = tracked->second;
+  uint32_t levels = level_count(range, info.mip_levels);
+  uint32_t layers = layer_count(range, info.array_layers);
+  state = info.subresources[range.baseArrayLayer * info.mip_levels + range.baseMipLevel];
+  for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + layers; ++layer)
+    for (uint32_t mip = range.baseMipLevel; mip < range.baseMipLevel + levels; ++mip)
+    {
+      const State& other = info.subresources[layer * info.mip_levels + mip];
+      if ((other.layout != state.layout) || (other.stage != state.stage) || (other.access != state.access))
+        return false;
+    }
+  return true;
+}
+
+void ImageStateTracker::SetState(VkImage image, const VkImageSubresourceRange& range, const State& state)
+{
+  auto tracked = m_images.find(image);
+  if (tracked == m_images.end())
+    return;
+
+  TrackedImage& info = tracked->second;
+  uint32_t levels = level_count(range, info.mip_levels);
+  uint32_t layers = layer_count(range, info.array_layers);
+  for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + layers; ++layer)
+    for (uint32_t mip = range.baseMipLevel; mip < range.baseMipLevel + levels; ++mip)
+      info.subresources[layer * info.mip_levels + mip] = state;
+}
+
+bool ImageStateTracker::Transition(VkImage image, const VkImageSubresourceRange& range, VkImageLayout layout, VkPipelineStageFlags stage, VkAccessFlags access)
+{
+  auto tracked = m_images.find(image);
+  if (tracked == m_images.end())
+    return false;
+
+  TrackedImage& info = tracked->second;
+  uint32_t levels = level_count(range, info.mip_levels);
+  uint32_t layers = layer_count(range, info.array_layers);
+  bool writes = (access & write_accesses) != 0;
+  for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + layers; ++layer)
+    for (uint32_t mip = range.baseMipLevel; mip < range.baseMipLevel + levels; ++mip)
+    {
+      State& current = info.subresources[layer * info.mip_levels + mip];
+
+      // a read in the same layout that already sees the contents needs nothing
+      bool unwritten = (current.access & write_accesses) == 0;
+      bool same_layout = current.layout == layout;
+      if (same_layout && !writes && unwritten && ((stage & ~current.stage) == 0) && ((access & ~current.access) == 0))
+        continue;
+
+      m_src_stage |= current.stage ? current.stage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+      m_dst_stage |= stage;
+
+      // neighbouring mips coming from the same state share one barrier
+      VkAccessFlags src_access = current.access & write_accesses;
+      VkImageMemoryBarrier* previous = m_barriers.empty() ? nullptr : &m_barriers.back();
+      if ((previous != nullptr) && (previous->image == image) && (previous->oldLayout == current.layout) && (previous->newLayout == layout) &&
+        (previous->srcAccessMask == src_access) && (previous->dstAccessMask == access) && (previous->subresourceRange.baseArrayLayer == layer) &&
+        (previous->subresourceRange.baseMipLevel + previous->subresourceRange.levelCount == mip))
+        ++previous->subresourceRange.levelCount;
+      else
+      {
+        VkImageMemoryBarrier image_barrier = {
+          VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, // VkStructureType
+          nullptr,                                // pNext
+          src_access,                             // srcAccessMask
+          access,                                 // dstAccessMask
+          current.layout,                         // oldLayout
+          layout,                                 // newLayout
+          VK_QUEUE_FAMILY_IGNORED,                // srcQueueFamilyIndex
+          VK_QUEUE_FAMILY_IGNORED,                // dstQueueFamilyIndex
+          image,                                  // image
+          {                                       // subresourceRange
+            range.aspectMask,                       // aspectMask
+            mip,                                    // baseMipLevel
+            1,                                      // levelCount
+            layer,                                  // baseArrayLayer
+            1                                       // layerCount
+          }
+        };
+        m_barriers.push_back(image_barrier);
+      }
+
+      // more readers of the same contents add up, anything else starts over
+      if (same_layout && !writes && unwritten)
+      {
+        current.stage |= stage;
+        current.access |= access;
+      }
+      else
+        current = { layout, stage, access };
+    }
+  return true;
+}
+
+void ImageStateTracker::Flush(VkCommandBuffer command_buffer, PFN_vkCmdPipelineBarrier cmd_pipeline_barrier)
+{
+  if (m_barriers.empty())
+    return;
+
+  cmd_pipeline_barrier(command_buffer, m_src_stage, m_dst_stage, 0, 0, nullptr, 0, nullptr,
+    static_cast<uint32_t>(m_barriers.size()), m_barriers.data());
+  m_barriers.clear();
+  m_src_stage = 0;
+  m_dst_stage = 0;
+}
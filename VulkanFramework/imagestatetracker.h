@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "resources\vulkan\vulkan.h"
+
+// the last known layout, stages and access of every mip and layer of the images the renderer owns, kept across command buffers
+// Transition only takes the state a use wants, queues a barrier for the subresources that aren't in it yet and
+// nothing for the ones that are, Flush records everything queued as a single vkCmdPipelineBarrier
+// states are as of recording, so command buffers have to reach the queue in the order they were recorded in
+class ImageStateTracker
+{
+public:
+  struct State
+  {
+    VkImageLayout        layout;
+    VkPipelineStageFlags stage;  // what the last barrier or use waited in
+    VkAccessFlags        access; // writes in here aren't visible to anyone yet, reads are the ones that already see the contents
+  };
+
+private:
+  struct TrackedImage
+  {
+    uint32_t           mip_levels;
+    uint32_t           array_layers;
+    std::vector<State> subresources; // layer * mip_levels + mip
+  };
+
+  std::unordered_map<VkImage, TrackedImage> m_images;
+  VkPipelineStageFlags                      m_src_stage = 0;
+  VkPipelineStageFlags                      m_dst_stage = 0;
+  std::vector<VkImageMemoryBarrier>         m_barriers;
+
+public:
+  // new images start with undefined contents, forgetting one drops the barriers still queued for it
+  void Track(VkImage image, uint32_t mip_levels, uint32_t array_layers = 1, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+  void Forget(VkImage image);
+  void Clear();
+
+  // false when the subresources in the range aren't all in the same state, untracked images have undefined contents
+  bool GetState(VkImage image, const VkImageSubresourceRange& range, State& state) const;
+  // for when something else moved the image, a render graph or a render pass
+  void SetState(VkImage image, const VkImageSubresourceRange& range, const State& state);
+
+  // false for untracked images, barriers in one batch aren't ordered so flush before moving a subresource a second time
+  bool Transition(VkImage image, const VkImageSubresourceRange& range, VkImageLayout layout, VkPipelineStageFlags stage, VkAccessFlags access);
+  bool HasPendingBarriers() const { return !m_barriers.empty(); }
+  // the renderer owns the loaded device functions, so it hands over the one to record with
+  void Flush(VkCommandBuffer command_buffer, PFN_vkCmdPipelineBarrier cmd_pipeline_barrier);
+};
@@ -0,0 +1,43 @@
+#include <algorithm>
+
+#include "mipmap.h"
+
+uint32_t mip_level_count(int width, int height)
+{
+  uint32_t count = 1;
+  for (int size = std::max(width, height); size > 1; size /= 2)
+    ++count;
+  return count;
+}
+
+uint32_t mip_level_extent(uint32_t extent, uint32_t level)
+{
+  return std::max(extent >> level, 1u);
+}
+
+std::vector<char> downsample_rgba(const char* rgba, int width, int height)
+{
+  int half_width = std::max(width / 2, 1);
+  int half_height = std::max(height / 2, 1);
+
+  const unsigned char* source = reinterpret_cast<const unsigned char*>(rgba);
+  std::vector<char> output(static_cast<size_t>(half_width) * half_height * 4);
+
+  for (int y = 0; y < half_height; ++y)
+  {
+    // odd sizes and 1 pixel wide images read the same texel twice
+    const unsigned char* row0 = source + static_cast<size_t>(std::min(y * 2, height - 1)) * width * 4;
+    const unsigned char* row1 = source + static_cast<size_t>(std::min(y * 2 + 1, height - 1)) * width * 4;
+
+    for (int x = 0; x < half_width; ++x)
+    {
+      int x0 = std::min(x * 2, width - 1) * 4;
+      int x1 = std::min(x * 2 + 1, width - 1) * 4;
+
+      for (int c = 0; c < 4; ++c)
+        output[(static_cast<size_t>(y) * half_width + x) * 4 + c] = static_cast<char>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+    }
+  }
+
+  return output;
+}
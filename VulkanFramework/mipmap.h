@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// mip chain helpers for 4 component RGBA8 images
+uint32_t mip_level_count(int width, int height);
+uint32_t mip_level_extent(uint32_t extent, uint32_t level);
+std::vector<char> downsample_rgba(const char* rgba, int width, int height); // 2x2 box filter, result is half size (at least 1)
@@ -0,0 +1,151 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "pipelinemanifest.h"
+
+namespace
+{
+  // the flat parts of a description, in file order
+  const size_t state_words = sizeof(PipelineState) / sizeof(uint32_t);
+  const size_t constant_words = sizeof(SpecializationConstants) / sizeof(uint32_t);
+  const size_t description_words = state_words + 2 * constant_words;
+
+  std::string manifest_header()
+  {
+    return "pipeline manifest 1 " + std::to_string(state_words) + " " + std::to_string(constant_words);
+  }
+
+  void description_to_words(const PipelineDescription& description, uint32_t* words)
+  {
+    PipelineState state = description.state;
+    normalize_pipeline_state(state);
+    memcpy(words, &state, sizeof(PipelineState));
+    memcpy(words + state_words, &description.vertex_constants, sizeof(SpecializationConstants));
+    memcpy(words + state_words + constant_words, &description.fragment_constants, sizeof(SpecializationConstants));
+  }
+
+  void words_to_description(const uint32_t* words, PipelineDescription& description)
+  {
+    memcpy(static_cast<void*>(&description.state), words, sizeof(PipelineState));
+    memcpy(static_cast<void*>(&description.vertex_constants), words + state_words, sizeof(SpecializationConstants));
+    memcpy(static_cast<void*>(&description.fragment_constants), words + state_words + constant_words, sizeof(SpecializationConstants));
+  }
+
+  template <typename Enum>
+  bool in_range(Enum value, Enum end_range)
+  {
+    return (static_cast<uint32_t>(value) <= static_cast<uint32_t>(end_range));
+  }
+
+  // the words come straight from the file, a stale or corrupt one must not hand out counts past the arrays
+  // or values the driver doesn't know, extension enums aren't written by this framework so they don't pass either
+  bool is_valid_state(const PipelineState& state)
+  {
+    const VertexLayout& layout = state.vertex_layout;
+    if ((layout.binding_count > VertexLayout::max_bindings) || (layout.attribute_count > VertexLayout::max_attributes))
+      return false;
+
+    for (uint32_t i = 0; i < layout.binding_count; ++i)
+      if (!in_range(layout.bindings[i].inputRate, VK_VERTEX_INPUT_RATE_END_RANGE))
+        return false;
+
+    for (uint32_t i = 0; i < layout.attribute_count; ++i)
+    {
+      const VkVertexInputAttributeDescription& attribute = layout.attributes[i];
+      bool has_binding = false;
+      for (uint32_t j = 0; j < layout.binding_count; ++j)
+        has_binding = has_binding || (layout.bindings[j].binding == attribute.binding);
+      if (!has_binding || (attribute.format == VK_FORMAT_UNDEFINED) || !in_range(attribute.format, VK_FORMAT_END_RANGE))
+        return false;
+    }
+
+    return in_range(state.topology, VK_PRIMITIVE_TOPOLOGY_END_RANGE) &&
+      in_range(state.polygon_mode, VK_POLYGON_MODE_END_RANGE) &&
+      (state.cull_mode <= VK_CULL_MODE_FRONT_AND_BACK) &&
+      in_range(state.front_face, VK_FRONT_FACE_END_RANGE) &&
+      (state.blend_enable <= VK_TRUE) &&
+      in_range(state.src_color_blend_factor, VK_BLEND_FACTOR_END_RANGE) &&
+      in_range(state.dst_color_blend_factor, VK_BLEND_FACTOR_END_RANGE) &&
+      in_range(state.color_blend_op, VK_BLEND_OP_END_RANGE) &&
+      in_range(state.src_alpha_blend_factor, VK_BLEND_FACTOR_END_RANGE) &&
+      in_range(state.dst_alpha_blend_factor, VK_BLEND_FACTOR_END_RANGE) &&
+      in_range(state.alpha_blend_op, VK_BLEND_OP_END_RANGE) &&
+      (state.color_write_mask <= (VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT)) &&
+      (state.depth_test_enable <= VK_TRUE) &&
+      (state.depth_write_enable <= VK_TRUE) &&
+      in_range(state.depth_compare_op, VK_COMPARE_OP_END_RANGE);
+  }
+
+  bool parse_line(const std::string& line, PipelineDescription& description)
+  {
+    size_t first_tab = line.find('\t');
+    size_t second_tab = first_tab == std::string::npos ? std::string::npos : line.find('\t', first_tab + 1);
+    if (second_tab == std::string::npos)
+      return false;
+
+    description.vertex_shader = line.substr(0, first_tab);
+    description.fragment_shader = line.substr(first_tab + 1, second_tab - first_tab - 1);
+
+    uint32_t words[description_words];
+    std::istringstream hex(line.substr(second_tab + 1));
+    for (size_t i = 0; i < description_words; ++i)
+      if (!(hex >> std::hex >> words[i]))
+        return false;
+
+    words_to_description(words, description);
+    return is_valid_state(description.state) &&
+      (description.vertex_constants.count <= SpecializationConstants::max_constants) &&
+      (description.fragment_constants.count <= SpecializationConstants::max_constants);
+  }
+}
+
+bool load_pipeline_manifest(const std::string& file_name, std::vector<PipelineDescription>& descriptions)
+{
+  std::ifstream file(file_name);
+  if (file.fail())
+    return false;
+
+  std::string line;
+  if (!std::getline(file, line) || (line != manifest_header()))
+    return false;
+
+  while (std::getline(file, line))
+  {
+    PipelineDescription description;
+    if (!line.empty() && parse_line(line, description))
+      descriptions.push_back(description);
+  }
+  return true;
+}
+
+bool append_pipeline_manifest(const std::string& file_name, const PipelineDescription& description)
+{
+  // a missing or stale file starts over with the current header
+  std::string header;
+  {
+    std::ifstream existing(file_name);
+    std::getline(existing, header);
+  }
+  bool start_over = header != manifest_header();
+
+  std::ofstream file(file_name, start_over ? std::ios::trunc : std::ios::app);
+  if (file.fail())
+    return false;
+  if (start_over)
+    file << manifest_header() << "\n";
+
+  uint32_t words[description_words];
+  description_to_words(description, words);
+
+  file << description.vertex_shader << "\t" << description.fragment_shader << "\t";
+  char word[16];
+  for (size_t i = 0; i < description_words; ++i)
+  {
+    snprintf(word, sizeof(word), i == 0 ? "%x" : " %x", words[i]);
+    file << word;
+  }
+  file << "\n";
+  return !file.fail();
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "pipelinestate.h"
+
+// the pipelines a run is going to need, built before the first frame so none compiles mid-game
+// one pipeline per line: vertex shader, fragment shader and the state plus both specialization constant
+// sets as 32 bit hex words, tab separated, the first line names the layout version and a stale file is skipped
+// anything requested after warm-up that the file doesn't list gets appended, so the next run has it too
+
+bool load_pipeline_manifest(const std::string& file_name, std::vector<PipelineDescription>& descriptions);
+bool append_pipeline_manifest(const std::string& file_name, const PipelineDescription& description);
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+
+#include "resources\vulkan\vulkan.h"
+#include "hash.h"
+#include "vertexlayout.h"
+
+// everything in here is plain 32 bit words without padding, so states and keys hash and compare as bytes
+// unused array slots have to stay zeroed for that, which the default member initializers take care of
+
+// fixed function state of a graphics pipeline, viewport and scissor are always dynamic
+struct PipelineState
+{
+  VertexLayout          vertex_layout;
+  VkPrimitiveTopology   topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  VkPolygonMode         polygon_mode = VK_POLYGON_MODE_FILL;
+  VkCullModeFlags       cull_mode = VK_CULL_MODE_BACK_BIT;
+  VkFrontFace           front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  VkBool32              blend_enable = VK_FALSE;
+  VkBlendFactor         src_color_blend_factor = VK_BLEND_FACTOR_SRC_ALPHA;
+  VkBlendFactor         dst_color_blend_factor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  VkBlendOp             color_blend_op = VK_BLEND_OP_ADD;
+  VkBlendFactor         src_alpha_blend_factor = VK_BLEND_FACTOR_ONE;
+  VkBlendFactor         dst_alpha_blend_factor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  VkBlendOp             alpha_blend_op = VK_BLEND_OP_ADD;
+  VkColorComponentFlags color_write_mask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  VkBool32              depth_test_enable = VK_FALSE; // depth needs a render pass with a depth attachment
+  VkBool32              depth_write_enable = VK_FALSE;
+  VkCompareOp           depth_compare_op = VK_COMPARE_OP_LESS_OR_EQUAL;
+};
+
+// with blending off the driver ignores factors and ops, so they're reset to the defaults before a state gets
+// hashed, compared or written out, otherwise states the driver can't tell apart would build separate pipelines
+inline void normalize_pipeline_state(PipelineState& state)
+{
+  if (state.blend_enable == VK_FALSE)
+  {
+    const PipelineState defaults;
+    state.src_color_blend_factor = defaults.src_color_blend_factor;
+    state.dst_color_blend_factor = defaults.dst_color_blend_factor;
+    state.color_blend_op = defaults.color_blend_op;
+    state.src_alpha_blend_factor = defaults.src_alpha_blend_factor;
+    state.dst_alpha_blend_factor = defaults.dst_alpha_blend_factor;
+    state.alpha_blend_op = defaults.alpha_blend_op;
+  }
+}
+
+// values for a shader stage's constant_id constants, kept sorted by id so the order they were set in
+// doesn't change the key, every GLSL specialization constant type is 32 bits (bool as VkBool32)
+struct SpecializationConstants
+{
+  constexpr static uint32_t max_constants = 8;
+
+  uint32_t count = 0;
+  uint32_t constant_ids[max_constants] = {};
+  uint32_t values[max_constants] = {};
+
+  bool Set(uint32_t constant_id, bool value)     { return SetBits(constant_id, value ? VK_TRUE : VK_FALSE); }
+  bool Set(uint32_t constant_id, int32_t value)  { return SetBits(constant_id, static_cast<uint32_t>(value)); }
+  bool Set(uint32_t constant_id, uint32_t value) { return SetBits(constant_id, value); }
+  bool Set(uint32_t constant_id, float value)
+  {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return SetBits(constant_id, bits);
+  }
+
+private:
+  // false when all slots are taken
+  bool SetBits(uint32_t constant_id, uint32_t bits)
+  {
+    uint32_t i = 0;
+    while ((i < count) && (constant_ids[i] < constant_id))
+      ++i;
+
+    if ((i < count) && (constant_ids[i] == constant_id))
+    {
+      values[i] = bits;
+      return true;
+    }
+
+    if (count == max_constants)
+      return false;
+    for (uint32_t j = count; j > i; --j)
+    {
+      constant_ids[j] = constant_ids[j - 1];
+      values[j] = values[j - 1];
+    }
+    constant_ids[i] = constant_id;
+    values[i] = bits;
+    ++count;
+    return true;
+  }
+};
+
+// what gets requested, shaders are embedded names or .spv paths
+struct PipelineDescription
+{
+  std::string             vertex_shader;
+  std::string             fragment_shader;
+  PipelineState           state;
+  SpecializationConstants vertex_constants;
+  SpecializationConstants fragment_constants;
+};
+
+// identity of a pipeline, shaders by content so renamed or duplicated files still share
+// the render pass part covers what makes render passes compatible for this framework's single color attachment
+struct PipelineKey
+{
+  uint64_t                vertex_shader_hash = 0;
+  uint64_t                fragment_shader_hash = 0;
+  PipelineState           state;
+  SpecializationConstants vertex_constants;
+  SpecializationConstants fragment_constants;
+  VkFormat                color_format = VK_FORMAT_UNDEFINED;
+  VkSampleCountFlagBits   samples = VK_SAMPLE_COUNT_1_BIT;
+  uint32_t                subpass = 0;
+};
+static_assert(sizeof(PipelineState) % sizeof(uint32_t) == 0, "pipeline state has to be made of 32 bit words");
+static_assert(sizeof(SpecializationConstants) == (1 + 2 * SpecializationConstants::max_constants) * sizeof(uint32_t), "specialization constants have to be made of 32 bit words");
+static_assert(sizeof(PipelineKey) == 2 * sizeof(uint64_t) + sizeof(PipelineState) + 2 * sizeof(SpecializationConstants) + 3 * sizeof(uint32_t), "pipeline key must not have padding");
+
+inline bool operator==(const PipelineKey& a, const PipelineKey& b)
+{
+  return memcmp(&a, &b, sizeof(PipelineKey)) == 0;
+}
+
+struct PipelineKeyHash
+{
+  size_t operator()(const PipelineKey& key) const
+  {
+    return static_cast<size_t>(hash_bytes(&key, sizeof(PipelineKey)));
+  }
+};
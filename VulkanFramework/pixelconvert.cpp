@@ -0,0 +1,640 @@
+#include <Windows.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include "pixelconvert.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXEL_CONVERT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define PIXEL_CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+// MSVC emits any intrinsic anywhere, gcc and clang want the target spelled out per function
+#if defined(__GNUC__) || defined(__clang__)
+#define PIXEL_TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#else
+#define PIXEL_TARGET_AVX2
+#endif
+
+namespace
+{
+  struct PixelKernels
+  {
+    PixelKernelSet set;
+    void (*rgb_to_rgba)(const char* rgb, char* rgba, size_t pixel_count);
+    void (*swizzle_rb)(const char* rgba, char* bgra, size_t pixel_count);
+    void (*premultiply_alpha)(char* rgba, size_t pixel_count);
+    void (*srgb_to_linear)(const char* rgba, float* linear_rgba, size_t pixel_count);
+    void (*float_to_half)(const float* input, uint16_t* output, size_t count);
+  };
+
+  //
+  // scalar
+  //
+
+  void rgb_to_rgba_scalar(const char* rgb, char* rgba, size_t pixel_count)
+  {
+    for (size_t i = 0; i < pixel_count; ++i)
+    {
+      rgba[i * 4 + 0] = rgb[i * 3 + 0];
+      rgba[i * 4 + 1] = rgb[i * 3 + 1];
+      rgba[i * 4 + 2] = rgb[i * 3 + 2];
+      rgba[i * 4 + 3] = static_cast<char>(255);
+    }
+  }
+
+  void swizzle_rb_scalar(const char* rgba, char* bgra, size_t pixel_count)
+  {
+    for (size_t i = 0; i < pixel_count; ++i)
+    {
+      char r = rgba[i * 4 + 0];
+      char b = rgba[i * 4 + 2];
+      bgra[i * 4 + 0] = b;
+      bgra[i * 4 + 1] = rgba[i * 4 + 1];
+      bgra[i * 4 + 2] = r;
+      bgra[i * 4 + 3] = rgba[i * 4 + 3];
+    }
+  }
+
+  inline uint8_t multiply_255(uint32_t c, uint32_t a)
+  {
+    uint32_t t = c * a + 128;
+    return static_cast<uint8_t>((t + (t >> 8)) >> 8);
+  }
+
+  void premultiply_alpha_scalar(char* rgba, size_t pixel_count)
+  {
+    uint8_t* pixels = reinterpret_cast<uint8_t*>(rgba);
+    for (size_t i = 0; i < pixel_count; ++i)
+    {
+      uint32_t a = pixels[i * 4 + 3];
+      pixels[i * 4 + 0] = multiply_255(pixels[i * 4 + 0], a);
+      pixels[i * 4 + 1] = multiply_255(pixels[i * 4 + 1], a);
+      pixels[i * 4 + 2] = multiply_255(pixels[i * 4 + 2], a);
+    }
+  }
+
+  const std::array<float, 256>& srgb_table()
+  {
+    static const std::array<float, 256> table = []()
+    {
+      std::array<float, 256> result;
+      for (int i = 0; i < 256; ++i)
+      {
+        double c = i / 255.0;
+        result[i] = static_cast<float>(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+      }
+      return result;
+    }();
+    return table;
+  }
+
+  // a 256 entry table is exact and beats any polynomial, without a gather instruction this is the fast path
+  void srgb_to_linear_scalar(const char* rgba, float* linear_rgba, size_t pixel_count)
+  {
+    const std::array<float, 256>& table = srgb_table();
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(rgba);
+    for (size_t i = 0; i < pixel_count; ++i)
+    {
+      linear_rgba[i * 4 + 0] = table[pixels[i * 4 + 0]];
+      linear_rgba[i * 4 + 1] = table[pixels[i * 4 + 1]];
+      linear_rgba[i * 4 + 2] = table[pixels[i * 4 + 2]];
+      linear_rgba[i * 4 + 3] = pixels[i * 4 + 3] * (1.0f / 255.0f);
+    }
+  }
+
+  // branchy but exact, the vector versions below do the same steps with masks
+  uint16_t float_to_half_one(float value)
+  {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint16_t result;
+    if (bits >= ((127 + 16) << 23))
+      result = bits > (255u << 23) ? 0x7e00 : 0x7c00; // nan stays quiet nan, everything too big becomes inf
+    else if (bits < ((127 - 14) << 23))
+    {
+      // subnormal half, let the float adder do the rounding
+      const uint32_t magic_bits = ((127 - 15) + (23 - 10) + 1) << 23;
+      float magic, absolute;
+      memcpy(&magic, &magic_bits, sizeof(magic));
+      memcpy(&absolute, &bits, sizeof(absolute));
+      absolute += magic;
+      memcpy(&bits, &absolute, sizeof(bits));
+      result = static_cast<uint16_t>(bits - magic_bits);
+    }
+    else
+    {
+      uint32_t mantissa_odd = (bits >> 13) & 1;
+      bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + mantissa_odd;
+      result = static_cast<uint16_t>(bits >> 13);
+    }
+
+    return static_cast<uint16_t>(result | (sign >> 16));
+  }
+
+  void float_to_half_scalar(const float* input, uint16_t* output, size_t count)
+  {
+    for (size_t i = 0; i < count; ++i)
+      output[i] = float_to_half_one(input[i]);
+  }
+
+  const PixelKernels scalar_kernels = {
+    PixelKernelSet::Scalar,
+    rgb_to_rgba_scalar,
+    swizzle_rb_scalar,
+    premultiply_alpha_scalar,
+    srgb_to_linear_scalar,
+    float_to_half_scalar
+  };
+
+#ifdef PIXEL_CONVERT_X86
+  //
+  // SSE2
+  //
+
+  void rgb_to_rgba_sse2(const char* rgb, char* rgba, size_t pixel_count)
+  {
+    // no byte shuffle before SSSE3, so shift each pixel into its own 32 bit lane and mask the rest away
+    const __m128i lane0 = _mm_setr_epi32(0x00ffffff, 0, 0, 0);
+    const __m128i lane1 = _mm_setr_epi32(0, 0x00ffffff, 0, 0);
+    const __m128i lane2 = _mm_setr_epi32(0, 0, 0x00ffffff, 0);
+    const __m128i lane3 = _mm_setr_epi32(0, 0, 0, 0x00ffffff);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+
+    // every load reads 16 bytes for 12 used ones, stop while that stays inside the source
+    size_t i = 0;
+    for (; i + 6 <= pixel_count; i += 4)
+    {
+      __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + i * 3));
+      __m128i pixels = _mm_or_si128(_mm_and_si128(source, lane0), _mm_and_si128(_mm_slli_si128(source, 1), lane1));
+      pixels = _mm_or_si128(pixels, _mm_and_si128(_mm_slli_si128(source, 2), lane2));
+      pixels = _mm_or_si128(pixels, _mm_and_si128(_mm_slli_si128(source, 3), lane3));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i * 4), _mm_or_si128(pixels, alpha));
+    }
+
+    rgb_to_rgba_scalar(rgb + i * 3, rgba + i * 4, pixel_count - i);
+  }
+
+  void swizzle_rb_sse2(const char* rgba, char* bgra, size_t pixel_count)
+  {
+    const __m128i green_alpha = _mm_set1_epi32(static_cast<int>(0xff00ff00));
+    const __m128i low_byte = _mm_set1_epi32(0x000000ff);
+
+    size_t i = 0;
+    for (; i + 4 <= pixel_count; i += 4)
+    {
+      __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+      __m128i red = _mm_slli_epi32(_mm_and_si128(pixels, low_byte), 16);
+      __m128i blue = _mm_and_si128(_mm_srli_epi32(pixels, 16), low_byte);
+      pixels = _mm_or_si128(_mm_and_si128(pixels, green_alpha), _mm_or_si128(red, blue));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(bgra + i * 4), pixels);
+    }
+
+    swizzle_rb_scalar(rgba + i * 4, bgra + i * 4, pixel_count - i);
+  }
+
+  // two pixels widened to 16 bit, alpha lanes get multiplied by 255 so they come out unchanged
+  inline __m128i premultiply_16_sse2(__m128i pixels)
+  {
+    const __m128i color_mask = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+    const __m128i alpha_255 = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+    const __m128i rounding = _mm_set1_epi16(128);
+
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm_or_si128(_mm_and_si128(alpha, color_mask), alpha_255);
+
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(pixels, alpha), rounding);
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+  }
+
+  void premultiply_alpha_sse2(char* rgba, size_t pixel_count)
+  {
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 4 <= pixel_count; i += 4)
+    {
+      __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+      __m128i low = premultiply_16_sse2(_mm_unpacklo_epi8(pixels, zero));
+      __m128i high = premultiply_16_sse2(_mm_unpackhi_epi8(pixels, zero));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i * 4), _mm_packus_epi16(low, high));
+    }
+
+    premultiply_alpha_scalar(rgba + i * 4, pixel_count - i);
+  }
+
+  inline __m128i select_si128(__m128i mask, __m128i if_true, __m128i if_false)
+  {
+    return _mm_or_si128(_mm_and_si128(mask, if_true), _mm_andnot_si128(mask, if_false));
+  }
+
+  // float_to_half_one on four lanes
+  inline __m128i float_to_half_4_sse2(__m128 value)
+  {
+    const __m128i sign_mask = _mm_set1_epi32(static_cast<int>(0x80000000));
+    const __m128i float_infinity = _mm_set1_epi32(255 << 23);
+    const __m128i half_overflow = _mm_set1_epi32((127 + 16) << 23);
+    const __m128i half_min_normal = _mm_set1_epi32((127 - 14) << 23);
+    const __m128i subnormal_magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+    const __m128i normal_bias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+    const __m128i half_infinity = _mm_set1_epi32(0x7c00);
+    const __m128i half_quiet_bit = _mm_set1_epi32(0x0200);
+
+    __m128i bits = _mm_castps_si128(value);
+    __m128i sign = _mm_and_si128(bits, sign_mask);
+    bits = _mm_xor_si128(bits, sign);
+
+    // sign is gone, so signed compares are fine
+    __m128i is_nan = _mm_cmpgt_epi32(bits, float_infinity);
+    __m128i is_finite = _mm_cmpgt_epi32(half_overflow, bits);
+    __m128i is_subnormal = _mm_cmpgt_epi32(half_min_normal, bits);
+
+    __m128i subnormal = _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(bits), _mm_castsi128_ps(subnormal_magic)));
+    subnormal = _mm_sub_epi32(subnormal, subnormal_magic);
+
+    __m128i mantissa_odd = _mm_srai_epi32(_mm_slli_epi32(bits, 31 - 13), 31);
+    __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(bits, normal_bias), mantissa_odd), 13);
+
+    __m128i result = select_si128(is_subnormal, subnormal, normal);
+    result = select_si128(is_finite, result, _mm_or_si128(half_infinity, _mm_and_si128(is_nan, half_quiet_bit)));
+    result = _mm_or_si128(result, _mm_srli_epi32(sign, 16));
+
+    // sign extend the low 16 bits so the saturating pack keeps them as they are
+    return _mm_srai_epi32(_mm_slli_epi32(result, 16), 16);
+  }
+
+  void float_to_half_sse2(const float* input, uint16_t* output, size_t count)
+  {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+      __m128i low = float_to_half_4_sse2(_mm_loadu_ps(input + i));
+      __m128i high = float_to_half_4_sse2(_mm_loadu_ps(input + i + 4));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_packs_epi32(low, high));
+    }
+
+    float_to_half_scalar(input + i, output + i, count - i);
+  }
+
+  const PixelKernels sse2_kernels = {
+    PixelKernelSet::SSE2,
+    rgb_to_rgba_sse2,
+    swizzle_rb_sse2,
+    premultiply_alpha_sse2,
+    srgb_to_linear_scalar, // table lookups need a gather, which SSE2 doesn't have
+    float_to_half_sse2
+  };
+
+  //
+  // AVX2 + F16C
+  //
+
+  PIXEL_TARGET_AVX2 void rgb_to_rgba_avx2(const char* rgb, char* rgba, size_t pixel_count)
+  {
+    // 4 pixels per 128 bit half, the shuffle can't cross halves so each half gets its own 12 bytes
+    const __m256i expand = _mm256_setr_epi8(
+      0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+      0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xff000000));
+
+    // the second load reads up to byte 28 of 24 used ones
+    size_t i = 0;
+    for (; i + 10 <= pixel_count; i += 8)
+    {
+      __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + i * 3));
+      __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + i * 3 + 12));
+      __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+      pixels = _mm256_or_si256(_mm256_shuffle_epi8(pixels, expand), alpha);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + i * 4), pixels);
+    }
+
+    rgb_to_rgba_sse2(rgb + i * 3, rgba + i * 4, pixel_count - i);
+  }
+
+  PIXEL_TARGET_AVX2 void swizzle_rb_avx2(const char* rgba, char* bgra, size_t pixel_count)
+  {
+    const __m256i swap = _mm256_setr_epi8(
+      2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+      2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+    size_t i = 0;
+    for (; i + 8 <= pixel_count; i += 8)
+    {
+      __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + i * 4));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(bgra + i * 4), _mm256_shuffle_epi8(pixels, swap));
+    }
+
+    swizzle_rb_scalar(rgba + i * 4, bgra + i * 4, pixel_count - i);
+  }
+
+  PIXEL_TARGET_AVX2 inline __m256i premultiply_16_avx2(__m256i pixels)
+  {
+    const __m256i alpha_shuffle = _mm256_setr_epi8(
+      6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1,
+      6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1);
+    const __m256i alpha_255 = _mm256_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255);
+    const __m256i rounding = _mm256_set1_epi16(128);
+
+    __m256i alpha = _mm256_or_si256(_mm256_shuffle_epi8(pixels, alpha_shuffle), alpha_255);
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(pixels, alpha), rounding);
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+  }
+
+  PIXEL_TARGET_AVX2 void premultiply_alpha_avx2(char* rgba, size_t pixel_count)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+
+    // unpack and pack both work per 128 bit half, so the pixel order survives the round trip
+    size_t i = 0;
+    for (; i + 8 <= pixel_count; i += 8)
+    {
+      __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + i * 4));
+      __m256i low = premultiply_16_avx2(_mm256_unpacklo_epi8(pixels, zero));
+      __m256i high = premultiply_16_avx2(_mm256_unpackhi_epi8(pixels, zero));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + i * 4), _mm256_packus_epi16(low, high));
+    }
+
+    premultiply_alpha_scalar(rgba + i * 4, pixel_count - i);
+  }
+
+  PIXEL_TARGET_AVX2 void srgb_to_linear_avx2(const char* rgba, float* linear_rgba, size_t pixel_count)
+  {
+    const float* table = srgb_table().data();
+    const __m256 alpha_scale = _mm256_set1_ps(1.0f / 255.0f);
+
+    // color comes from the table, alpha lanes (3 and 7) are scaled and blended in
+    size_t i = 0;
+    for (; i + 2 <= pixel_count; i += 2)
+    {
+      __m256i bytes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rgba + i * 4)));
+      __m256 color = _mm256_i32gather_ps(table, bytes, 4);
+      __m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(bytes), alpha_scale);
+      _mm256_storeu_ps(linear_rgba + i * 4, _mm256_blend_ps(color, alpha, 0x88));
+    }
+
+    srgb_to_linear_scalar(rgba + i * 4, linear_rgba + i * 4, pixel_count - i);
+  }
+
+  PIXEL_TARGET_AVX2 void float_to_half_avx2(const float* input, uint16_t* output, size_t count)
+  {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+      __m128i halves = _mm256_cvtps_ph(_mm256_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), halves);
+    }
+
+    float_to_half_scalar(input + i, output + i, count - i);
+  }
+
+  const PixelKernels avx2_kernels = {
+    PixelKernelSet::AVX2,
+    rgb_to_rgba_avx2,
+    swizzle_rb_avx2,
+    premultiply_alpha_avx2,
+    srgb_to_linear_avx2,
+    float_to_half_avx2
+  };
+
+  void cpuid(int leaf, int subleaf, int registers[4])
+  {
+#ifdef _MSC_VER
+    __cpuidex(registers, leaf, subleaf);
+#else
+    unsigned int eax, ebx, ecx, edx;
+    __cpuid_count(leaf, subleaf, eax, ebx, ecx, edx);
+    registers[0] = static_cast<int>(eax);
+    registers[1] = static_cast<int>(ebx);
+    registers[2] = static_cast<int>(ecx);
+    registers[3] = static_cast<int>(edx);
+#endif
+  }
+
+  bool cpu_supports_avx2()
+  {
+    int registers[4];
+    cpuid(0, 0, registers);
+    if (registers[0] < 7)
+      return false;
+
+    cpuid(1, 0, registers);
+    bool osxsave = (registers[2] & (1 << 27)) != 0;
+    bool avx = (registers[2] & (1 << 28)) != 0;
+    bool f16c = (registers[2] & (1 << 29)) != 0;
+    if (!osxsave || !avx || !f16c)
+      return false;
+
+    // the OS has to save the upper halves of the ymm registers too
+#ifdef _MSC_VER
+    unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned int xcr0_low, xcr0_high;
+    __asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+    unsigned long long xcr0 = (static_cast<unsigned long long>(xcr0_high) << 32) | xcr0_low;
+#endif
+    if ((xcr0 & 6) != 6)
+      return false;
+
+    cpuid(7, 0, registers);
+    return (registers[1] & (1 << 5)) != 0;
+  }
+#endif
+
+#ifdef PIXEL_CONVERT_NEON
+  //
+  // NEON
+  //
+
+  void rgb_to_rgba_neon(const char* rgb, char* rgba, size_t pixel_count)
+  {
+    size_t i = 0;
+    for (; i + 16 <= pixel_count; i += 16)
+    {
+      uint8x16x3_t source = vld3q_u8(reinterpret_cast<const uint8_t*>(rgb + i * 3));
+      uint8x16x4_t pixels = { { source.val[0], source.val[1], source.val[2], vdupq_n_u8(255) } };
+      vst4q_u8(reinterpret_cast<uint8_t*>(rgba + i * 4), pixels);
+    }
+
+    rgb_to_rgba_scalar(rgb + i * 3, rgba + i * 4, pixel_count - i);
+  }
+
+  void swizzle_rb_neon(const char* rgba, char* bgra, size_t pixel_count)
+  {
+    size_t i = 0;
+    for (; i + 16 <= pixel_count; i += 16)
+    {
+      uint8x16x4_t pixels = vld4q_u8(reinterpret_cast<const uint8_t*>(rgba + i * 4));
+      uint8x16_t red = pixels.val[0];
+      pixels.val[0] = pixels.val[2];
+      pixels.val[2] = red;
+      vst4q_u8(reinterpret_cast<uint8_t*>(bgra + i * 4), pixels);
+    }
+
+    swizzle_rb_scalar(rgba + i * 4, bgra + i * 4, pixel_count - i);
+  }
+
+  // (t + ((t + 128) >> 8) + 128) >> 8, the same rounding as multiply_255
+  inline uint8x16_t multiply_255_neon(uint8x16_t color, uint8x16_t alpha)
+  {
+    uint16x8_t low = vmull_u8(vget_low_u8(color), vget_low_u8(alpha));
+    uint16x8_t high = vmull_u8(vget_high_u8(color), vget_high_u8(alpha));
+    return vcombine_u8(vraddhn_u16(low, vrshrq_n_u16(low, 8)), vraddhn_u16(high, vrshrq_n_u16(high, 8)));
+  }
+
+  void premultiply_alpha_neon(char* rgba, size_t pixel_count)
+  {
+    size_t i = 0;
+    for (; i + 16 <= pixel_count; i += 16)
+    {
+      uint8x16x4_t pixels = vld4q_u8(reinterpret_cast<const uint8_t*>(rgba + i * 4));
+      pixels.val[0] = multiply_255_neon(pixels.val[0], pixels.val[3]);
+      pixels.val[1] = multiply_255_neon(pixels.val[1], pixels.val[3]);
+      pixels.val[2] = multiply_255_neon(pixels.val[2], pixels.val[3]);
+      vst4q_u8(reinterpret_cast<uint8_t*>(rgba + i * 4), pixels);
+    }
+
+    premultiply_alpha_scalar(rgba + i * 4, pixel_count - i);
+  }
+
+  void float_to_half_neon(const float* input, uint16_t* output, size_t count)
+  {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+      vst1_u16(output + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(input + i))));
+
+    float_to_half_scalar(input + i, output + i, count - i);
+  }
+
+  const PixelKernels neon_kernels = {
+    PixelKernelSet::NEON,
+    rgb_to_rgba_neon,
+    swizzle_rb_neon,
+    premultiply_alpha_neon,
+    srgb_to_linear_scalar, // no gather either
+    float_to_half_neon
+  };
+#endif
+
+  // every set this CPU can run, widest last
+  std::vector<const PixelKernels*> supported_kernels()
+  {
+    std::vector<const PixelKernels*> result = { &scalar_kernels };
+#ifdef PIXEL_CONVERT_X86
+    result.push_back(&sse2_kernels);
+    if (cpu_supports_avx2())
+      result.push_back(&avx2_kernels);
+#endif
+#ifdef PIXEL_CONVERT_NEON
+    result.push_back(&neon_kernels);
+#endif
+    return result;
+  }
+
+  const PixelKernels& kernels()
+  {
+    static const PixelKernels& selected = *supported_kernels().back();
+    return selected;
+  }
+}
+
+PixelKernelSet pixel_kernel_set()
+{
+  return kernels().set;
+}
+
+const char* pixel_kernel_set_name(PixelKernelSet set)
+{
+  switch (set)
+  {
+  case PixelKernelSet::SSE2: return "SSE2";
+  case PixelKernelSet::AVX2: return "AVX2";
+  case PixelKernelSet::NEON: return "NEON";
+  default: return "Scalar";
+  }
+}
+
+void rgb_to_rgba(const char* rgb, char* rgba, size_t pixel_count)
+{
+  kernels().rgb_to_rgba(rgb, rgba, pixel_count);
+}
+
+void swizzle_rb(const char* rgba, char* bgra, size_t pixel_count)
+{
+  kernels().swizzle_rb(rgba, bgra, pixel_count);
+}
+
+void premultiply_alpha(char* rgba, size_t pixel_count)
+{
+  kernels().premultiply_alpha(rgba, pixel_count);
+}
+
+void srgb_to_linear(const char* rgba, float* linear_rgba, size_t pixel_count)
+{
+  kernels().srgb_to_linear(rgba, linear_rgba, pixel_count);
+}
+
+void float_to_half(const float* input, uint16_t* output, size_t count)
+{
+  kernels().float_to_half(input, output, count);
+}
+
+void benchmark_pixel_kernels(size_t pixel_count)
+{
+  std::vector<char>     rgb(pixel_count * 3);
+  std::vector<char>     rgba(pixel_count * 4);
+  std::vector<char>     bgra(pixel_count * 4);
+  std::vector<float>    linear(pixel_count * 4);
+  std::vector<uint16_t> halves(pixel_count * 4);
+
+  for (size_t i = 0; i < rgb.size(); ++i)
+    rgb[i] = static_cast<char>(i * 7);
+  for (size_t i = 0; i < rgba.size(); ++i)
+    rgba[i] = static_cast<char>(i * 13);
+  for (size_t i = 0; i < linear.size(); ++i)
+    linear[i] = static_cast<float>(i % 4096) / 64.0f - 32.0f;
+
+  // bytes per second counts the larger side of each conversion, best of a few runs
+  auto measure = [](const char* kernel, const char* set, size_t bytes, const std::function<void()>& run)
+  {
+    double best_seconds = 1e30;
+    for (int repeat = 0; repeat < 5; ++repeat)
+    {
+      auto begin = std::chrono::high_resolution_clock::now();
+      run();
+      std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - begin;
+      best_seconds = std::min(best_seconds, seconds.count());
+    }
+
+    char line[128];
+    snprintf(line, sizeof(line), "%-18s %-7s %8.2f GB/s\n", kernel, set, bytes / best_seconds / 1e9);
+    OutputDebugString(line);
+  };
+
+  for (const PixelKernels* set : supported_kernels())
+  {
+    const char* name = pixel_kernel_set_name(set->set);
+    measure("rgb_to_rgba", name, pixel_count * 4, [&]() { set->rgb_to_rgba(rgb.data(), rgba.data(), pixel_count); });
+    measure("swizzle_rb", name, pixel_count * 4, [&]() { set->swizzle_rb(rgba.data(), bgra.data(), pixel_count); });
+    measure("premultiply_alpha", name, pixel_count * 4, [&]() { set->premultiply_alpha(bgra.data(), pixel_count); });
+    measure("srgb_to_linear", name, pixel_count * 16, [&]() { set->srgb_to_linear(rgba.data(), linear.data(), pixel_count); });
+    measure("float_to_half", name, pixel_count * 16, [&]() { set->float_to_half(linear.data(), halves.data(), pixel_count * 4); });
+  }
+}
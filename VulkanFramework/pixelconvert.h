@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// pixel format conversion kernels for the image load path, no Vulkan dependency
+// every kernel has a scalar version plus SSE2, AVX2 or NEON ones where they pay off,
+// the widest set the CPU supports is picked on first use
+
+// set to 1 to log the throughput of every kernel at startup
+#define PIXEL_KERNEL_BENCHMARK 0
+
+enum class PixelKernelSet
+{
+  Scalar,
+  SSE2,
+  AVX2, // AVX2 + F16C
+  NEON
+};
+
+PixelKernelSet pixel_kernel_set();
+const char* pixel_kernel_set_name(PixelKernelSet set);
+
+void rgb_to_rgba(const char* rgb, char* rgba, size_t pixel_count);            // alpha becomes 255
+void swizzle_rb(const char* rgba, char* bgra, size_t pixel_count);            // RGBA <-> BGRA, may run in place
+void premultiply_alpha(char* rgba, size_t pixel_count);                       // exact c * a / 255, rounded
+void srgb_to_linear(const char* rgba, float* linear_rgba, size_t pixel_count); // alpha is already linear, only scaled
+void float_to_half(const float* input, uint16_t* output, size_t count);       // round to nearest even, keeps inf and nan
+
+// runs every kernel of every set this CPU supports over pixel_count pixels and logs bytes per second
+void benchmark_pixel_kernels(size_t pixel_count);
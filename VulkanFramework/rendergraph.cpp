@@ -0,0 +1,486 @@
+#include <algorithm>
+
+#include "rendergraph.h"
+
+namespace
+{
+  struct UsageState
+  {
+    VkPipelineStageFlags stage;
+    VkAccessFlags        access;
+    VkImageLayout        layout; // ignored for buffers
+  };
+
+  const UsageState usage_states[] = {
+    { VK_PIPELINE_STAGE_TRANSFER_BIT,                VK_ACCESS_TRANSFER_READ_BIT,                                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL },     // TransferRead
+    { VK_PIPELINE_STAGE_TRANSFER_BIT,                VK_ACCESS_TRANSFER_WRITE_BIT,                                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL },     // TransferWrite
+    { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,                                        VK_IMAGE_LAYOUT_UNDEFINED },                // VertexBuffer
+    { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,            VK_ACCESS_INDEX_READ_BIT,                                                   VK_IMAGE_LAYOUT_UNDEFINED },                // IndexBuffer
+    { VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,           VK_ACCESS_UNIFORM_READ_BIT,                                                 VK_IMAGE_LAYOUT_UNDEFINED },                // UniformRead
+    { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,         VK_ACCESS_SHADER_READ_BIT,                                                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }, // SampledRead
+    { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL }, // ColorAttachment
+    { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL }, // DepthAttachment
+    { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,          0,                                                                          VK_IMAGE_LAYOUT_PRESENT_SRC_KHR }           // Present
+  };
+  static_assert(sizeof(usage_states) / sizeof(usage_states[0]) == static_cast<size_t>(RenderUsage::Count), "every usage needs a state");
+
+  // what an image has to be created with to be used like this
+  VkImageUsageFlags image_usage(RenderUsage usage)
+  {
+    switch (usage)
+    {
+    case RenderUsage::TransferRead:    return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    case RenderUsage::TransferWrite:   return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    case RenderUsage::SampledRead:     return VK_IMAGE_USAGE_SAMPLED_BIT;
+    case RenderUsage::ColorAttachment: return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    case RenderUsage::DepthAttachment: return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    default:                           return 0;
+    }
+  }
+
+  const VkImageUsageFlags attachment_usages = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+  const VkAccessFlags write_accesses = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+  // what the graph knows about a resource between two uses
+  struct TrackedState
+  {
+    VkImageLayout        layout;
+    uint32_t             queue_family;
+    VkPipelineStageFlags write_stage;  // last write or layout transition, 0 = none
+    VkAccessFlags        write_access; // 0 after a transition, nothing left to make visible
+    VkPipelineStageFlags synced_stages; // already ordered after write_stage and seeing its writes
+    VkAccessFlags        synced_access;
+    VkPipelineStageFlags read_stages;  // reads since then, a write has to wait for them
+  };
+
+  // everything one pass asks of one resource
+  struct Need
+  {
+    VkPipelineStageFlags stage;
+    VkAccessFlags        access;
+    VkImageLayout        layout;
+    bool                 write;
+    bool                 discard; // previous contents aren't needed
+  };
+}
+
+void RenderGraph::Reset(uint32_t queue_family)
+{
+  m_queue_family = queue_family;
+  m_resources.clear();
+  m_passes.clear();
+  m_barriers.clear();
+}
+
+RenderGraph::Resource RenderGraph::ImportImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout layout, VkPipelineStageFlags stage,
+  VkAccessFlags access, uint32_t queue_family)
+{
+  ResourceInfo resource = {};
+  resource.is_image = true;
+  resource.image = image;
+  resource.buffer = VK_NULL_HANDLE;
+  resource.range = range;
+  resource.layout = layout;
+  resource.stage = stage;
+  resource.access = access;
+  resource.queue_family = queue_family;
+  resource.exported = false;
+  m_resources.push_back(resource);
+  return static_cast<Resource>(m_resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::ImportImage(ImageStateTracker& tracker, VkImage image, const VkImageSubresourceRange& range, VkPipelineStageFlags stage,
+  uint32_t queue_family)
+{
+  ImageStateTracker::State state;
+  bool uniform = tracker.GetState(image, range, state);
+
+  Resource resource = ImportImage(image, range, state.layout, stage ? stage : state.stage, state.access, queue_family);
+  m_resources[resource].tracker = &tracker;
+  m_resources[resource].mixed_state = !uniform;
+  return resource;
+}
+
+RenderGraph::Resource RenderGraph::ImportBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkPipelineStageFlags stage, VkAccessFlags access)
+{
+  ResourceInfo resource = {};
+  resource.is_image = false;
+  resource.image = VK_NULL_HANDLE;
+  resource.buffer = buffer;
+  resource.offset = offset;
+  resource.size = size;
+  resource.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  resource.stage = stage;
+  resource.access = access;
+  resource.queue_family = VK_QUEUE_FAMILY_IGNORED;
+  resource.exported = false;
+  m_resources.push_back(resource);
+  return static_cast<Resource>(m_resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::CreateTransientImage(const TransientImageDesc& desc)
+{
+  VkImageSubresourceRange range = {
+    desc.aspect, // aspectMask
+    0,           // baseMipLevel
+    1,           // levelCount
+    0,           // baseArrayLayer
+    1            // layerCount
+  };
+
+  Resource resource = ImportImage(VK_NULL_HANDLE, range, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
+  m_resources[resource].transient = true;
+  m_resources[resource].desc = desc;
+  return resource;
+}
+
+void RenderGraph::Export(Resource resource, RenderUsage usage, uint32_t queue_family)
+{
+  m_resources[resource].exported = true;
+  m_resources[resource].export_usage = usage;
+  m_resources[resource].export_queue_family = queue_family;
+}
+
+RenderGraph::Pass RenderGraph::AddPass(const char* name, std::function<void(VkCommandBuffer)> record)
+{
+  PassInfo pass;
+  pass.name = name;
+  pass.record = std::move(record);
+  pass.keep = false;
+  pass.culled = false;
+  m_passes.push_back(std::move(pass));
+  return static_cast<Pass>(m_passes.size() - 1);
+}
+
+void RenderGraph::Read(Pass pass, Resource resource, RenderUsage usage)
+{
+  m_passes[pass].uses.push_back({ resource, usage, false, false, {} });
+}
+
+void RenderGraph::Write(Pass pass, Resource resource, RenderUsage usage)
+{
+  m_passes[pass].uses.push_back({ resource, usage, true, false, {} });
+}
+
+void RenderGraph::Clear(Pass pass, Resource resource, RenderUsage usage)
+{
+  m_passes[pass].uses.push_back({ resource, usage, true, true, {} });
+}
+
+void RenderGraph::KeepPass(Pass pass)
+{
+  m_passes[pass].keep = true;
+}
+
+bool RenderGraph::Compile(const TransientAllocator& allocate_transients)
+{
+  for (const ResourceInfo& resource : m_resources)
+    if (resource.mixed_state)
+      return false;
+
+  // backwards: a pass is needed when it writes something needed after it, and then needs what it reads
+  // a clear doesn't need the earlier contents, any other write only changes part of them
+  std::vector<bool> needed(m_resources.size());
+  for (size_t i = 0; i < m_resources.size(); ++i)
+    needed[i] = m_resources[i].exported;
+
+  for (size_t p = m_passes.size(); p-- > 0;)
+  {
+    PassInfo& pass = m_passes[p];
+    bool live = pass.keep;
+    for (const Use& use : pass.uses)
+      live = live || (use.write && needed[use.resource]);
+
+    pass.culled = !live;
+    if (!live)
+      continue;
+
+    for (Use& use : pass.uses)
+      use.attachment.store_op = needed[use.resource] ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    for (const Use& use : pass.uses)
+      if (use.clear)
+        needed[use.resource] = false;
+    for (const Use& use : pass.uses)
+      if (!use.clear)
+        needed[use.resource] = true;
+  }
+
+  // transients live from the first to the last live pass using them, the allocator decides where their memory goes
+  std::vector<TransientImage> transients;
+  std::vector<uint32_t> first_passes(m_resources.size(), UINT32_MAX);
+  for (size_t p = 0; p < m_passes.size(); ++p)
+  {
+    if (m_passes[p].culled)
+      continue;
+
+    for (const Use& use : m_passes[p].uses)
+    {
+      if (!m_resources[use.resource].transient)
+        continue;
+
+      auto transient = std::find_if(transients.begin(), transients.end(), [&](const TransientImage& t) { return t.resource == use.resource; });
+      if (transient == transients.end())
+      {
+        TransientImage image = {};
+        image.resource = use.resource;
+        image.desc = m_resources[use.resource].desc;
+        image.first_pass = static_cast<uint32_t>(p);
+        transients.push_back(image);
+        transient = transients.end() - 1;
+        first_passes[use.resource] = static_cast<uint32_t>(p);
+      }
+      transient->usage |= image_usage(use.usage);
+      transient->last_pass = static_cast<uint32_t>(p);
+    }
+  }
+
+  if (!transients.empty())
+  {
+    for (TransientImage& transient : transients)
+      transient.lazy = ((transient.usage & ~attachment_usages) == 0) && (transient.first_pass == transient.last_pass);
+
+    if (!allocate_transients || !allocate_transients(transients))
+      return false;
+
+    for (const TransientImage& transient : transients)
+    {
+      for (Resource alias : transient.aliases)
+        if ((first_passes[alias] == UINT32_MAX) || (first_passes[alias] >= transient.first_pass))
+          return false;
+
+      m_resources[transient.resource].image = transient.image;
+      m_resources[transient.resource].aliases = transient.aliases;
+    }
+  }
+
+  std::vector<TrackedState> states(m_resources.size());
+  for (size_t i = 0; i < m_resources.size(); ++i)
+  {
+    const ResourceInfo& resource = m_resources[i];
+    TrackedState& state = states[i];
+    state.layout = resource.layout;
+    state.queue_family = resource.queue_family != VK_QUEUE_FAMILY_IGNORED ? resource.queue_family : m_queue_family;
+    state.write_stage = (resource.access & write_accesses) ? resource.stage : 0;
+    state.write_access = resource.access & write_accesses;
+    state.synced_stages = 0;
+    state.synced_access = 0;
+    state.read_stages = state.write_stage ? 0 : (resource.stage & ~VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+  }
+
+  // the barrier one need asks for, if any, and the state after it; family is who owns the resource afterwards
+  auto add_barrier = [&](BarrierBatch& batch, Resource r, const Need& need, uint32_t family)
+  {
+    const ResourceInfo& resource = m_resources[r];
+    TrackedState& state = states[r];
+
+    bool layout_change = resource.is_image && (state.layout != need.layout);
+    bool family_change = (state.queue_family != VK_QUEUE_FAMILY_IGNORED) && (family != VK_QUEUE_FAMILY_IGNORED) && (state.queue_family != family) &&
+      !(resource.is_image && need.discard);
+    bool unsynced = (state.write_stage != 0) && (((need.stage & ~state.synced_stages) != 0) || ((state.write_access != 0) && ((need.access & ~state.synced_access) != 0)));
+
+    bool barrier = layout_change || family_change || unsynced;
+    if (need.write)
+      barrier = barrier || (state.write_access != 0) || (state.read_stages != 0);
+
+    if (barrier)
+    {
+      VkPipelineStageFlags src_stage = state.write_stage | state.read_stages;
+      batch.src_stage |= src_stage ? src_stage : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+      batch.dst_stage |= need.stage;
+
+      uint32_t src_family = family_change ? state.queue_family : VK_QUEUE_FAMILY_IGNORED;
+      uint32_t dst_family = family_change ? family : VK_QUEUE_FAMILY_IGNORED;
+      if (resource.is_image)
+      {
+        VkImageMemoryBarrier image_barrier = {
+          VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,                  // VkStructureType
+          nullptr,                                                 // pNext
+          state.write_access,                                      // srcAccessMask
+          need.access,                                             // dstAccessMask
+          need.discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout, // oldLayout
+          need.layout,                                             // newLayout
+          src_family,                                              // srcQueueFamilyIndex
+          dst_family,                                              // dstQueueFamilyIndex
+          resource.image,                                          // image
+          resource.range                                           // subresourceRange
+        };
+        batch.image_barriers.push_back(image_barrier);
+      }
+      else
+      {
+        VkBufferMemoryBarrier buffer_barrier = {
+          VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, // VkStructureType
+          nullptr,                                 // pNext
+          state.write_access,                      // srcAccessMask
+          need.access,                             // dstAccessMask
+          src_family,                              // srcQueueFamilyIndex
+          dst_family,                              // dstQueueFamilyIndex
+          resource.buffer,                         // buffer
+          resource.offset,                         // offset
+          resource.size                            // size
+        };
+        batch.buffer_barriers.push_back(buffer_barrier);
+      }
+    }
+
+    // discarded contents change owner without a transfer
+    if (family != VK_QUEUE_FAMILY_IGNORED)
+      state.queue_family = family;
+
+    if (need.write)
+    {
+      if (resource.is_image)
+        state.layout = need.layout;
+      state.write_stage = need.stage;
+      state.write_access = need.access & write_accesses;
+      state.synced_stages = 0;
+      state.synced_access = 0;
+      state.read_stages = 0;
+    }
+    else if (layout_change)
+    {
+      // the transition is what everyone after has to be ordered behind
+      state.layout = need.layout;
+      state.write_stage = need.stage;
+      state.write_access = 0;
+      state.synced_stages = need.stage;
+      state.synced_access = need.access;
+      state.read_stages = need.stage;
+    }
+    else
+    {
+      if (barrier)
+      {
+        state.synced_stages |= need.stage;
+        state.synced_access |= need.access;
+      }
+      state.read_stages |= need.stage;
+    }
+  };
+
+  m_barriers.assign(m_passes.size() + 1, BarrierBatch());
+  for (size_t p = 0; p < m_passes.size(); ++p)
+  {
+    PassInfo& pass = m_passes[p];
+    if (pass.culled)
+      continue;
+
+    // all uses of one resource in a pass become one need, they can't disagree on the layout
+    for (size_t u = 0; u < pass.uses.size(); ++u)
+    {
+      Use& use = pass.uses[u];
+      bool first = true;
+      for (size_t earlier = 0; earlier < u; ++earlier)
+        first = first && (pass.uses[earlier].resource != use.resource);
+      if (!first)
+        continue;
+
+      const UsageState& usage_state = usage_states[static_cast<size_t>(use.usage)];
+      Need need = { usage_state.stage, usage_state.access, usage_state.layout, use.write, use.clear };
+      for (size_t later = u + 1; later < pass.uses.size(); ++later)
+      {
+        const Use& other = pass.uses[later];
+        if (other.resource != use.resource)
+          continue;
+
+        const UsageState& other_state = usage_states[static_cast<size_t>(other.usage)];
+        if (m_resources[use.resource].is_image && (other_state.layout != need.layout))
+          return false;
+        need.stage |= other_state.stage;
+        need.access |= other_state.access;
+        need.write = need.write || other.write;
+        need.discard = need.discard && other.clear;
+      }
+      // memory taken over from other transients still has their last uses in flight
+      if (first_passes[use.resource] == p)
+      {
+        TrackedState& state = states[use.resource];
+        for (Resource alias : m_resources[use.resource].aliases)
+        {
+          state.write_stage |= states[alias].write_stage | states[alias].read_stages;
+          state.write_access |= states[alias].write_access;
+        }
+      }
+      need.discard = need.discard || (states[use.resource].layout == VK_IMAGE_LAYOUT_UNDEFINED);
+
+      // contents before the pass: cleared, kept, or whatever was there when nobody wrote them yet
+      use.attachment.load_op = use.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR :
+        (states[use.resource].layout == VK_IMAGE_LAYOUT_UNDEFINED ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD);
+      use.attachment.layout = need.layout;
+
+      add_barrier(m_barriers[p], use.resource, need, m_queue_family);
+    }
+  }
+
+  // leave exported resources how the next user expects them, a write usage only needs its layout
+  for (size_t r = 0; r < m_resources.size(); ++r)
+  {
+    const ResourceInfo& resource = m_resources[r];
+    if (!resource.exported)
+      continue;
+
+    const UsageState& usage_state = usage_states[static_cast<size_t>(resource.export_usage)];
+    uint32_t family = resource.export_queue_family != VK_QUEUE_FAMILY_IGNORED ? resource.export_queue_family : m_queue_family;
+    bool hand_over = (family != VK_QUEUE_FAMILY_IGNORED) && (states[r].queue_family != VK_QUEUE_FAMILY_IGNORED) && (family != states[r].queue_family);
+    bool layout_change = resource.is_image && (states[r].layout != usage_state.layout);
+    if (((usage_state.access & write_accesses) != 0) && !layout_change && !hand_over)
+      continue;
+
+    Need need = { usage_state.stage, usage_state.access, usage_state.layout, false, false };
+    add_barrier(m_barriers.back(), static_cast<Resource>(r), need, family);
+  }
+
+  for (size_t r = 0; r < m_resources.size(); ++r)
+  {
+    const ResourceInfo& resource = m_resources[r];
+    if (resource.tracker == nullptr)
+      continue;
+
+    const TrackedState& state = states[r];
+    VkPipelineStageFlags stage = state.write_stage | state.read_stages;
+    ImageStateTracker::State final_state = { state.layout, stage ? stage : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT), state.write_access | state.synced_access };
+    resource.tracker->SetState(resource.image, resource.range, final_state);
+  }
+
+  return true;
+}
+
+RenderGraph::Attachment RenderGraph::GetAttachment(Pass pass, Resource resource) const
+{
+  for (const Use& use : m_passes[pass].uses)
+    if (use.resource == resource)
+      return use.attachment;
+
+  Attachment unused = { VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED };
+  return unused;
+}
+
+void RenderGraph::Execute(VkCommandBuffer command_buffer, PFN_vkCmdPipelineBarrier cmd_pipeline_barrier) const
+{
+  if (m_barriers.empty())
+    return; // never compiled
+
+  auto record_barriers = [command_buffer, cmd_pipeline_barrier](const BarrierBatch& batch)
+  {
+    if (batch.image_barriers.empty() && batch.buffer_barriers.empty())
+      return;
+
+    cmd_pipeline_barrier(command_buffer, batch.src_stage, batch.dst_stage, 0, 0, nullptr,
+      static_cast<uint32_t>(batch.buffer_barriers.size()), batch.buffer_barriers.data(),
+      static_cast<uint32_t>(batch.image_barriers.size()), batch.image_barriers.data());
+  };
+
+  for (size_t p = 0; p < m_passes.size(); ++p)
+  {
+    if (m_passes[p].culled)
+      continue;
+
+    record_barriers(m_barriers[p]);
+    if (m_passes[p].record)
+      m_passes[p].record(command_buffer);
+  }
+  record_barriers(m_barriers.back());
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "resources\vulkan\vulkan.h"
+#include "imagestatetracker.h"
+
+// how a pass touches a resource, each one stands for the exact stages, access and image layout of that use
+enum class RenderUsage : uint8_t
+{
+  TransferRead,
+  TransferWrite,
+  VertexBuffer,
+  IndexBuffer,
+  UniformRead,     // vertex shader
+  SampledRead,     // fragment shader
+  ColorAttachment, // blended, so read and write
+  DepthAttachment, // tested and written
+  Present,
+  Count
+};
+
+// one frame's (or one upload's) work as passes that declare the images and buffers they use
+// passes run in the order they were added, Compile drops the ones nothing exported depends on and works out
+// a single batched barrier in front of each pass, and the load and store ops of its attachments
+// barriers only cover what the uses need: reads after reads get none, writes after reads only wait, and layouts
+// are changed where a use asks for a different one
+// transient images get their memory from an allocator while compiling, one that reuses another's memory waits for
+// that one's last use in the barrier in front of its first
+class RenderGraph
+{
+public:
+  using Resource = uint32_t;
+  using Pass = uint32_t;
+
+  struct Attachment
+  {
+    VkAttachmentLoadOp  load_op;
+    VkAttachmentStoreOp store_op;
+    VkImageLayout       layout; // render passes keep the attachment in this layout, the graph transitions around them
+  };
+
+  // images that only exist between the passes of one graph, nobody before or after sees their contents
+  struct TransientImageDesc
+  {
+    VkFormat           format;
+    VkExtent2D         extent;
+    VkImageAspectFlags aspect;
+  };
+  // what Compile asks the allocator to back, one per transient image some live pass uses
+  // the allocator fills in image, and aliases with the transients whose memory it reuses, those are done before first_pass
+  struct TransientImage
+  {
+    Resource              resource;
+    TransientImageDesc    desc;
+    VkImageUsageFlags     usage;      // everything its uses need
+    bool                  lazy;       // only ever an attachment inside one pass, the contents can stay in tile memory
+    uint32_t              first_pass;
+    uint32_t              last_pass;
+    VkImage               image;
+    std::vector<Resource> aliases;
+  };
+  using TransientAllocator = std::function<bool(std::vector<TransientImage>&)>;
+
+private:
+  struct ResourceInfo
+  {
+    bool                    is_image;
+    VkImage                 image;
+    VkBuffer                buffer;
+    VkImageSubresourceRange range;
+    VkDeviceSize            offset;
+    VkDeviceSize            size;
+    VkImageLayout           layout;
+    VkPipelineStageFlags    stage;
+    VkAccessFlags           access;
+    uint32_t                queue_family;
+    bool                    exported;
+    RenderUsage             export_usage;
+    uint32_t                export_queue_family;
+    bool                    transient;
+    TransientImageDesc      desc;
+    std::vector<Resource>   aliases;
+    ImageStateTracker*      tracker; // told the final state once compiled
+    bool                    mixed_state;
+  };
+  struct Use
+  {
+    Resource    resource;
+    RenderUsage usage;
+    bool        write;
+    bool        clear; // attachment contents start from the clear value
+    Attachment  attachment;
+  };
+  struct PassInfo
+  {
+    const char*                          name;
+    std::function<void(VkCommandBuffer)> record;
+    std::vector<Use>                     uses;
+    bool                                 keep;
+    bool                                 culled;
+  };
+  struct BarrierBatch
+  {
+    VkPipelineStageFlags               src_stage;
+    VkPipelineStageFlags               dst_stage;
+    std::vector<VkImageMemoryBarrier>  image_barriers;
+    std::vector<VkBufferMemoryBarrier> buffer_barriers;
+  };
+
+  uint32_t                  m_queue_family = VK_QUEUE_FAMILY_IGNORED;
+  std::vector<ResourceInfo> m_resources;
+  std::vector<PassInfo>     m_passes;
+  std::vector<BarrierBatch> m_barriers; // one per pass, plus the exports at the end
+
+public:
+  // starts over, the queue family is the one the graph gets submitted to
+  void Reset(uint32_t queue_family = VK_QUEUE_FAMILY_IGNORED);
+
+  // resources live outside the graph, imported with the state their last user left them in
+  // a layout of VK_IMAGE_LAYOUT_UNDEFINED means the contents don't matter, handles may be null when only the ops are wanted
+  Resource ImportImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout layout, VkPipelineStageFlags stage, VkAccessFlags access,
+    uint32_t queue_family = VK_QUEUE_FAMILY_IGNORED);
+  // same, with the state the tracker last saw, and the tracker learns the state the graph leaves the image in
+  // the range has to be in one state, a Transition flushed before the graph's barriers gets it there
+  // a stage replaces the tracked one when something else orders the image, like the semaphore an acquired image is waited on at
+  Resource ImportImage(ImageStateTracker& tracker, VkImage image, const VkImageSubresourceRange& range, VkPipelineStageFlags stage = 0,
+    uint32_t queue_family = VK_QUEUE_FAMILY_IGNORED);
+  Resource ImportBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkPipelineStageFlags stage, VkAccessFlags access);
+  // created and thrown away within the graph, gets its image from the allocator handed to Compile and can't be exported
+  Resource CreateTransientImage(const TransientImageDesc& desc);
+  // the state the resource is left in for whoever uses it after the graph, a different queue family also hands it over
+  // passes that don't lead to an exported resource are culled
+  void Export(Resource resource, RenderUsage usage, uint32_t queue_family = VK_QUEUE_FAMILY_IGNORED);
+
+  Pass AddPass(const char* name, std::function<void(VkCommandBuffer)> record);
+  void Read(Pass pass, Resource resource, RenderUsage usage);
+  void Write(Pass pass, Resource resource, RenderUsage usage);
+  // attachment write that doesn't need the previous contents
+  void Clear(Pass pass, Resource resource, RenderUsage usage = RenderUsage::ColorAttachment);
+  void KeepPass(Pass pass); // for passes with effects outside of the graph
+
+  // false when a pass wants one resource in two layouts at once, a tracked range isn't in one state, or transient images couldn't be allocated
+  bool Compile(const TransientAllocator& allocate_transients = nullptr);
+  bool IsCulled(Pass pass) const { return m_passes[pass].culled; }
+  Attachment GetAttachment(Pass pass, Resource resource) const;
+  // the renderer owns the loaded device functions, so it hands over the one the graph records with
+  void Execute(VkCommandBuffer command_buffer, PFN_vkCmdPipelineBarrier cmd_pipeline_barrier) const;
+};
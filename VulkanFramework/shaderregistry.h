@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// SPIR-V of every shader under shaders/, compiled and embedded by ShaderBuilder before each build
+// the arrays are defined here, so only include this where shaders get created
+struct EmbeddedShader
+{
+  const char*     name; // source path relative to shaders/, "t6/t6.vert"
+  const uint32_t* code;
+  size_t          size; // bytes
+};
+
+#include "shaders\embeddedshaders.inl"
+
+constexpr bool shader_name_equal(const char* a, const char* b)
+{
+  while ((*a != '\0') && (*a == *b))
+  {
+    ++a;
+    ++b;
+  }
+  return *a == *b;
+}
+
+constexpr const EmbeddedShader* find_embedded_shader(const char* name)
+{
+  for (const EmbeddedShader& shader : embedded_shaders)
+    if ((shader.name != nullptr) && shader_name_equal(shader.name, name))
+      return &shader;
+  return nullptr;
+}
+
+// for static_assert, so a shader that is not embedded becomes a build error
+constexpr bool is_shader_embedded(const char* name)
+{
+  return find_embedded_shader(name) != nullptr;
+}
@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+#include "fileio.h"
+#include "shaderwatcher.h"
+#include "..\ShaderBuilder\spirvstrip.h"
+
+ShaderWatcher shaderWatcher;
+
+namespace
+{
+  const char* const shader_stages[] = { "vert", "frag", "comp", "geom", "tesc", "tese" };
+
+  // editors save in several steps, a change is compiled once the directory has been quiet this long
+  const DWORD settle_milliseconds = 100;
+
+  bool is_shader_source(const std::string& name)
+  {
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos)
+      return false;
+    for (const char* stage : shader_stages)
+      if (name.compare(dot + 1, std::string::npos, stage) == 0)
+        return true;
+    return false;
+  }
+
+  void log(const std::string& text)
+  {
+    OutputDebugString(text.c_str());
+  }
+}
+
+void ShaderWatcher::Initialize()
+{
+#if SHADER_HOT_RELOAD
+  // nothing to watch when running without the sources, like from a copied build
+  DWORD attributes = GetFileAttributesA((m_directory + "glslangValidator.exe").c_str());
+  if ((attributes == INVALID_FILE_ATTRIBUTES) || (attributes & FILE_ATTRIBUTE_DIRECTORY))
+    return;
+
+  m_stop_event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+  if (m_stop_event == nullptr)
+    return;
+
+  m_thread = std::thread(&ShaderWatcher::WatchLoop, this);
+#endif
+}
+
+void ShaderWatcher::Terminate()
+{
+  if (m_stop_event == nullptr)
+    return;
+
+  SetEvent(m_stop_event);
+  if (m_thread.joinable())
+    m_thread.join();
+  CloseHandle(m_stop_event);
+  m_stop_event = nullptr;
+  m_changes.clear();
+}
+
+bool ShaderWatcher::TakeChanges(std::vector<ChangedShader>& changes)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_changes.empty())
+    return false;
+
+  changes.swap(m_changes);
+  m_changes.clear();
+  return true;
+}
+
+void ShaderWatcher::WatchLoop()
+{
+  HANDLE directory = CreateFileA(m_directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+    nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+  if (directory == INVALID_HANDLE_VALUE)
+    return;
+
+  OVERLAPPED overlapped = {};
+  overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+  if (overlapped.hEvent == nullptr)
+  {
+    CloseHandle(directory);
+    return;
+  }
+
+  // FILE_NOTIFY_INFORMATION records are DWORD aligned
+  DWORD buffer[4096];
+  std::set<std::string> pending;
+  bool reading = false;
+  for (;;)
+  {
+    if (!reading)
+    {
+      ResetEvent(overlapped.hEvent);
+      if (!ReadDirectoryChangesW(directory, buffer, sizeof(buffer), TRUE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, nullptr, &overlapped, nullptr))
+        break;
+      reading = true;
+    }
+
+    HANDLE events[2] = { m_stop_event, overlapped.hEvent };
+    DWORD result = WaitForMultipleObjects(2, events, FALSE, pending.empty() ? INFINITE : settle_milliseconds);
+    if (result == WAIT_OBJECT_0 + 1)
+    {
+      reading = false;
+
+      // 0 bytes means the buffer overflowed and the changes are lost, the next save brings them back
+      DWORD bytes = 0;
+      if (!GetOverlappedResult(directory, &overlapped, &bytes, FALSE) || (bytes == 0))
+        continue;
+
+      const char* record = reinterpret_cast<const char*>(buffer);
+      for (;;)
+      {
+        const FILE_NOTIFY_INFORMATION* change = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(record);
+        int wide_length = static_cast<int>(change->FileNameLength / sizeof(WCHAR));
+        int length = WideCharToMultiByte(CP_UTF8, 0, change->FileName, wide_length, nullptr, 0, nullptr, nullptr);
+        std::string name(static_cast<size_t>(length), '\0');
+        WideCharToMultiByte(CP_UTF8, 0, change->FileName, wide_length, &name[0], length, nullptr, nullptr);
+        std::replace(name.begin(), name.end(), '\\', '/');
+
+        if ((change->Action != FILE_ACTION_REMOVED) && (change->Action != FILE_ACTION_RENAMED_OLD_NAME) && is_shader_source(name))
+          pending.insert(name);
+
+        if (change->NextEntryOffset == 0)
+          break;
+        record += change->NextEntryOffset;
+      }
+    }
+    else if (result == WAIT_TIMEOUT)
+    {
+      for (const std::string& name : pending)
+      {
+        ChangedShader changed;
+        changed.name = name;
+        if (!Compile(name, changed.code))
+          continue;
+
+        log(name + " reloaded\n");
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto same_name = std::find_if(m_changes.begin(), m_changes.end(), [&](const ChangedShader& other) { return other.name == name; });
+        if (same_name != m_changes.end())
+          same_name->code.swap(changed.code);
+        else
+          m_changes.push_back(std::move(changed));
+      }
+      pending.clear();
+    }
+    else
+      break; // stop event, or the wait itself failed
+  }
+
+  if (reading)
+  {
+    DWORD bytes;
+    CancelIoEx(directory, &overlapped);
+    GetOverlappedResult(directory, &overlapped, &bytes, TRUE);
+  }
+  CloseHandle(overlapped.hEvent);
+  CloseHandle(directory);
+}
+
+bool ShaderWatcher::Compile(const std::string& name, std::vector<uint32_t>& code)
+{
+  std::string source = name;
+  std::replace(source.begin(), source.end(), '/', '\\');
+  size_t dot = source.rfind('.');
+  std::string binary = m_directory + source.substr(0, dot) + "_" + source.substr(dot + 1) + ".spv";
+  source = m_directory + source;
+
+  // the compiler's output goes into a pipe so errors end up in the debug log instead of a console window
+  SECURITY_ATTRIBUTES inheritable = { sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE };
+  HANDLE output_read, output_write;
+  if (!CreatePipe(&output_read, &output_write, &inheritable, 0))
+    return false;
+  SetHandleInformation(output_read, HANDLE_FLAG_INHERIT, 0);
+
+  STARTUPINFOA startup_info = {};
+  startup_info.cb = sizeof(startup_info);
+  startup_info.dwFlags = STARTF_USESTDHANDLES;
+  startup_info.hStdOutput = output_write;
+  startup_info.hStdError = output_write;
+  PROCESS_INFORMATION process_info = {};
+
+  std::string command = "\"" + m_directory + "glslangValidator.exe\" -V -o \"" + binary + "\" \"" + source + "\"";
+  BOOL started = CreateProcessA(nullptr, &command[0], nullptr, nullptr, TRUE, CREATE_NO_WINDOW, nullptr, nullptr, &startup_info, &process_info);
+  CloseHandle(output_write);
+  if (!started)
+  {
+    CloseHandle(output_read);
+    log(name + ": could not start glslangValidator\n");
+    return false;
+  }
+
+  // reads until the compiler exits and the pipe breaks
+  std::string output;
+  char chunk[1024];
+  DWORD chunk_size;
+  while (ReadFile(output_read, chunk, sizeof(chunk), &chunk_size, nullptr) && (chunk_size > 0))
+    output.append(chunk, chunk_size);
+  CloseHandle(output_read);
+
+  DWORD exit_code = 1;
+  WaitForSingleObject(process_info.hProcess, INFINITE);
+  GetExitCodeProcess(process_info.hProcess, &exit_code);
+  CloseHandle(process_info.hProcess);
+  CloseHandle(process_info.hThread);
+
+  if (exit_code != 0)
+  {
+    log(output);
+    return false;
+  }
+
+  std::vector<char> bytes = read_binary_file(binary);
+  if ((bytes.size() < 20) || (bytes.size() % sizeof(uint32_t) != 0))
+    return false;
+
+  code.resize(bytes.size() / sizeof(uint32_t));
+  memcpy(code.data(), bytes.data(), bytes.size());
+  if (code[0] != 0x07230203)
+    return false;
+
+  // stripped the way ShaderBuilder strips the embedded copies, so a reload runs the same code they do
+  std::vector<uint32_t> stripped;
+  if (strip_spirv(code, stripped) && validate_stripped_spirv(code, stripped))
+    code.swap(stripped);
+  else
+    log(name + ": could not strip, using the module unchanged\n");
+  return true;
+}
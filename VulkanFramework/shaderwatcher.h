@@ -0,0 +1,47 @@
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// debug builds watch the shader sources and reload them while running, set to 0 to turn that off
+#ifdef NDEBUG
+#define SHADER_HOT_RELOAD 0
+#else
+#define SHADER_HOT_RELOAD 1
+#endif
+
+// watches the GLSL sources under the shader directory on its own thread and recompiles the ones that change
+// with the same glslangValidator call as ShaderBuilder, the renderer picks the new SPIR-V up at a frame boundary
+// a source that doesn't compile only logs the compiler's output, whatever was running keeps running
+extern class ShaderWatcher
+{
+public:
+  struct ChangedShader
+  {
+    std::string           name; // same names as the embedded shaders, "t6/t6.vert"
+    std::vector<uint32_t> code;
+  };
+
+private:
+  std::string                m_directory = "shaders\\";
+  std::thread                m_thread;
+  HANDLE                     m_stop_event = nullptr;
+  std::mutex                 m_mutex;
+  std::vector<ChangedShader> m_changes;
+
+  void Initialize();
+  void Terminate();
+  void WatchLoop();
+  bool Compile(const std::string& name, std::vector<uint32_t>& code);
+
+public:
+  // hands over everything compiled since the last call, false when nothing was
+  bool TakeChanges(std::vector<ChangedShader>& changes);
+
+  friend bool Initialize();
+  friend void Terminate();
+} shaderWatcher;
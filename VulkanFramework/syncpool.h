@@ -0,0 +1,200 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "assert.h"
+
+// fences and semaphores made up front and handed out again and again, so nothing creates sync objects mid frame
+// handles sit in blocks of 64 with one bit per handle saying it's free, taking one is a compare exchange on that word
+// and any thread can do it without a lock, only growing the pool by a block takes the mutex
+// every handle comes with the slot it sits in, and goes back with it so releasing doesn't have to search for it
+// handles come back reset, a semaphore has to be unsignaled again (its wait finished) before it's released
+// whatever is still out when the pool is destroyed gets counted as leaked
+template <typename Handle>
+class SyncPool
+{
+public:
+  using CreateFunction = std::function<bool(Handle&)>;
+  using ResetFunction = std::function<void(Handle)>;   // may be null, for objects that need no reset
+  using DestroyFunction = std::function<void(Handle)>;
+  using Slot = uint32_t; // block * 64 + bit
+
+private:
+  constexpr static uint32_t m_block_size = 64;
+  constexpr static uint32_t m_max_blocks = 64;
+
+  struct Block
+  {
+    Handle                handles[m_block_size];
+    std::atomic<uint64_t> free_mask;
+  };
+
+  // blocks are only ever appended, and a published block never changes its handles, so readers need no lock
+  std::unique_ptr<Block>   m_block_storage[m_max_blocks];
+  std::atomic<Block*>      m_blocks[m_max_blocks];
+  std::atomic<uint32_t>    m_block_count;
+  std::atomic<uint32_t>    m_acquired;
+  std::atomic<uint32_t>    m_peak_acquired;
+  std::mutex               m_grow_mutex;
+  CreateFunction           m_create;
+  ResetFunction            m_reset;
+  DestroyFunction          m_destroy;
+
+  static uint32_t lowest_bit(uint64_t mask)
+  {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<uint32_t>(index);
+#else
+    return static_cast<uint32_t>(__builtin_ctzll(mask));
+#endif
+  }
+
+  bool TryAcquire(Handle& handle, Slot& slot)
+  {
+    uint32_t block_count = m_block_count.load(std::memory_order_acquire);
+    for (uint32_t b = 0; b < block_count; ++b)
+    {
+      Block* block = m_blocks[b].load(std::memory_order_acquire);
+      uint64_t mask = block->free_mask.load(std::memory_order_relaxed);
+      while (mask != 0)
+      {
+        uint32_t bit = lowest_bit(mask);
+        if (block->free_mask.compare_exchange_weak(mask, mask & ~(uint64_t(1) << bit), std::memory_order_acquire, std::memory_order_relaxed))
+        {
+          handle = block->handles[bit];
+          slot = b * m_block_size + bit;
+          uint32_t acquired = m_acquired.fetch_add(1, std::memory_order_relaxed) + 1;
+          uint32_t peak = m_peak_acquired.load(std::memory_order_relaxed);
+          while ((acquired > peak) && !m_peak_acquired.compare_exchange_weak(peak, acquired, std::memory_order_relaxed))
+            ;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // caller holds m_grow_mutex
+  bool AddBlock()
+  {
+    uint32_t block_count = m_block_count.load(std::memory_order_relaxed);
+    if (block_count == m_max_blocks)
+      return false;
+
+    std::unique_ptr<Block> block(new Block);
+    for (uint32_t i = 0; i < m_block_size; ++i)
+      if (!m_create(block->handles[i]))
+      {
+        for (uint32_t j = 0; j < i; ++j)
+          m_destroy(block->handles[j]);
+        return false;
+      }
+    block->free_mask.store(~uint64_t(0), std::memory_order_relaxed);
+
+    m_blocks[block_count].store(block.get(), std::memory_order_release);
+    m_block_storage[block_count] = std::move(block);
+    m_block_count.store(block_count + 1, std::memory_order_release);
+    return true;
+  }
+
+public:
+  void Initialize(CreateFunction create, ResetFunction reset, DestroyFunction destroy)
+  {
+    m_create = std::move(create);
+    m_reset = std::move(reset);
+    m_destroy = std::move(destroy);
+    for (std::atomic<Block*>& block : m_blocks)
+      block.store(nullptr, std::memory_order_relaxed);
+    m_block_count.store(0, std::memory_order_relaxed);
+    m_acquired.store(0, std::memory_order_relaxed);
+    m_peak_acquired.store(0, std::memory_order_relaxed);
+  }
+
+  // makes sure at least count handles exist, meant for setup so the first frames don't pay for them
+  bool Reserve(uint32_t count)
+  {
+    std::lock_guard<std::mutex> lock(m_grow_mutex);
+    while (m_block_count.load(std::memory_order_relaxed) * m_block_size < count)
+      if (!AddBlock())
+        return false;
+    return true;
+  }
+
+  // false only when every handle is out and no more could be created
+  bool Acquire(Handle& handle, Slot& slot)
+  {
+    if (TryAcquire(handle, slot))
+      return true;
+
+    std::lock_guard<std::mutex> lock(m_grow_mutex);
+    // somebody may have grown the pool or released a handle while we waited
+    while (!TryAcquire(handle, slot))
+      if (!AddBlock())
+        return false;
+    return true;
+  }
+
+  // the handle has to be idle, a fence signaled or never submitted, a semaphore not waited on by anything pending
+  // a handle that isn't the one in its slot, or one that is already back, is left alone
+  void Release(Handle handle, Slot slot)
+  {
+    uint32_t b = slot / m_block_size;
+    uint32_t bit = slot % m_block_size;
+    Block* block = b < m_block_count.load(std::memory_order_acquire) ? m_blocks[b].load(std::memory_order_acquire) : nullptr;
+    if ((block == nullptr) || (block->handles[bit] != handle))
+    {
+      assert("Released a handle the pool doesn't own!", "Vulkan", Assert::Error);
+      return;
+    }
+    if ((block->free_mask.load(std::memory_order_relaxed) & (uint64_t(1) << bit)) != 0)
+    {
+      assert("Released a handle twice!", "Vulkan", Assert::Error);
+      return;
+    }
+
+    if (m_reset)
+      m_reset(handle);
+    // the reset has to happen before anybody can take the handle again, so a racing second release is only caught here
+    uint64_t old_mask = block->free_mask.fetch_or(uint64_t(1) << bit, std::memory_order_release);
+    if ((old_mask & (uint64_t(1) << bit)) != 0)
+    {
+      assert("Released a handle twice!", "Vulkan", Assert::Error);
+      return;
+    }
+    m_acquired.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  uint32_t Acquired() const { return m_acquired.load(std::memory_order_relaxed); }
+  uint32_t PeakAcquired() const { return m_peak_acquired.load(std::memory_order_relaxed); }
+  uint32_t Capacity() const { return m_block_count.load(std::memory_order_relaxed) * m_block_size; }
+
+  // destroys every handle, including ones never released, and returns how many of those there were
+  // nothing may be using the pool anymore, and the device has to be idle
+  uint32_t Destroy()
+  {
+    uint32_t leaked = m_acquired.load(std::memory_order_relaxed);
+
+    uint32_t block_count = m_block_count.load(std::memory_order_relaxed);
+    for (uint32_t b = 0; b < block_count; ++b)
+    {
+      for (Handle handle : m_block_storage[b]->handles)
+        m_destroy(handle);
+      m_blocks[b].store(nullptr, std::memory_order_relaxed);
+      m_block_storage[b].reset();
+    }
+    m_block_count.store(0, std::memory_order_relaxed);
+    m_acquired.store(0, std::memory_order_relaxed);
+
+    return leaked;
+  }
+};
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <atomic>
+
+#include "threadpool.h"
+
+ThreadPool threadPool;
+
+void ThreadPool::Initialize()
+{
+  // main thread joins ParallelFor work too, so leave one core for it
+  unsigned int hardware_threads = std::thread::hardware_concurrency();
+  size_t worker_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+
+  m_stop = false;
+  for (size_t i = 0; i < worker_count; ++i)
+    m_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+void ThreadPool::Terminate()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_condition.notify_all();
+
+  for (std::thread& worker : m_workers)
+    if (worker.joinable())
+      worker.join();
+  m_workers.clear();
+}
+
+void ThreadPool::WorkerLoop()
+{
+  for (;;)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+
+      // finish what is queued before leaving, someone may be waiting on it
+      if (m_stop && m_tasks.empty())
+        return;
+
+      task = std::move(m_tasks.front());
+      m_tasks.pop();
+    }
+    task();
+  }
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& body)
+{
+  if (count == 0)
+    return;
+
+  size_t chunk_count = std::min(count, (m_workers.size() + 1) * 4);
+  if (m_workers.empty() || chunk_count == 1)
+  {
+    body(0, count);
+    return;
+  }
+
+  // shared so helpers that get scheduled late never touch a dead stack frame
+  struct Job
+  {
+    std::atomic<size_t>                      next_chunk;
+    std::atomic<size_t>                      finished_chunks;
+    size_t                                   chunk_count;
+    size_t                                   count;
+    std::function<void(size_t, size_t)>      body;
+    std::mutex                               mutex;
+    std::condition_variable                  finished;
+  };
+
+  std::shared_ptr<Job> job = std::make_shared<Job>();
+  job->next_chunk = 0;
+  job->finished_chunks = 0;
+  job->chunk_count = chunk_count;
+  job->count = count;
+  job->body = body;
+
+  auto run = [job]()
+  {
+    size_t chunk;
+    while ((chunk = job->next_chunk.fetch_add(1)) < job->chunk_count)
+    {
+      job->body(job->count * chunk / job->chunk_count, job->count * (chunk + 1) / job->chunk_count);
+
+      if (job->finished_chunks.fetch_add(1) + 1 == job->chunk_count)
+      {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finished.notify_all();
+      }
+    }
+  };
+
+  size_t helper_count = std::min(m_workers.size(), chunk_count - 1);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < helper_count; ++i)
+      m_tasks.emplace(run);
+  }
+  m_condition.notify_all();
+
+  run();
+
+  std::unique_lock<std::mutex> lock(job->mutex);
+  job->finished.wait(lock, [&job]() { return job->finished_chunks == job->chunk_count; });
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+extern class ThreadPool
+{
+private:
+  std::vector<std::thread>          m_workers;
+  std::queue<std::function<void()>> m_tasks;
+  std::mutex                        m_mutex;
+  std::condition_variable           m_condition;
+  bool                              m_stop = false;
+
+  void WorkerLoop();
+
+public:
+  // public unlike the other singletons, so offline tools that link threadpool.cpp alone can start and stop the workers
+  void Initialize();
+  void Terminate();
+
+  size_t ThreadCount() const { return m_workers.size(); }
+
+  // runs task on a worker, or right away when the pool has no workers (offline tools)
+  template <typename F>
+  auto Submit(F&& task) -> std::future<decltype(task())>;
+
+  // splits [0, count) into ranges and blocks until all of them are done
+  // the calling thread takes ranges too, so it is safe to call from inside a worker
+  void ParallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& body);
+} threadPool;
+
+template <typename F>
+auto ThreadPool::Submit(F&& task) -> std::future<decltype(task())>
+{
+  using result_type = decltype(task());
+
+  auto packaged_task = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(task));
+  std::future<result_type> result = packaged_task->get_future();
+
+  if (m_workers.empty())
+  {
+    (*packaged_task)();
+    return result;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.emplace([packaged_task]() { (*packaged_task)(); });
+  }
+  m_condition.notify_one();
+
+  return result;
+}
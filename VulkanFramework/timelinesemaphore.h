@@ -0,0 +1,63 @@
+#pragma once
+
+#include "resources\vulkan\vulkan.h"
+
+// VK_KHR_timeline_semaphore is newer than the bundled headers, these are its definitions as the registry has them
+// devices without it get by with fences, see QueueTimeline in vktexturefinal.h
+#ifndef VK_KHR_timeline_semaphore
+#define VK_KHR_timeline_semaphore 1
+#define VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME "VK_KHR_timeline_semaphore"
+
+const VkStructureType VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR = static_cast<VkStructureType>(1000207000);
+const VkStructureType VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_PROPERTIES_KHR = static_cast<VkStructureType>(1000207001);
+const VkStructureType VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR = static_cast<VkStructureType>(1000207002);
+const VkStructureType VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR = static_cast<VkStructureType>(1000207003);
+const VkStructureType VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR = static_cast<VkStructureType>(1000207004);
+const VkStructureType VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO_KHR = static_cast<VkStructureType>(1000207005);
+
+typedef enum VkSemaphoreTypeKHR {
+  VK_SEMAPHORE_TYPE_BINARY_KHR = 0,
+  VK_SEMAPHORE_TYPE_TIMELINE_KHR = 1,
+  VK_SEMAPHORE_TYPE_MAX_ENUM_KHR = 0x7FFFFFFF
+} VkSemaphoreTypeKHR;
+
+typedef enum VkSemaphoreWaitFlagBitsKHR {
+  VK_SEMAPHORE_WAIT_ANY_BIT_KHR = 0x00000001,
+  VK_SEMAPHORE_WAIT_FLAG_BITS_MAX_ENUM_KHR = 0x7FFFFFFF
+} VkSemaphoreWaitFlagBitsKHR;
+typedef VkFlags VkSemaphoreWaitFlagsKHR;
+
+typedef struct VkPhysicalDeviceTimelineSemaphoreFeaturesKHR {
+  VkStructureType sType;
+  void*           pNext;
+  VkBool32        timelineSemaphore;
+} VkPhysicalDeviceTimelineSemaphoreFeaturesKHR;
+
+typedef struct VkSemaphoreTypeCreateInfoKHR {
+  VkStructureType    sType;
+  const void*        pNext;
+  VkSemaphoreTypeKHR semaphoreType;
+  uint64_t           initialValue;
+} VkSemaphoreTypeCreateInfoKHR;
+
+typedef struct VkTimelineSemaphoreSubmitInfoKHR {
+  VkStructureType sType;
+  const void*     pNext;
+  uint32_t        waitSemaphoreValueCount;
+  const uint64_t* pWaitSemaphoreValues;
+  uint32_t        signalSemaphoreValueCount;
+  const uint64_t* pSignalSemaphoreValues;
+} VkTimelineSemaphoreSubmitInfoKHR;
+
+typedef struct VkSemaphoreWaitInfoKHR {
+  VkStructureType         sType;
+  const void*             pNext;
+  VkSemaphoreWaitFlagsKHR flags;
+  uint32_t                semaphoreCount;
+  const VkSemaphore*      pSemaphores;
+  const uint64_t*         pValues;
+} VkSemaphoreWaitInfoKHR;
+
+typedef VkResult (VKAPI_PTR *PFN_vkGetSemaphoreCounterValueKHR)(VkDevice device, VkSemaphore semaphore, uint64_t* pValue);
+typedef VkResult (VKAPI_PTR *PFN_vkWaitSemaphoresKHR)(VkDevice device, const VkSemaphoreWaitInfoKHR* pWaitInfo, uint64_t timeout);
+#endif
@@ -0,0 +1,117 @@
+#include <Windows.h>
+#include <algorithm>
+#include <numeric>
+#include <string>
+
+#include "assert.h"
+#include "transientplanner.h"
+
+namespace
+{
+  VkDeviceSize align_up(VkDeviceSize offset, VkDeviceSize alignment)
+  {
+    return alignment > 1 ? (offset + alignment - 1) / alignment * alignment : offset;
+  }
+
+  bool lifetimes_overlap(const TransientPlacement& a, const TransientPlacement& b)
+  {
+    return (a.first_pass <= b.last_pass) && (b.first_pass <= a.last_pass);
+  }
+
+  bool bytes_overlap(const TransientPlacement& a, const TransientPlacement& b)
+  {
+    return (a.heap == b.heap) && (a.offset < b.offset + b.size) && (b.offset < a.offset + a.size);
+  }
+}
+
+std::vector<TransientHeap> plan_transient_memory(std::vector<TransientPlacement>& placements)
+{
+  std::vector<TransientHeap> heaps;
+
+  // biggest first, small images then fill the gaps between big ones instead of pushing them up
+  std::vector<uint32_t> order(placements.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return placements[a].size > placements[b].size; });
+
+  std::vector<uint32_t> placed;
+  for (uint32_t i : order)
+  {
+    TransientPlacement& placement = placements[i];
+
+    auto heap = std::find_if(heaps.begin(), heaps.end(), [&](const TransientHeap& h) { return h.memory_type == placement.memory_type; });
+    if (heap == heaps.end())
+    {
+      heaps.push_back({ placement.memory_type, 0 });
+      heap = heaps.end() - 1;
+    }
+    placement.heap = static_cast<uint32_t>(heap - heaps.begin());
+
+    // walk up past everything alive at the same time until the range is free, each step skips a block that's in the way
+    placement.offset = 0;
+    bool moved = true;
+    while (moved)
+    {
+      moved = false;
+      placement.offset = align_up(placement.offset, placement.alignment);
+      for (uint32_t other : placed)
+      {
+        const TransientPlacement& other_placement = placements[other];
+        if (lifetimes_overlap(placement, other_placement) && bytes_overlap(placement, other_placement))
+        {
+          placement.offset = other_placement.offset + other_placement.size;
+          moved = true;
+        }
+      }
+    }
+
+    heap->size = std::max(heap->size, placement.offset + placement.size);
+    placed.push_back(i);
+  }
+
+  for (TransientPlacement& placement : placements)
+  {
+    placement.follows.clear();
+    for (uint32_t other = 0; other < placements.size(); ++other)
+      if ((placements[other].last_pass < placement.first_pass) && bytes_overlap(placement, placements[other]))
+        placement.follows.push_back(other);
+  }
+
+  return heaps;
+}
+
+bool check_transient_planner()
+{
+  // an offscreen color target drawn in passes 0-1, a post target taking its bytes over in 2-3, a small blur
+  // target alive across the hand-over, a depth buffer of another memory type for the whole frame and a
+  // last pass target that fits where the blur target was once that is done
+  // the planner's fields start out empty, it fills them in
+  std::vector<TransientPlacement> placements = {
+    { 4096, 256, 0, 0, 1, 0, 0, {} },
+    { 4096, 256, 0, 2, 3, 0, 0, {} },
+    { 1024, 256, 0, 1, 2, 0, 0, {} },
+    { 2048, 256, 1, 0, 3, 0, 0, {} },
+    { 1000, 256, 0, 3, 3, 0, 0, {} }
+  };
+  std::vector<TransientHeap> heaps = plan_transient_memory(placements);
+
+  const uint32_t     expected_heaps[] = { 0, 0, 0, 1, 0 };
+  const VkDeviceSize expected_offsets[] = { 0, 0, 4096, 0, 4096 };
+  const std::vector<uint32_t> expected_follows[] = { {}, { 0 }, {}, {}, { 2 } };
+
+  bool passed = (heaps.size() == 2) && (heaps[0].memory_type == 0) && (heaps[0].size == 5120) && (heaps[1].memory_type == 1) && (heaps[1].size == 2048);
+  for (size_t i = 0; i < placements.size(); ++i)
+    passed = passed && (placements[i].heap == expected_heaps[i]) && (placements[i].offset == expected_offsets[i]) &&
+      (placements[i].follows == expected_follows[i]);
+
+  VkDeviceSize dedicated = 0, aliased = 0;
+  for (const TransientPlacement& placement : placements)
+    dedicated += placement.size;
+  for (const TransientHeap& heap : heaps)
+    aliased += heap.size;
+  OutputDebugString(("transient planner: " + std::to_string(aliased) + " of " + std::to_string(dedicated) + " bytes aliased, " +
+    (passed ? "placement as expected\n" : "placement differs\n")).c_str());
+
+  if (!passed)
+    assert("Transient planner placed the check frame differently than expected!", "Vulkan", Assert::Error);
+  return passed;
+}
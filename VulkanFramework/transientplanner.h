@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "resources\vulkan\vulkan.h"
+
+// memory for images that only live for a few passes of a frame
+// two images whose pass ranges don't overlap can sit on the same bytes, so every memory type gets one heap
+// and each image an offset in it, bigger images are placed first at the lowest offset nothing alive at the same time uses
+
+// debug builds check the planner against a hand-placed frame at startup, the sample frame declares no transient
+// images of its own so this is what keeps the planner exercised, set to 0 to skip it
+#ifdef NDEBUG
+#define TRANSIENT_PLANNER_SELF_CHECK 0
+#else
+#define TRANSIENT_PLANNER_SELF_CHECK 1
+#endif
+
+struct TransientPlacement
+{
+  // filled in by the caller, from the image's memory requirements and the graph's lifetimes
+  VkDeviceSize size;
+  VkDeviceSize alignment;
+  uint32_t     memory_type;
+  uint32_t     first_pass;
+  uint32_t     last_pass;
+
+  // filled in by the planner
+  uint32_t              heap;    // index into the returned heaps
+  VkDeviceSize          offset;
+  std::vector<uint32_t> follows; // earlier placements whose bytes this one takes over, it has to wait for them
+};
+
+struct TransientHeap
+{
+  uint32_t     memory_type;
+  VkDeviceSize size;
+};
+
+std::vector<TransientHeap> plan_transient_memory(std::vector<TransientPlacement>& placements);
+
+// plans a small multi-pass frame whose placement is known, asserts on any offset, follows list or heap size that
+// comes out different and logs the memory the frame takes aliased against one allocation per image
+bool check_transient_planner();
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "resources\vulkan\vulkan.h"
+
+// vertex structs declare their members with these types, the Vulkan format of every attribute is
+// derived from the member type at compile time, so compact formats only need a different member type
+//
+//   struct Vertex { VertexVector<Half, 4> position; VertexVector<Unorm16, 2> uv; };
+//   constexpr VertexAttribute vertex_attributes[] = { VERTEX_ATTRIBUTE(Vertex, position, 0), VERTEX_ATTRIBUTE(Vertex, uv, 1) };
+//   constexpr VertexLayout vertex_layout = make_vertex_layout<Vertex>(vertex_attributes);
+
+struct Half    { uint16_t bits; };   // IEEE 754 binary16
+struct Snorm16 { int16_t  value; };  // [-1, 1] as [-32767, 32767]
+struct Unorm16 { uint16_t value; };  // [0, 1] as [0, 65535]
+struct Snorm8  { int8_t   value; };
+struct Unorm8  { uint8_t  value; };
+
+template <typename T, uint32_t N>
+struct VertexVector
+{
+  T v[N];
+};
+
+enum class VertexNumericType
+{
+  Float, // float, half and normalized formats all read as floats in the shader
+  SInt,
+  UInt
+};
+
+// formats for 1 to 4 components, 3 component 8 and 16 bit formats are left out on purpose,
+// hardly any device can fetch them, pad those to 4
+template <typename T> struct VertexComponent;
+
+template <> struct VertexComponent<float>
+{
+  constexpr static VertexNumericType numeric_type = VertexNumericType::Float;
+  constexpr static VkFormat Format(uint32_t components)
+  {
+    return components == 1 ? VK_FORMAT_R32_SFLOAT : components == 2 ? VK_FORMAT_R32G32_SFLOAT :
+      components == 3 ? VK_FORMAT_R32G32B32_SFLOAT : components == 4 ? VK_FORMAT_R32G32B32A32_SFLOAT : VK_FORMAT_UNDEFINED;
+  }
+};
+
+template <> struct VertexComponent<int32_t>
+{
+  constexpr static VertexNumericType numeric_type = VertexNumericType::SInt;
+  constexpr static VkFormat Format(uint32_t components)
+  {
+    return components == 1 ? VK_FORMAT_R32_SINT : components == 2 ? VK_FORMAT_R32G32_SINT :
+      components == 3 ? VK_FORMAT_R32G32B32_SINT : components == 4 ? VK_FORMAT_R32G32B32A32_SINT : VK_FORMAT_UNDEFINED;
+  }
+};
+
+template <> struct VertexComponent<uint32_t>
+{
+  constexpr static VertexNumericType numeric_type = VertexNumericType::UInt;
+  constexpr static VkFormat Format(uint32_t components)
+  {
+    return components == 1 ? VK_FORMAT_R32_UINT : components == 2 ? VK_FORMAT_R32G32_UINT :
+      components == 3 ? VK_FORMAT_R32G32B32_UINT : components == 4 ? VK_FORMAT_R32G32B32A32_UINT : VK_FORMAT_UNDEFINED;
+  }
+};
+
+template <> struct VertexComponent<Half>
+{
+  constexpr static VertexNumericType numeric_type = VertexNumericType::Float;
+  constexpr static VkFormat Format(uint32_t components)
+  {
+    return components == 1 ? VK_FORMAT_R16_SFLOAT : components == 2 ? VK_FORMAT_R16G16_SFLOAT :
+      components == 4 ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_UNDEFINED;
+  }
+};
+
+template <> struct VertexComponent<Snorm16>
+{
+  constexpr static VertexNumericType numeric_type = VertexNumericType::Float;
+  constexpr static VkFormat Format(uint32_t components)
+  {
+    return components == 1 ? VK_FORMAT_R16_SNORM : components == 2 ? VK_FORMAT_R16G16_SNORM :
+      components == 4 ? VK_FORMAT_R16G16B16A16_SNORM : VK_FORMAT_UNDEFINED;
+  }
+};
+
+template <> struct VertexComponent<Unorm16>
+{
+  constexpr static VertexNumericType numeric_type = VertexNumericType::Float;
+  constexpr static VkFormat Format(uint32_t components)
+  {
+    return components == 1 ? VK_FORMAT_R16_UNORM : components == 2 ? VK_FORMAT_R16G16_UNORM :
+      components == 4 ? VK_FORMAT_R16G16B16A16_UNORM : VK_FORMAT_UNDEFINED;
+  }
+};
+
+template <> struct VertexComponent<Snorm8>
+{
+  constexpr static VertexNumericType numeric_type = VertexNumericType::Float;
+  constexpr static VkFormat Format(uint32_t components)
+  {
+    return components == 1 ? VK_FORMAT_R8_SNORM : components == 2 ? VK_FORMAT_R8G8_SNORM :
+      components == 4 ? VK_FORMAT_R8G8B8A8_SNORM : VK_FORMAT_UNDEFINED;
+  }
+};
+
+template <> struct VertexComponent<Unorm8>
+{
+  constexpr static VertexNumericType numeric_type = VertexNumericType::Float;
+  constexpr static VkFormat Format(uint32_t components)
+  {
+    return components == 1 ? VK_FORMAT_R8_UNORM : components == 2 ? VK_FORMAT_R8G8_UNORM :
+      components == 4 ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_UNDEFINED;
+  }
+};
+
+template <typename T> struct VertexMember
+{
+  constexpr static uint32_t          components = 1;
+  constexpr static VkFormat          format = VertexComponent<T>::Format(1);
+  constexpr static VertexNumericType numeric_type = VertexComponent<T>::numeric_type;
+};
+
+template <typename T, uint32_t N> struct VertexMember<VertexVector<T, N>>
+{
+  constexpr static uint32_t          components = N;
+  constexpr static VkFormat          format = VertexComponent<T>::Format(N);
+  constexpr static VertexNumericType numeric_type = VertexComponent<T>::numeric_type;
+  static_assert(format != VK_FORMAT_UNDEFINED, "This vertex member type has no vertex fetch format!");
+};
+
+struct VertexAttribute
+{
+  uint32_t          location;
+  VkFormat          format;
+  uint32_t          offset;
+  uint32_t          size;
+  uint32_t          components;
+  VertexNumericType numeric_type;
+};
+
+#define VERTEX_ATTRIBUTE(vertex, member, location)                     \
+  VertexAttribute{ location,                                           \
+    VertexMember<decltype(vertex::member)>::format,                    \
+    static_cast<uint32_t>(offsetof(vertex, member)),                   \
+    static_cast<uint32_t>(sizeof(vertex::member)),                     \
+    VertexMember<decltype(vertex::member)>::components,                \
+    VertexMember<decltype(vertex::member)>::numeric_type }
+
+// fixed size so pipeline states stay flat and hashable
+struct VertexLayout
+{
+  constexpr static uint32_t max_bindings = 2;
+  constexpr static uint32_t max_attributes = 8;
+
+  uint32_t                          binding_count = 0;
+  uint32_t                          attribute_count = 0;
+  VkVertexInputBindingDescription   bindings[max_bindings] = {};
+  VkVertexInputAttributeDescription attributes[max_attributes] = {};
+};
+
+// a broken layout makes the constant evaluation fail, which turns into a compile error where the
+// layout is declared constexpr, the string shows up in the compiler's notes
+constexpr bool vertex_layout_error(const char*)
+{
+  return true;
+}
+
+template <typename Vertex, size_t N>
+constexpr VertexLayout make_vertex_layout(const VertexAttribute(&attributes)[N], uint32_t binding = 0, VkVertexInputRate input_rate = VK_VERTEX_INPUT_RATE_VERTEX)
+{
+  static_assert(N <= VertexLayout::max_attributes, "Too many vertex attributes!");
+
+  VertexLayout layout{};
+  layout.binding_count = 1;
+  layout.bindings[0].binding = binding;
+  layout.bindings[0].stride = static_cast<uint32_t>(sizeof(Vertex));
+  layout.bindings[0].inputRate = input_rate;
+
+  layout.attribute_count = static_cast<uint32_t>(N);
+  for (size_t i = 0; i < N; ++i)
+  {
+    if (attributes[i].offset + attributes[i].size > sizeof(Vertex))
+      throw vertex_layout_error("vertex attribute lies outside of the vertex");
+    for (size_t j = 0; j < i; ++j)
+    {
+      if (attributes[i].location == attributes[j].location)
+        throw vertex_layout_error("two vertex attributes share a location");
+      if ((attributes[i].offset < attributes[j].offset + attributes[j].size) && (attributes[j].offset < attributes[i].offset + attributes[i].size))
+        throw vertex_layout_error("vertex attributes overlap");
+    }
+
+    layout.attributes[i].location = attributes[i].location;
+    layout.attributes[i].binding = binding;
+    layout.attributes[i].format = attributes[i].format;
+    layout.attributes[i].offset = attributes[i].offset;
+  }
+  return layout;
+}
+
+// reads the numeric type of a VkFormat back, for the formats the members above produce
+constexpr VertexNumericType vertex_format_numeric_type(VkFormat format)
+{
+  return ((format == VK_FORMAT_R32_SINT) || (format == VK_FORMAT_R32G32_SINT) || (format == VK_FORMAT_R32G32B32_SINT) || (format == VK_FORMAT_R32G32B32A32_SINT)) ? VertexNumericType::SInt :
+    ((format == VK_FORMAT_R32_UINT) || (format == VK_FORMAT_R32G32_UINT) || (format == VK_FORMAT_R32G32B32_UINT) || (format == VK_FORMAT_R32G32B32A32_UINT)) ? VertexNumericType::UInt :
+    VertexNumericType::Float;
+}
+
+// finds the instruction with the given opcode whose result id (at word result_word) is id, 0 if there is none
+constexpr size_t spirv_find_instruction(const uint32_t* code, size_t word_count, uint32_t opcode, uint32_t id, uint32_t result_word)
+{
+  for (size_t i = 5; (i < word_count) && ((code[i] >> 16) != 0); i += code[i] >> 16)
+    if (((code[i] & 0xffff) == opcode) && ((code[i] >> 16) > result_word) && (code[i + result_word] == id))
+      return i;
+  return 0;
+}
+
+// true when every attribute feeds an input variable of the same numeric type at its location,
+// and every input variable with a location is fed, code is the vertex shader's SPIR-V
+constexpr bool vertex_layout_matches_spirv(const VertexLayout& layout, const uint32_t* code, size_t word_count)
+{
+  const uint32_t op_type_int = 21, op_type_float = 22, op_type_vector = 23, op_type_pointer = 32, op_variable = 59, op_decorate = 71;
+  const uint32_t decoration_location = 30, storage_class_input = 1;
+
+  if ((code == nullptr) || (word_count < 5) || (code[0] != 0x07230203))
+    return false;
+
+  uint32_t matched_attributes = 0;
+  for (size_t i = 5; (i < word_count) && ((code[i] >> 16) != 0); i += code[i] >> 16)
+  {
+    if (((code[i] & 0xffff) != op_decorate) || ((code[i] >> 16) < 4) || (code[i + 2] != decoration_location))
+      continue;
+
+    // only shader inputs, outputs have locations too
+    size_t variable = spirv_find_instruction(code, word_count, op_variable, code[i + 1], 2);
+    if ((variable == 0) || (code[variable + 3] != storage_class_input))
+      continue;
+
+    uint32_t location = code[i + 3];
+    uint32_t attribute = layout.attribute_count;
+    for (uint32_t a = 0; a < layout.attribute_count; ++a)
+      if (layout.attributes[a].location == location)
+        attribute = a;
+    if (attribute == layout.attribute_count)
+      return false;
+    ++matched_attributes;
+
+    size_t pointer = spirv_find_instruction(code, word_count, op_type_pointer, code[variable + 1], 1);
+    if (pointer == 0)
+      return false;
+    size_t type = spirv_find_instruction(code, word_count, op_type_vector, code[pointer + 3], 1);
+    uint32_t scalar_type_id = (type != 0) ? code[type + 2] : code[pointer + 3];
+
+    VertexNumericType shader_type = VertexNumericType::Float;
+    if (spirv_find_instruction(code, word_count, op_type_float, scalar_type_id, 1) != 0)
+      shader_type = VertexNumericType::Float;
+    else
+    {
+      size_t int_type = spirv_find_instruction(code, word_count, op_type_int, scalar_type_id, 1);
+      if (int_type == 0)
+        return false; // matrices and anything else are not supported as vertex input here
+      shader_type = code[int_type + 3] ? VertexNumericType::SInt : VertexNumericType::UInt;
+    }
+
+    if (vertex_format_numeric_type(layout.attributes[attribute].format) != shader_type)
+      return false;
+  }
+
+  return matched_attributes == layout.attribute_count;
+}
@@ -0,0 +1,413 @@
+#include <Windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include "vertexpacking.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define VERTEX_PACKING_X86 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+  struct VertexPackingKernels
+  {
+    const char* name;
+    void (*float_to_snorm16)(const float* input, Snorm16* output, size_t count);
+    void (*float_to_unorm16)(const float* input, Unorm16* output, size_t count);
+    void (*encode_octahedral)(const float* normals, VertexVector<Snorm16, 2>* output, size_t count);
+    void (*pack_vertices)(const float* positions, const float* normals, const float* uvs, size_t count, const float offset[3], const float inverse_scale[3], PackedVertex* output);
+  };
+
+  //
+  // scalar
+  //
+
+  // written like the SSE2 min, max and convert so both give the same bits, nan ends up at the low end
+  inline float clamp_float(float value, float low, float high)
+  {
+    value = value > low ? value : low;
+    return value < high ? value : high;
+  }
+
+  inline int16_t snorm16_one(float value)
+  {
+    return static_cast<int16_t>(std::nearbyint(clamp_float(value, -1.0f, 1.0f) * 32767.0f));
+  }
+
+  inline uint16_t unorm16_one(float value)
+  {
+    return static_cast<uint16_t>(std::nearbyint(clamp_float(value, 0.0f, 1.0f) * 65535.0f));
+  }
+
+  // projects onto the octahedron |x| + |y| + |z| = 1 and folds the lower half over the diagonals
+  inline void octahedral_one(const float* normal, int16_t& x, int16_t& y)
+  {
+    float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+    float inverse_length = 1.0f / (length > 1e-20f ? length : 1e-20f);
+    float ox = normal[0] * inverse_length;
+    float oy = normal[1] * inverse_length;
+    if (normal[2] < 0.0f)
+    {
+      float folded_x = (1.0f - std::fabs(oy)) * std::copysign(1.0f, ox);
+      float folded_y = (1.0f - std::fabs(ox)) * std::copysign(1.0f, oy);
+      ox = folded_x;
+      oy = folded_y;
+    }
+
+    x = snorm16_one(ox);
+    y = snorm16_one(oy);
+  }
+
+  void float_to_snorm16_scalar(const float* input, Snorm16* output, size_t count)
+  {
+    for (size_t i = 0; i < count; ++i)
+      output[i].value = snorm16_one(input[i]);
+  }
+
+  void float_to_unorm16_scalar(const float* input, Unorm16* output, size_t count)
+  {
+    for (size_t i = 0; i < count; ++i)
+      output[i].value = unorm16_one(input[i]);
+  }
+
+  void encode_octahedral_scalar(const float* normals, VertexVector<Snorm16, 2>* output, size_t count)
+  {
+    for (size_t i = 0; i < count; ++i)
+      octahedral_one(normals + i * 3, output[i].v[0].value, output[i].v[1].value);
+  }
+
+  void pack_vertices_scalar(const float* positions, const float* normals, const float* uvs, size_t count, const float offset[3], const float inverse_scale[3], PackedVertex* output)
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      PackedVertex& vertex = output[i];
+      for (int c = 0; c < 3; ++c)
+        vertex.position.v[c].value = snorm16_one((positions[i * 3 + c] - offset[c]) * inverse_scale[c]);
+      vertex.position.v[3].value = 32767;
+
+      vertex.normal.v[0].value = 0;
+      vertex.normal.v[1].value = 0;
+      if (normals != nullptr)
+        octahedral_one(normals + i * 3, vertex.normal.v[0].value, vertex.normal.v[1].value);
+
+      vertex.uv.v[0].value = uvs != nullptr ? unorm16_one(uvs[i * 2 + 0]) : 0;
+      vertex.uv.v[1].value = uvs != nullptr ? unorm16_one(uvs[i * 2 + 1]) : 0;
+    }
+  }
+
+  const VertexPackingKernels scalar_kernels = {
+    "Scalar",
+    float_to_snorm16_scalar,
+    float_to_unorm16_scalar,
+    encode_octahedral_scalar,
+    pack_vertices_scalar
+  };
+
+#ifdef VERTEX_PACKING_X86
+  //
+  // SSE2
+  //
+
+  inline __m128i snorm16_4_sse2(__m128 value)
+  {
+    value = _mm_min_ps(_mm_max_ps(value, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+    return _mm_cvtps_epi32(_mm_mul_ps(value, _mm_set1_ps(32767.0f)));
+  }
+
+  // results go to 32 bit lanes biased by -32768, so the signed saturating pack keeps them
+  inline __m128i unorm16_4_biased_sse2(__m128 value)
+  {
+    value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    return _mm_sub_epi32(_mm_cvtps_epi32(_mm_mul_ps(value, _mm_set1_ps(65535.0f))), _mm_set1_epi32(32768));
+  }
+
+  inline __m128i unbias_unorm16_sse2(__m128i packed)
+  {
+    return _mm_xor_si128(packed, _mm_set1_epi16(static_cast<short>(0x8000)));
+  }
+
+  // x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3 -> x0-3 | y0-3 | z0-3
+  inline void deinterleave_xyz_sse2(const float* xyz, __m128& x, __m128& y, __m128& z)
+  {
+    __m128 a = _mm_loadu_ps(xyz);
+    __m128 b = _mm_loadu_ps(xyz + 4);
+    __m128 c = _mm_loadu_ps(xyz + 8);
+    x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+  }
+
+  // octahedral_one on four lanes, x and y come back as 32 bit snorm16 values
+  inline void octahedral_4_sse2(__m128 x, __m128 y, __m128 z, __m128i& encoded_x, __m128i& encoded_y)
+  {
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    __m128 length = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(sign_mask, x), _mm_andnot_ps(sign_mask, y)), _mm_andnot_ps(sign_mask, z));
+    __m128 inverse_length = _mm_div_ps(one, _mm_max_ps(length, _mm_set1_ps(1e-20f)));
+    __m128 ox = _mm_mul_ps(x, inverse_length);
+    __m128 oy = _mm_mul_ps(y, inverse_length);
+
+    __m128 folded_x = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, oy)), _mm_or_ps(one, _mm_and_ps(sign_mask, ox)));
+    __m128 folded_y = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, ox)), _mm_or_ps(one, _mm_and_ps(sign_mask, oy)));
+    __m128 lower = _mm_cmplt_ps(z, _mm_setzero_ps());
+    ox = _mm_or_ps(_mm_and_ps(lower, folded_x), _mm_andnot_ps(lower, ox));
+    oy = _mm_or_ps(_mm_and_ps(lower, folded_y), _mm_andnot_ps(lower, oy));
+
+    encoded_x = snorm16_4_sse2(ox);
+    encoded_y = snorm16_4_sse2(oy);
+  }
+
+  void float_to_snorm16_sse2(const float* input, Snorm16* output, size_t count)
+  {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+      __m128i low = snorm16_4_sse2(_mm_loadu_ps(input + i));
+      __m128i high = snorm16_4_sse2(_mm_loadu_ps(input + i + 4));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_packs_epi32(low, high));
+    }
+
+    float_to_snorm16_scalar(input + i, output + i, count - i);
+  }
+
+  void float_to_unorm16_sse2(const float* input, Unorm16* output, size_t count)
+  {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+      __m128i low = unorm16_4_biased_sse2(_mm_loadu_ps(input + i));
+      __m128i high = unorm16_4_biased_sse2(_mm_loadu_ps(input + i + 4));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), unbias_unorm16_sse2(_mm_packs_epi32(low, high)));
+    }
+
+    float_to_unorm16_scalar(input + i, output + i, count - i);
+  }
+
+  void encode_octahedral_sse2(const float* normals, VertexVector<Snorm16, 2>* output, size_t count)
+  {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 x, y, z;
+      deinterleave_xyz_sse2(normals + i * 3, x, y, z);
+
+      __m128i encoded_x, encoded_y;
+      octahedral_4_sse2(x, y, z, encoded_x, encoded_y);
+
+      // x0-3 y0-3 -> x0 y0 x1 y1 ...
+      __m128i packed = _mm_packs_epi32(encoded_x, encoded_y);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_unpacklo_epi16(packed, _mm_srli_si128(packed, 8)));
+    }
+
+    encode_octahedral_scalar(normals + i * 3, output + i, count - i);
+  }
+
+  // four vertices per step, every component is converted in its own register and the
+  // 16 bit results are transposed back into 16 byte vertices at the end
+  void pack_vertices_sse2(const float* positions, const float* normals, const float* uvs, size_t count, const float offset[3], const float inverse_scale[3], PackedVertex* output)
+  {
+    const __m128 offset_x = _mm_set1_ps(offset[0]), offset_y = _mm_set1_ps(offset[1]), offset_z = _mm_set1_ps(offset[2]);
+    const __m128 scale_x = _mm_set1_ps(inverse_scale[0]), scale_y = _mm_set1_ps(inverse_scale[1]), scale_z = _mm_set1_ps(inverse_scale[2]);
+    const __m128i one = _mm_set1_epi32(32767);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 x, y, z;
+      deinterleave_xyz_sse2(positions + i * 3, x, y, z);
+      __m128i position_x = snorm16_4_sse2(_mm_mul_ps(_mm_sub_ps(x, offset_x), scale_x));
+      __m128i position_y = snorm16_4_sse2(_mm_mul_ps(_mm_sub_ps(y, offset_y), scale_y));
+      __m128i position_z = snorm16_4_sse2(_mm_mul_ps(_mm_sub_ps(z, offset_z), scale_z));
+
+      __m128i normal_x = _mm_setzero_si128(), normal_y = _mm_setzero_si128();
+      if (normals != nullptr)
+      {
+        deinterleave_xyz_sse2(normals + i * 3, x, y, z);
+        octahedral_4_sse2(x, y, z, normal_x, normal_y);
+      }
+
+      __m128i uv = _mm_setzero_si128();
+      if (uvs != nullptr)
+      {
+        __m128 low = _mm_loadu_ps(uvs + i * 2);
+        __m128 high = _mm_loadu_ps(uvs + i * 2 + 4);
+        __m128i u = unorm16_4_biased_sse2(_mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i v = unorm16_4_biased_sse2(_mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+        uv = unbias_unorm16_sse2(_mm_packs_epi32(u, v));
+      }
+
+      // 16 bit lanes: component 0-3 | component 0-3, interleave each pair to one dword per vertex
+      __m128i xy = _mm_packs_epi32(position_x, position_y);
+      __m128i zw = _mm_packs_epi32(position_z, one);
+      __m128i normal = _mm_packs_epi32(normal_x, normal_y);
+      xy = _mm_unpacklo_epi16(xy, _mm_srli_si128(xy, 8));
+      zw = _mm_unpacklo_epi16(zw, _mm_srli_si128(zw, 8));
+      normal = _mm_unpacklo_epi16(normal, _mm_srli_si128(normal, 8));
+      uv = _mm_unpacklo_epi16(uv, _mm_srli_si128(uv, 8));
+
+      __m128i position_low = _mm_unpacklo_epi32(xy, zw);
+      __m128i position_high = _mm_unpackhi_epi32(xy, zw);
+      __m128i attribute_low = _mm_unpacklo_epi32(normal, uv);
+      __m128i attribute_high = _mm_unpackhi_epi32(normal, uv);
+
+      __m128i* vertices = reinterpret_cast<__m128i*>(output + i);
+      _mm_storeu_si128(vertices + 0, _mm_unpacklo_epi64(position_low, attribute_low));
+      _mm_storeu_si128(vertices + 1, _mm_unpackhi_epi64(position_low, attribute_low));
+      _mm_storeu_si128(vertices + 2, _mm_unpacklo_epi64(position_high, attribute_high));
+      _mm_storeu_si128(vertices + 3, _mm_unpackhi_epi64(position_high, attribute_high));
+    }
+
+    pack_vertices_scalar(positions + i * 3, normals != nullptr ? normals + i * 3 : nullptr, uvs != nullptr ? uvs + i * 2 : nullptr, count - i, offset, inverse_scale, output + i);
+  }
+
+  const VertexPackingKernels sse2_kernels = {
+    "SSE2",
+    float_to_snorm16_sse2,
+    float_to_unorm16_sse2,
+    encode_octahedral_sse2,
+    pack_vertices_sse2
+  };
+#endif
+
+  // every set this CPU can run, widest last
+  std::vector<const VertexPackingKernels*> supported_kernels()
+  {
+    std::vector<const VertexPackingKernels*> result = { &scalar_kernels };
+#ifdef VERTEX_PACKING_X86
+    result.push_back(&sse2_kernels);
+#endif
+    return result;
+  }
+
+  const VertexPackingKernels& kernels()
+  {
+    static const VertexPackingKernels& selected = *supported_kernels().back();
+    return selected;
+  }
+
+  VertexQuantization position_quantization(const float* positions, size_t count, float inverse_scale[3])
+  {
+    float low[3] = { 0.0f, 0.0f, 0.0f };
+    float high[3] = { 0.0f, 0.0f, 0.0f };
+    for (size_t i = 0; i < count; ++i)
+      for (int c = 0; c < 3; ++c)
+      {
+        float value = positions[i * 3 + c];
+        low[c] = ((i == 0) || (value < low[c])) ? value : low[c];
+        high[c] = ((i == 0) || (value > high[c])) ? value : high[c];
+      }
+
+    // a flat axis keeps scale 0 and packs to 0
+    VertexQuantization quantization;
+    for (int c = 0; c < 3; ++c)
+    {
+      quantization.offset[c] = (low[c] + high[c]) * 0.5f;
+      quantization.scale[c] = (high[c] - low[c]) * 0.5f;
+      inverse_scale[c] = quantization.scale[c] > 0.0f ? 1.0f / quantization.scale[c] : 0.0f;
+    }
+    return quantization;
+  }
+}
+
+void float_to_snorm16(const float* input, Snorm16* output, size_t count)
+{
+  kernels().float_to_snorm16(input, output, count);
+}
+
+void float_to_unorm16(const float* input, Unorm16* output, size_t count)
+{
+  kernels().float_to_unorm16(input, output, count);
+}
+
+void encode_octahedral(const float* normals, VertexVector<Snorm16, 2>* output, size_t count)
+{
+  kernels().encode_octahedral(normals, output, count);
+}
+
+VertexQuantization pack_vertices(const float* positions, const float* normals, const float* uvs, size_t count, PackedVertex* output)
+{
+  float inverse_scale[3];
+  VertexQuantization quantization = position_quantization(positions, count, inverse_scale);
+  kernels().pack_vertices(positions, normals, uvs, count, quantization.offset, inverse_scale, output);
+  return quantization;
+}
+
+void benchmark_vertex_packing(size_t vertex_count)
+{
+  // points on a unit sphere with their own normals and a lat-long unwrap, big enough to leave the caches
+  std::vector<float> positions(vertex_count * 3);
+  std::vector<float> normals(vertex_count * 3);
+  std::vector<float> uvs(vertex_count * 2);
+  for (size_t i = 0; i < vertex_count; ++i)
+  {
+    float u = static_cast<float>(i % 1024) / 1024.0f;
+    float v = static_cast<float>(i / 1024 % 1024) / 1024.0f;
+    float theta = u * 6.2831853f, phi = v * 3.1415926f;
+    normals[i * 3 + 0] = std::sin(phi) * std::cos(theta);
+    normals[i * 3 + 1] = std::sin(phi) * std::sin(theta);
+    normals[i * 3 + 2] = std::cos(phi);
+    for (int c = 0; c < 3; ++c)
+      positions[i * 3 + c] = normals[i * 3 + c] * 10.0f;
+    uvs[i * 2 + 0] = u;
+    uvs[i * 2 + 1] = v;
+  }
+  std::vector<PackedVertex> packed(vertex_count);
+
+  float inverse_scale[3];
+  VertexQuantization quantization = position_quantization(positions.data(), vertex_count, inverse_scale);
+
+  // bytes per second counts the float input, best of a few runs
+  const size_t float_bytes = vertex_count * 8 * sizeof(float);
+  for (const VertexPackingKernels* set : supported_kernels())
+  {
+    double best_seconds = 1e30;
+    for (int repeat = 0; repeat < 5; ++repeat)
+    {
+      auto begin = std::chrono::high_resolution_clock::now();
+      set->pack_vertices(positions.data(), normals.data(), uvs.data(), vertex_count, quantization.offset, inverse_scale, packed.data());
+      std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - begin;
+      best_seconds = std::min(best_seconds, seconds.count());
+    }
+
+    char line[128];
+    snprintf(line, sizeof(line), "%-18s %-7s %8.2f GB/s\n", "pack_vertices", set->name, float_bytes / best_seconds / 1e9);
+    OutputDebugString(line);
+  }
+
+  // decode the way the shader does and compare
+  float position_error = 0.0f, normal_error = 0.0f;
+  for (size_t i = 0; i < vertex_count; ++i)
+  {
+    const PackedVertex& vertex = packed[i];
+    for (int c = 0; c < 3; ++c)
+    {
+      float position = vertex.position.v[c].value / 32767.0f * quantization.scale[c] + quantization.offset[c];
+      position_error = std::max(position_error, std::fabs(position - positions[i * 3 + c]));
+    }
+
+    float n[3] = { vertex.normal.v[0].value / 32767.0f, vertex.normal.v[1].value / 32767.0f, 0.0f };
+    n[2] = 1.0f - std::fabs(n[0]) - std::fabs(n[1]);
+    if (n[2] < 0.0f)
+    {
+      float x = (1.0f - std::fabs(n[1])) * (n[0] >= 0.0f ? 1.0f : -1.0f);
+      float y = (1.0f - std::fabs(n[0])) * (n[1] >= 0.0f ? 1.0f : -1.0f);
+      n[0] = x;
+      n[1] = y;
+    }
+    float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    float cosine = (n[0] * normals[i * 3 + 0] + n[1] * normals[i * 3 + 1] + n[2] * normals[i * 3 + 2]) / length;
+    normal_error = std::max(normal_error, std::acos(std::min(cosine, 1.0f)) * 57.29578f);
+  }
+
+  char line[160];
+  snprintf(line, sizeof(line), "%zu vertices: %zu bytes as floats, %zu packed, position error %g (of 10), normal error %g degrees\n",
+    vertex_count, float_bytes, vertex_count * sizeof(PackedVertex), position_error, normal_error);
+  OutputDebugString(line);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "resources\vulkan\vulkan.h"
+#include "vertexlayout.h"
+
+// quantizes float vertex streams at load time, scalar and SSE2 kernels, SSE2 whenever the CPU is x86
+// (every x64 CPU has it), both produce the same bits
+
+// set to 1 to log the throughput and size of the packers at startup
+#define VERTEX_PACKING_BENCHMARK 0
+
+// 16 bytes per vertex, the float position + normal + uv it comes from takes 32
+struct PackedVertex
+{
+  VertexVector<Snorm16, 4> position; // relative to the mesh bounds, w is always 1
+  VertexVector<Snorm16, 2> normal;   // octahedral, see decode_octahedral below
+  VertexVector<Unorm16, 2> uv;       // clamped to [0, 1], atlas and unwrapped uvs fit
+};
+
+// position = packed position * scale + offset, fold it into the model matrix
+struct VertexQuantization
+{
+  float offset[3];
+  float scale[3];
+};
+
+// vec3 decode_octahedral(vec2 e)
+// {
+//   vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+//   if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+//   return normalize(n);
+// }
+
+void float_to_snorm16(const float* input, Snorm16* output, size_t count); // clamped to [-1, 1], round to nearest even
+void float_to_unorm16(const float* input, Unorm16* output, size_t count); // clamped to [0, 1], round to nearest even
+void encode_octahedral(const float* normals, VertexVector<Snorm16, 2>* output, size_t count); // xyz triples, need not be unit length
+
+// positions and normals are xyz triples, uvs pairs, normals and uvs may be null and come out zero
+VertexQuantization pack_vertices(const float* positions, const float* normals, const float* uvs, size_t count, PackedVertex* output);
+
+// packs a generated mesh of vertex_count vertices with every set this CPU supports and logs
+// bytes per second, the size against the float layout and the largest position and normal error
+void benchmark_vertex_packing(size_t vertex_count);
@@ -78,6 +78,11 @@ bool VKBase::CreateInstance()
       return false;
     }
 
+  //optional, device extensions written against 1.1 features need it on a 1.0 instance
+  m_get_physical_device_properties2 = CheckExtensionAvailability(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, available_extensions);
+  if (m_get_physical_device_properties2)
+    extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+
   VkApplicationInfo application_info = { //peek VkApplicationInfo for more details
     VK_STRUCTURE_TYPE_APPLICATION_INFO,
     nullptr,
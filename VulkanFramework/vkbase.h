@@ -26,6 +26,7 @@ protected:
   VkPhysicalDevice m_physical_device;
   VkDevice m_device;
   VkSurfaceKHR m_presentation_surface;
+  bool m_get_physical_device_properties2 = false; //instance has VK_KHR_get_physical_device_properties2
 
   virtual bool CheckExtensionAvailability(const char* extension_name, const std::vector<VkExtensionProperties>& available_extensions) final;
 
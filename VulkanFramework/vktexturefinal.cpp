@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <array>
 
 #define VK_USE_PLATFORM_WIN32_KHR
@@ -5,6 +6,11 @@
 #include "system.h"
 #include "assert.h"
 #include "fileio.h"
+#include "hash.h"
+#include "mipmap.h"
+#include "shaderregistry.h"
+#include "threadpool.h"
+#include "transientplanner.h"
 
 #include "vktexturefinal.h"
 
@@ -18,15 +24,21 @@ bool VKTextureFinal::Initialize()
   CHECK(CreateVertexBuffer)
   CHECK(CreateStagingBuffer)
   CHECK(CreateCommandBuffers)
-  CHECK(CreateSemaphores)
-  CHECK(CreateFences)
+  CHECK(CreateSyncPools)
+  CHECK(CreateTimelines)
   CHECK(CreateTexture)
+  CHECK(CreateTextureStreaming)
   CHECK(CreateUniformBuffer)
   CHECK(CreateDescriptorSetLayout)
+  CHECK(CreatePipelineLayout)
+  CHECK(CreatePipelineCache)
   CHECK(CreateDescriptorPool)
   CHECK(AllocateDescriptorSet)
   CHECK(UpdateDescriptorSet)
   CHECK(CopyVertexData)
+  CHECK(CreateSpriteBuffers)
+  CHECK(CreateVirtualFrames)
+  CHECK(LoadPipelineManifest)
   CHECK(OnWindowSizeChanged)
 
 #undef CHECK
@@ -96,15 +108,39 @@ bool VKTextureFinal::CreateDevice()
     VK_KHR_SWAPCHAIN_EXTENSION_NAME
   };
 
+  // block compressed textures are optional, textures stay RGBA when the device can't sample them
+  VkPhysicalDeviceFeatures device_features;
+  vkGetPhysicalDeviceFeatures(m_physical_device, &device_features);
+
+  VkPhysicalDeviceFeatures enabled_features = {};
+  enabled_features.textureCompressionBC = device_features.textureCompressionBC;
+
+  // timeline semaphores are optional too, without them every submission signals a fence of its own
+  uint32_t extensions_count = 0;
+  vkEnumerateDeviceExtensionProperties(m_physical_device, nullptr, &extensions_count, nullptr);
+  std::vector<VkExtensionProperties> available_extensions(extensions_count);
+  if (vkEnumerateDeviceExtensionProperties(m_physical_device, nullptr, &extensions_count, available_extensions.data()) != VK_SUCCESS)
+    available_extensions.clear();
+
+  bool timeline_semaphores = m_get_physical_device_properties2 && CheckExtensionAvailability(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, available_extensions);
+  if (timeline_semaphores)
+    extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_semaphore_features = {
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR, // VkStructureType
+    nullptr,                                                          // pNext
+    VK_TRUE                                                           // timelineSemaphore
+  };
+
   VkDeviceCreateInfo device_create_info = { //peek VkDeviceCreateInfo for more details
     VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-    nullptr, 0,
+    timeline_semaphores ? &timeline_semaphore_features : nullptr, 0,
     static_cast<uint32_t>(queue_create_infos.size()), //num of queue families
     queue_create_infos.data(),
     0, nullptr,
     static_cast<uint32_t>(extensions.size()),
     extensions.data(),
-    nullptr // pointer to device features
+    &enabled_features // pointer to device features
   };
 
   if (vkCreateDevice(m_physical_device, &device_create_info, nullptr, &m_device) != VK_SUCCESS)
@@ -113,6 +149,8 @@ bool VKTextureFinal::CreateDevice()
     return false;
   }
 
+  m_texture_compression_bc = enabled_features.textureCompressionBC == VK_TRUE;
+  m_timeline_semaphores = timeline_semaphores;
   m_graphics_queue_family_index = selected_graphics_queue_family_index;
   m_present_queue_family_index = selected_present_queue_family_index;
   return true;
@@ -316,14 +354,81 @@ bool VKTextureFinal::CreateCommandBuffers()
   if (!CreateCommandPool(m_graphics_queue_family_index, &m_graphics_command_pool))
     return false;
 
-  for (VirtualFrame& virtual_frame : m_virtual_frames)
-    if (!AllocateCommandBuffers(m_graphics_command_pool, 1, &virtual_frame.command_buffer))
+  if (!AllocateCommandBuffers(m_graphics_command_pool, 1, &m_upload_command_buffer))
+    return false;
+
+  if (!CreateCommandPool(m_graphics_queue_family_index, &m_static_command_pool, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT))
+    return false;
+
+  // a chunk for every thread that can record, the main thread included
+  m_recording_chunk_count = std::min(threadPool.ThreadCount() + 1, m_max_recording_chunks);
+
+  return true;
+}
+
+bool VKTextureFinal::CreateFrameCommandPool(FrameCommandPool& frame_pool, VkCommandBufferLevel level)
+{
+  // no per buffer reset, the whole pool is reset at once so the driver can hand memory out linearly
+  if (!CreateCommandPool(m_graphics_queue_family_index, &frame_pool.pool, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT))
+    return false;
+
+  frame_pool.level = level;
+  frame_pool.command_buffers.clear();
+  frame_pool.used = 0;
+  return true;
+}
+
+bool VKTextureFinal::AcquireFrameCommandBuffer(FrameCommandPool& frame_pool, VkCommandBuffer& command_buffer)
+{
+  if (frame_pool.used == frame_pool.command_buffers.size())
+  {
+    VkCommandBuffer allocated;
+    if (!AllocateCommandBuffers(frame_pool.pool, 1, &allocated, frame_pool.level))
       return false;
+    frame_pool.command_buffers.push_back(allocated);
+  }
+
+  command_buffer = frame_pool.command_buffers[frame_pool.used++];
+  return true;
+}
+
+bool VKTextureFinal::ResetFrameCommandPools(VirtualFrame& virtual_frame)
+{
+  // keeps the memory in the pool, the next frame records about as much as this one did
+  auto reset = [this](FrameCommandPool& frame_pool)
+  {
+    if (frame_pool.pool == VK_NULL_HANDLE)
+      return true;
+
+    frame_pool.used = 0;
+    return vkResetCommandPool(m_device, frame_pool.pool, 0) == VK_SUCCESS;
+  };
 
+  bool reset_all = reset(virtual_frame.command_pool);
+  for (FrameCommandPool& frame_pool : virtual_frame.recording_command_pools)
+    reset_all = reset(frame_pool) && reset_all;
+
+  if (!reset_all)
+  {
+    assert("Could not reset frame command pools!", "Vulkan", Assert::Error);
+    return false;
+  }
   return true;
 }
 
-bool VKTextureFinal::CreateCommandPool(uint32_t queue_family_index, VkCommandPool* pool)
+void VKTextureFinal::DestroyFrameCommandPool(FrameCommandPool& frame_pool)
+{
+  if (frame_pool.pool == VK_NULL_HANDLE)
+    return;
+
+  // freed along with the pool
+  vkDestroyCommandPool(m_device, frame_pool.pool, nullptr);
+  frame_pool.pool = VK_NULL_HANDLE;
+  frame_pool.command_buffers.clear();
+  frame_pool.used = 0;
+}
+
+bool VKTextureFinal::CreateCommandPool(uint32_t queue_family_index, VkCommandPool* pool, VkCommandPoolCreateFlags flags)
 {
   // VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT = enable individual command buffer rerecord. If without, command buffers can only be rerecorded by resetting whole command pool
   // VK_COMMAND_POOL_CREATE_TRANSIENT_BIT = the command buffer will only last for a short period. 
@@ -331,7 +436,7 @@ bool VKTextureFinal::CreateCommandPool(uint32_t queue_family_index, VkCommandPoo
   VkCommandPoolCreateInfo cmd_pool_create_info = {
     VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,                                             // VkStructureType
     nullptr,                                                                                // pNext
-    VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, // VkCommandPoolCreateFlags
+    flags,                                                                                  // VkCommandPoolCreateFlags
     queue_family_index                                                                      // queueFamilyIndex
   };
 
@@ -343,13 +448,13 @@ bool VKTextureFinal::CreateCommandPool(uint32_t queue_family_index, VkCommandPoo
   return true;
 }
 
-bool VKTextureFinal::AllocateCommandBuffers(VkCommandPool pool, uint32_t count, VkCommandBuffer* command_buffers)
+bool VKTextureFinal::AllocateCommandBuffers(VkCommandPool pool, uint32_t count, VkCommandBuffer* command_buffers, VkCommandBufferLevel level)
 {
   VkCommandBufferAllocateInfo command_buffer_allocate_info = {
     VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, // VkStructureType
     nullptr,                                        // pNext
     pool,                                           // VkCommandPool
-    VK_COMMAND_BUFFER_LEVEL_PRIMARY,                // VkCommandBufferLevel
+    level,                                          // VkCommandBufferLevel
     count                                           // bufferCount
   };
 
@@ -361,52 +466,443 @@ bool VKTextureFinal::AllocateCommandBuffers(VkCommandPool pool, uint32_t count,
   return true;
 }
 
-bool VKTextureFinal::CreateSemaphores()
+bool VKTextureFinal::CreateSyncPools()
 {
-  VkSemaphoreCreateInfo semaphore_create_info = {
-    VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, // VkStructureType
-    nullptr,                                 // pNext
-    0                                        // VkSemaphoreCreateFlags
-  };
+  m_fence_pool.Initialize(
+    [this](VkFence& fence)
+    {
+      VkFenceCreateInfo fence_create_info = {
+        VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, // VkStructureType
+        nullptr,                             // pNext
+        0                                    // VkFenceCreateFlags
+      };
+      return vkCreateFence(m_device, &fence_create_info, nullptr, &fence) == VK_SUCCESS;
+    },
+    [this](VkFence fence) { vkResetFences(m_device, 1, &fence); },
+    [this](VkFence fence) { vkDestroyFence(m_device, fence, nullptr); });
 
-  for (VirtualFrame& virtual_frame : m_virtual_frames)
-    if ((vkCreateSemaphore(m_device, &semaphore_create_info, nullptr, &virtual_frame.image_available_semaphore) != VK_SUCCESS) ||
-      (vkCreateSemaphore(m_device, &semaphore_create_info, nullptr, &virtual_frame.finished_rendering_semaphore) != VK_SUCCESS))
+  // binary semaphores are unsignaled again once their wait has executed, there's nothing to reset
+  m_semaphore_pool.Initialize(
+    [this](VkSemaphore& semaphore)
     {
-      assert("Could not create semaphores!", "Vulkan", Assert::Error);
+      VkSemaphoreCreateInfo semaphore_create_info = {
+        VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, // VkStructureType
+        nullptr,                                 // pNext
+        0                                        // VkSemaphoreCreateFlags
+      };
+      return vkCreateSemaphore(m_device, &semaphore_create_info, nullptr, &semaphore) == VK_SUCCESS;
+    },
+    nullptr,
+    [this](VkSemaphore semaphore) { vkDestroySemaphore(m_device, semaphore, nullptr); });
+
+  if (!m_semaphore_pool.Reserve(2 * m_max_virtual_frames))
+  {
+    assert("Could not create sync objects!", "Vulkan", Assert::Error);
+    return false;
+  }
+
+  return true;
+}
+
+void VKTextureFinal::DestroySyncPools()
+{
+  uint32_t fence_peak = m_fence_pool.PeakAcquired();
+  uint32_t semaphore_peak = m_semaphore_pool.PeakAcquired();
+  uint32_t leaked_fences = m_fence_pool.Destroy();
+  uint32_t leaked_semaphores = m_semaphore_pool.Destroy();
+
+  OutputDebugString(("sync pools: peak " + std::to_string(fence_peak) + " fences, " + std::to_string(semaphore_peak) + " semaphores\n").c_str());
+  if ((leaked_fences != 0) || (leaked_semaphores != 0))
+    OutputDebugString(("sync pools: " + std::to_string(leaked_fences) + " fences and " + std::to_string(leaked_semaphores) +
+      " semaphores were never released\n").c_str());
+}
+
+bool VKTextureFinal::CreateVirtualFrames()
+{
+  m_virtual_frames.resize(m_virtual_frames_count);
+  for (VirtualFrame& virtual_frame : m_virtual_frames)
+    if (!CreateVirtualFrame(virtual_frame))
       return false;
-    }
 
+  m_current_virtual_frame_index = 0;
   return true;
 }
 
-bool VKTextureFinal::CreateFences()
+bool VKTextureFinal::CreateVirtualFrame(VirtualFrame& virtual_frame)
 {
-  VkFenceCreateInfo fence_create_info = {
-    VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, // VkStructureType
-    nullptr,                             // pNext
-    VK_FENCE_CREATE_SIGNALED_BIT         // VkFenceCreateFlags
+  if (!m_semaphore_pool.Acquire(virtual_frame.image_available_semaphore, virtual_frame.image_available_slot) ||
+    !m_semaphore_pool.Acquire(virtual_frame.finished_rendering_semaphore, virtual_frame.finished_rendering_slot))
+  {
+    assert("Could not create semaphores!", "Vulkan", Assert::Error);
+    return false;
+  }
+
+  if (!CreateFrameCommandPool(virtual_frame.command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY))
+    return false;
+
+  for (size_t chunk = 0; chunk < m_recording_chunk_count; ++chunk)
+    if (!CreateFrameCommandPool(virtual_frame.recording_command_pools[chunk], VK_COMMAND_BUFFER_LEVEL_SECONDARY))
+      return false;
+
+  VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
+    VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, // VkStructureType
+    nullptr,                                        // pNext
+    m_descriptor_pool,                              // VkDescriptorPool
+    1,                                              // descriptorSetCount
+    &m_descriptor_set_layout                        // pSetLayouts
   };
 
+  if (vkAllocateDescriptorSets(m_device, &descriptor_set_allocate_info, &virtual_frame.descriptor_set) != VK_SUCCESS)
+  {
+    assert("Could not allocate descriptor set!", "Vulkan", Assert::Error);
+    return false;
+  }
+  UpdateDescriptorSet(virtual_frame);
+
+  // vertices are rewritten every frame, so they stay host visible and mapped for the whole run
+  virtual_frame.sprite_vertex_buffer_info.size = static_cast<uint64_t>(m_max_sprites) * 4 * sizeof(SpriteVertex);
+  virtual_frame.sprite_vertex_buffer_info.count = m_max_sprites * 4;
+  if (!CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, virtual_frame.sprite_vertex_buffer, virtual_frame.sprite_vertex_buffer_info))
+    return false;
+
+  void* sprite_vertex_buffer_memory_pointer;
+  if (vkMapMemory(m_device, virtual_frame.sprite_vertex_buffer_info.memory, 0, VK_WHOLE_SIZE, 0, &sprite_vertex_buffer_memory_pointer) != VK_SUCCESS)
+  {
+    assert("Could not map memory!", "Vulkan", Assert::Error);
+    return false;
+  }
+  virtual_frame.sprite_vertices = static_cast<SpriteVertex*>(sprite_vertex_buffer_memory_pointer);
+
+  return true;
+}
+
+void VKTextureFinal::DestroyVirtualFrame(VirtualFrame& virtual_frame)
+{
+  // transient images join the retired ones, the caller releases those once the device is idle
+  RetireTransientImages(virtual_frame.transient_images);
+
+  DestroyFrameCommandPool(virtual_frame.command_pool);
+  for (FrameCommandPool& frame_pool : virtual_frame.recording_command_pools)
+    DestroyFrameCommandPool(frame_pool);
+  virtual_frame.command_buffer = VK_NULL_HANDLE;
+
+  if (virtual_frame.image_available_semaphore != VK_NULL_HANDLE)
+    m_semaphore_pool.Release(virtual_frame.image_available_semaphore, virtual_frame.image_available_slot);
+  if (virtual_frame.finished_rendering_semaphore != VK_NULL_HANDLE)
+    m_semaphore_pool.Release(virtual_frame.finished_rendering_semaphore, virtual_frame.finished_rendering_slot);
+  virtual_frame.image_available_semaphore = VK_NULL_HANDLE;
+  virtual_frame.finished_rendering_semaphore = VK_NULL_HANDLE;
+
+  if (virtual_frame.descriptor_set != VK_NULL_HANDLE)
+    vkFreeDescriptorSets(m_device, m_descriptor_pool, 1, &virtual_frame.descriptor_set);
+  virtual_frame.descriptor_set = VK_NULL_HANDLE;
+
+  if (virtual_frame.frame_buffer != VK_NULL_HANDLE)
+    vkDestroyFramebuffer(m_device, virtual_frame.frame_buffer, nullptr);
+  virtual_frame.frame_buffer = VK_NULL_HANDLE;
+
+  // freeing the memory unmaps it
+  if (virtual_frame.sprite_vertex_buffer_info.memory != VK_NULL_HANDLE)
+    vkFreeMemory(m_device, virtual_frame.sprite_vertex_buffer_info.memory, nullptr);
+  virtual_frame.sprite_vertex_buffer_info.memory = VK_NULL_HANDLE;
+  virtual_frame.sprite_vertices = nullptr;
+  if (virtual_frame.sprite_vertex_buffer != VK_NULL_HANDLE)
+    vkDestroyBuffer(m_device, virtual_frame.sprite_vertex_buffer, nullptr);
+  virtual_frame.sprite_vertex_buffer = VK_NULL_HANDLE;
+}
+
+bool VKTextureFinal::SetFramesInFlight(uint32_t frames_in_flight, uint32_t swap_chain_images)
+{
+  if ((frames_in_flight == 0) || (frames_in_flight > m_max_virtual_frames))
+  {
+    assert("Unsupported number of frames in flight!", "Vulkan", Assert::Warn);
+    return false;
+  }
+
+  bool swap_chain_changed = (swap_chain_images != m_swap_chain_image_count);
+  m_virtual_frames_count = frames_in_flight;
+  m_swap_chain_image_count = swap_chain_images;
+
+  // before Initialize the counts are all there is to set
+  if (m_virtual_frames.empty())
+    return true;
+
+  // the frames' last submissions and presents use their semaphores and buffers, all of them have to be done
+  if (!FlushTimeline(m_graphics_timeline))
+    return false;
+  vkDeviceWaitIdle(m_device);
+  TimelineReached(m_graphics_timeline, m_graphics_timeline.submitted);
+
   for (VirtualFrame& virtual_frame : m_virtual_frames)
-    if (vkCreateFence(m_device, &fence_create_info, nullptr, &virtual_frame.fence) != VK_SUCCESS)
+    DestroyVirtualFrame(virtual_frame);
+  m_virtual_frames.clear();
+  ReleaseRetiredImages(true);
+
+  if (!CreateVirtualFrames())
+    return false;
+
+  // static buffers are picked by frame index, what was recorded before doesn't line up anymore
+  InvalidateStaticCommandBuffers();
+
+  if (swap_chain_changed && !OnWindowSizeChanged())
+    return false;
+
+  OutputDebugString(("frames in flight: " + std::to_string(m_virtual_frames_count) + ", swap chain images: " +
+    std::to_string(m_swap_chain_info.images.size()) + "\n").c_str());
+  return true;
+}
+
+bool VKTextureFinal::CreateTimelines()
+{
+  // the extension's functions aren't in the device level list, a device without them falls back to fences
+  if (m_timeline_semaphores)
+  {
+    vkGetSemaphoreCounterValueKHR = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(vkGetDeviceProcAddr(m_device, "vkGetSemaphoreCounterValueKHR"));
+    vkWaitSemaphoresKHR = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(m_device, "vkWaitSemaphoresKHR"));
+    m_timeline_semaphores = (vkGetSemaphoreCounterValueKHR != nullptr) && (vkWaitSemaphoresKHR != nullptr);
+  }
+  OutputDebugString(m_timeline_semaphores ? "synchronizing with timeline semaphores\n" : "synchronizing with fences\n");
+
+  return CreateTimeline(m_graphics_queue, m_graphics_timeline);
+}
+
+bool VKTextureFinal::CreateTimeline(VkQueue queue, QueueTimeline& timeline)
+{
+  timeline.queue = queue;
+  timeline.semaphore = VK_NULL_HANDLE;
+  timeline.submitted = 0;
+  timeline.flushed = 0;
+  timeline.completed = 0;
+  timeline.batched = 0;
+  if (!m_timeline_semaphores)
+  {
+    // the fallback takes a fence per flush in flight, made now so flushing never creates one
+    if (!m_fence_pool.Reserve(m_reserved_fences))
     {
-      assert("Could not create a fence!", "Vulkan", Assert::Error);
+      assert("Could not create fences!", "Vulkan", Assert::Error);
       return false;
     }
+    return true;
+  }
+
+  VkSemaphoreTypeCreateInfoKHR semaphore_type_create_info = {
+    VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR, // VkStructureType
+    nullptr,                                          // pNext
+    VK_SEMAPHORE_TYPE_TIMELINE_KHR,                   // semaphoreType
+    0                                                 // initialValue
+  };
+
+  VkSemaphoreCreateInfo semaphore_create_info = {
+    VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, // VkStructureType
+    &semaphore_type_create_info,             // pNext
+    0                                        // VkSemaphoreCreateFlags
+  };
+
+  if (vkCreateSemaphore(m_device, &semaphore_create_info, nullptr, &timeline.semaphore) != VK_SUCCESS)
+  {
+    assert("Could not create a timeline semaphore!", "Vulkan", Assert::Error);
+    return false;
+  }
 
   return true;
 }
 
-bool VKTextureFinal::CreateTexture()
-{  
-  int width = 0, height = 0, data_size = 0;
-  std::vector<char> texture_data = read_image("images/crusty.jpg", 4, &width, &height, nullptr, &data_size);
-  if (texture_data.size() == 0)
+bool VKTextureFinal::SubmitToTimeline(QueueTimeline& timeline, VkCommandBuffer command_buffer, const std::vector<TimelineWait>& waits,
+  VkSemaphore wait_semaphore, VkPipelineStageFlags wait_stage, VkSemaphore signal_semaphore, uint64_t& value)
+{
+  // entries are reused from flush to flush, so their vectors keep their capacity
+  if (timeline.batched == timeline.batch.size())
+    timeline.batch.emplace_back();
+  PendingSubmit& submit = timeline.batch[timeline.batched];
+  submit.command_buffer = command_buffer;
+  submit.wait_semaphores.clear();
+  submit.wait_stages.clear();
+  submit.wait_values.clear();
+  submit.signal_semaphores.clear();
+  submit.signal_values.clear();
+
+  if (wait_semaphore != VK_NULL_HANDLE)
+  {
+    submit.wait_semaphores.push_back(wait_semaphore);
+    submit.wait_stages.push_back(wait_stage);
+    submit.wait_values.push_back(0); // binary, ignored
+  }
+
+  // work earlier on the same queue is ordered by the barriers recorded in it, only other queues need waiting for
+  for (const TimelineWait& wait : waits)
+  {
+    if ((wait.timeline == &timeline) || TimelineReached(*wait.timeline, wait.value))
+      continue;
+
+    if (m_timeline_semaphores)
+    {
+      // a value still batched on the other queue has to be submitted before anything waits for it
+      if ((wait.value > wait.timeline->flushed) && !FlushTimeline(*wait.timeline))
+        return false;
+      submit.wait_semaphores.push_back(wait.timeline->semaphore);
+      submit.wait_stages.push_back(wait.stage);
+      submit.wait_values.push_back(wait.value);
+    }
+    else if (!WaitTimeline(*wait.timeline, wait.value))
+      return false;
+  }
+
+  if (signal_semaphore != VK_NULL_HANDLE)
+  {
+    submit.signal_semaphores.push_back(signal_semaphore);
+    submit.signal_values.push_back(0);
+  }
+  if (m_timeline_semaphores)
+  {
+    submit.signal_semaphores.push_back(timeline.semaphore);
+    submit.signal_values.push_back(timeline.submitted + 1);
+  }
+
+  ++timeline.batched;
+  value = ++timeline.submitted;
+  return true;
+}
+
+bool VKTextureFinal::FlushTimeline(QueueTimeline& timeline)
+{
+  if (timeline.batched == 0)
+    return true;
+
+  // both keep their capacity across flushes, so only a batch bigger than any before allocates
+  std::vector<VkTimelineSemaphoreSubmitInfoKHR>& timeline_submit_infos = timeline.timeline_submit_infos;
+  std::vector<VkSubmitInfo>& submit_infos = timeline.submit_infos;
+  timeline_submit_infos.resize(timeline.batched);
+  submit_infos.resize(timeline.batched);
+  for (size_t i = 0; i < timeline.batched; ++i)
+  {
+    const PendingSubmit& submit = timeline.batch[i];
+
+    VkTimelineSemaphoreSubmitInfoKHR timeline_submit_info = {
+      VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR, // VkStructureType
+      nullptr,                                              // pNext
+      static_cast<uint32_t>(submit.wait_values.size()),     // waitSemaphoreValueCount
+      submit.wait_values.data(),                            // pWaitSemaphoreValues
+      static_cast<uint32_t>(submit.signal_values.size()),   // signalSemaphoreValueCount
+      submit.signal_values.data()                           // pSignalSemaphoreValues
+    };
+    timeline_submit_infos[i] = timeline_submit_info;
+
+    VkSubmitInfo submit_info = {
+      VK_STRUCTURE_TYPE_SUBMIT_INFO,                               // VkStructureType
+      m_timeline_semaphores ? &timeline_submit_infos[i] : nullptr, // pNext
+      static_cast<uint32_t>(submit.wait_semaphores.size()),        // waitSemaphoreCount
+      submit.wait_semaphores.data(),                               // pWaitSemaphores
+      submit.wait_stages.data(),                                   // pWaitDstStageMask
+      1,                                                           // commandBufferCount
+      &submit.command_buffer,                                      // pCommandBuffers
+      static_cast<uint32_t>(submit.signal_semaphores.size()),      // signalSemaphoreCount
+      submit.signal_semaphores.data()                              // pSignalSemaphores
+    };
+    submit_infos[i] = submit_info;
+  }
+
+  // without timeline semaphores one fence stands for the whole batch, back to the pool once it has been seen signaled
+  VkFence fence = VK_NULL_HANDLE;
+  uint32_t fence_slot = 0;
+  if (!m_timeline_semaphores && !m_fence_pool.Acquire(fence, fence_slot))
+  {
+    assert("Could not create a fence!", "Vulkan", Assert::Error);
     return false;
+  }
 
-  if (!CreateImage(width, height, &m_texture))
+  timeline.batched = 0;
+  if (vkQueueSubmit(timeline.queue, static_cast<uint32_t>(submit_infos.size()), submit_infos.data(), fence) != VK_SUCCESS)
+  {
+    if (fence != VK_NULL_HANDLE)
+      m_fence_pool.Release(fence, fence_slot);
+    assert("Graphics queue submit failed!", "Vulkan", Assert::Error);
     return false;
+  }
+
+  if (fence != VK_NULL_HANDLE)
+    timeline.pending_fences.push_back({ timeline.submitted, fence, fence_slot });
+  timeline.flushed = timeline.submitted;
+  return true;
+}
+
+bool VKTextureFinal::TimelineReached(QueueTimeline& timeline, uint64_t value)
+{
+  if (value <= timeline.completed)
+    return true;
+
+  if (m_timeline_semaphores)
+  {
+    uint64_t counter = 0;
+    if (vkGetSemaphoreCounterValueKHR(m_device, timeline.semaphore, &counter) == VK_SUCCESS)
+      timeline.completed = std::max(timeline.completed, counter);
+  }
+  else
+  {
+    // fences signal in submission order on one queue, so the oldest pending one decides
+    while (!timeline.pending_fences.empty() && (vkGetFenceStatus(m_device, timeline.pending_fences.front().fence) == VK_SUCCESS))
+    {
+      SubmittedFence& finished = timeline.pending_fences.front();
+      m_fence_pool.Release(finished.fence, finished.slot);
+      timeline.completed = finished.value;
+      timeline.pending_fences.pop_front();
+    }
+  }
+
+  return value <= timeline.completed;
+}
+
+bool VKTextureFinal::WaitTimeline(QueueTimeline& timeline, uint64_t value, uint64_t timeout)
+{
+  if (TimelineReached(timeline, value))
+    return true;
+  if ((value > timeline.flushed) && !FlushTimeline(timeline))
+    return false;
+
+  if (m_timeline_semaphores)
+  {
+    VkSemaphoreWaitInfoKHR semaphore_wait_info = {
+      VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR, // VkStructureType
+      nullptr,                                   // pNext
+      0,                                         // VkSemaphoreWaitFlags
+      1,                                         // semaphoreCount
+      &timeline.semaphore,                       // pSemaphores
+      &value                                     // pValues
+    };
+
+    if (vkWaitSemaphoresKHR(m_device, &semaphore_wait_info, timeout) != VK_SUCCESS)
+      return false;
+  }
+  else
+  {
+    auto submitted = std::find_if(timeline.pending_fences.begin(), timeline.pending_fences.end(),
+      [value](const SubmittedFence& pending) { return pending.value >= value; });
+    if ((submitted == timeline.pending_fences.end()) || (vkWaitForFences(m_device, 1, &submitted->fence, VK_TRUE, timeout) != VK_SUCCESS))
+      return false;
+  }
+
+  return TimelineReached(timeline, value);
+}
+
+void VKTextureFinal::DestroyTimeline(QueueTimeline& timeline)
+{
+  if (timeline.semaphore != VK_NULL_HANDLE)
+    vkDestroySemaphore(m_device, timeline.semaphore, nullptr);
+  timeline.semaphore = VK_NULL_HANDLE;
+
+  // the device is idle by now, so every pending fence is signaled and can go back
+  for (const SubmittedFence& pending : timeline.pending_fences)
+    m_fence_pool.Release(pending.fence, pending.slot);
+  timeline.pending_fences.clear();
+}
+
+bool VKTextureFinal::CreateTexture()
+{
+  // mid grey placeholder, real images are streamed in by CreateTextureStreaming
+  std::vector<char> texture_data(4, static_cast<char>(128));
+
+  if (!CreateImage(1, 1, 1, VK_FORMAT_R8G8B8A8_UNORM, &m_texture))
+    return false;
+  m_image_states.Track(m_texture, 1);
 
   if (!AllocateImageMemory(m_texture, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_texture_memory))
     return false;
@@ -418,7 +914,7 @@ bool VKTextureFinal::CreateTexture()
     return false;
   }
 
-  if (!CreateImageView(m_texture, &m_texture_view))
+  if (!CreateImageView(m_texture, VK_FORMAT_R8G8B8A8_UNORM, 1, &m_texture_view))
   {
     assert("Could not create image view!", "Vulkan", Assert::Error);
     return false;
@@ -427,31 +923,54 @@ bool VKTextureFinal::CreateTexture()
   if (!CreateSampler(&m_texture_sampler))
     return false;
 
-  if (!CopyTextureData(texture_data.data(), data_size, width, height))
+  if (!CopyTextureData(m_texture, texture_data.data(), 1, 1))
     return false;
 
   return true;
 }
 
-bool VKTextureFinal::CreateImage(uint32_t width, uint32_t height, VkImage* image)
+VkFormat VKTextureFinal::SelectTextureFormat(int components, BCFormat& bc_format)
+{
+  if (!m_texture_compression_bc)
+    return VK_FORMAT_R8G8B8A8_UNORM;
+
+  // opaque images take BC1 (8x smaller than RGBA), images with alpha BC3 or BC7 (4x) depending on quality mode
+  bool has_alpha = (components == 2) || (components == 4);
+
+  if (!has_alpha)
+  {
+    bc_format = BCFormat::BC1;
+    return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+  }
+
+  if (m_texture_compression_quality == BCQuality::Fast)
+  {
+    bc_format = BCFormat::BC3;
+    return VK_FORMAT_BC3_UNORM_BLOCK;
+  }
+
+  bc_format = BCFormat::BC7;
+  return VK_FORMAT_BC7_UNORM_BLOCK;
+}
+
+bool VKTextureFinal::CreateImage(uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format, VkImage* image, VkImageUsageFlags usage)
 {
   VkImageCreateInfo image_create_info = {
     VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO, // VkStructureType 
     nullptr,                             // pNext
     0,                                   // VkImageCreateFlags
     VK_IMAGE_TYPE_2D,                    // VkImageType
-    VK_FORMAT_R8G8B8A8_UNORM,            // VkFormat
+    format,                              // VkFormat
     {                                    // VkExtent3D
       width,                               // width
       height,                              // height
       1                                    // depth
     },
-    1,                                   // mipLevels
+    mip_levels,                          // mipLevels
     1,                                   // arrayLayers
     VK_SAMPLE_COUNT_1_BIT,               // VkSampleCountFlagBits
     VK_IMAGE_TILING_OPTIMAL,             // VkImageTiling, inner memory structure
-    VK_IMAGE_USAGE_TRANSFER_DST_BIT |    // VkImageUsageFlags
-    VK_IMAGE_USAGE_SAMPLED_BIT,          // this notes this image will be used in shader
+    usage,                               // VkImageUsageFlags, textures by default: copied into, copied from by streaming and sampled
     VK_SHARING_MODE_EXCLUSIVE,           // VkSharingMode
     0,                                   // queueFamilyIndexCount
     nullptr,                             // pQueueFamilyIndices
@@ -489,7 +1008,7 @@ bool VKTextureFinal::AllocateImageMemory(VkImage image, VkMemoryPropertyFlagBits
   return false;
 }
 
-bool VKTextureFinal::CreateImageView(VkImage image, VkImageView* image_view)
+bool VKTextureFinal::CreateImageView(VkImage image, VkFormat format, uint32_t mip_levels, VkImageView* image_view, VkImageAspectFlags aspect)
 {
   VkImageViewCreateInfo image_view_create_info = {
     VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO, // VkStructureType
@@ -497,7 +1016,7 @@ bool VKTextureFinal::CreateImageView(VkImage image, VkImageView* image_view)
     0,                                        // VkImageViewCreateFlags
     image,                                    // VkImage
     VK_IMAGE_VIEW_TYPE_2D,                    // VkImageViewType
-    VK_FORMAT_R8G8B8A8_UNORM,                 // VkFormat
+    format,                                   // VkFormat
     {                                         // VkComponentMapping
       VK_COMPONENT_SWIZZLE_IDENTITY,            // r
       VK_COMPONENT_SWIZZLE_IDENTITY,            // g
@@ -505,9 +1024,9 @@ bool VKTextureFinal::CreateImageView(VkImage image, VkImageView* image_view)
       VK_COMPONENT_SWIZZLE_IDENTITY             // a
     },
     {                                         // VkImageSubresourceRange
-      VK_IMAGE_ASPECT_COLOR_BIT,                // aspectMask
+      aspect,                                   // aspectMask
       0,                                        // baseMipLevel
-      1,                                        // levelCount
+      mip_levels,                               // levelCount
       0,                                        // baseArrayLayer
       1                                         // layerCount
     }
@@ -516,6 +1035,143 @@ bool VKTextureFinal::CreateImageView(VkImage image, VkImageView* image_view)
   return vkCreateImageView(m_device, &image_view_create_info, nullptr, image_view) == VK_SUCCESS;
 }
 
+uint32_t VKTextureFinal::GetMemoryType(uint32_t memory_type_bits, VkMemoryPropertyFlags property)
+{
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  vkGetPhysicalDeviceMemoryProperties(m_physical_device, &memory_properties);
+
+  for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i)
+    if ((memory_type_bits & (1 << i)) && ((memory_properties.memoryTypes[i].propertyFlags & property) == property))
+      return i;
+  return UINT32_MAX;
+}
+
+bool VKTextureFinal::AllocateTransientImages(VirtualFrame& virtual_frame, std::vector<RenderGraph::TransientImage>& transients)
+{
+  TransientImageSet& transient_images = virtual_frame.transient_images;
+
+  // same images over the same passes as last time, the memory layout can't have changed either
+  uint64_t signature = 1;
+  for (const RenderGraph::TransientImage& transient : transients)
+  {
+    uint32_t key[] = { static_cast<uint32_t>(transient.desc.format), transient.desc.extent.width, transient.desc.extent.height, transient.desc.aspect,
+      transient.usage, transient.lazy ? 1u : 0u, transient.first_pass, transient.last_pass };
+    signature = hash_bytes(key, sizeof(key), signature);
+  }
+
+  if (signature != transient_images.signature)
+  {
+    // whatever this frame recorded against the old images must not be resubmitted
+    RetireTransientImages(transient_images);
+    InvalidateStaticCommandBuffers();
+
+    std::vector<TransientPlacement> placements(transients.size());
+    VkDeviceSize dedicated_size = 0;
+    for (size_t i = 0; i < transients.size(); ++i)
+    {
+      const RenderGraph::TransientImage& transient = transients[i];
+
+      // attachments that never leave the tile don't need real memory where the device offers lazily allocated memory
+      VkImageUsageFlags usage = transient.lazy ? (transient.usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) : transient.usage;
+      VkImage image;
+      if (!CreateImage(transient.desc.extent.width, transient.desc.extent.height, 1, transient.desc.format, &image, usage))
+      {
+        assert("Could not create a transient image!", "Vulkan", Assert::Error);
+        return false;
+      }
+      transient_images.images.push_back(image);
+
+      VkMemoryRequirements image_memory_requirements;
+      vkGetImageMemoryRequirements(m_device, image, &image_memory_requirements);
+
+      uint32_t memory_type = transient.lazy ? GetMemoryType(image_memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) : UINT32_MAX;
+      if (memory_type == UINT32_MAX)
+        memory_type = GetMemoryType(image_memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+      if (memory_type == UINT32_MAX)
+      {
+        assert("Could not find memory for a transient image!", "Vulkan", Assert::Error);
+        return false;
+      }
+
+      placements[i].size = image_memory_requirements.size;
+      placements[i].alignment = image_memory_requirements.alignment;
+      placements[i].memory_type = memory_type;
+      placements[i].first_pass = transient.first_pass;
+      placements[i].last_pass = transient.last_pass;
+      dedicated_size += image_memory_requirements.size;
+    }
+
+    std::vector<TransientHeap> heaps = plan_transient_memory(placements);
+    VkDeviceSize aliased_size = 0;
+    for (const TransientHeap& heap : heaps)
+    {
+      VkMemoryAllocateInfo memory_allocate_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, // VkStructureType
+        nullptr,                                // pNext
+        heap.size,                              // allocationSize
+        heap.memory_type                        // memoryTypeIndex
+      };
+
+      VkDeviceMemory memory;
+      if (vkAllocateMemory(m_device, &memory_allocate_info, nullptr, &memory) != VK_SUCCESS)
+      {
+        assert("Could not allocate transient image memory!", "Vulkan", Assert::Error);
+        return false;
+      }
+      transient_images.memories.push_back(memory);
+      aliased_size += heap.size;
+    }
+
+    for (size_t i = 0; i < transients.size(); ++i)
+    {
+      if (vkBindImageMemory(m_device, transient_images.images[i], transient_images.memories[placements[i].heap], placements[i].offset) != VK_SUCCESS)
+      {
+        assert("Could not bind memory to a transient image!", "Vulkan", Assert::Error);
+        return false;
+      }
+
+      VkImageView view;
+      if (!CreateImageView(transient_images.images[i], transients[i].desc.format, 1, &view, transients[i].desc.aspect))
+      {
+        assert("Could not create a transient image view!", "Vulkan", Assert::Error);
+        return false;
+      }
+      transient_images.views.push_back(view);
+      transient_images.follows.push_back(placements[i].follows);
+    }
+    transient_images.signature = signature;
+
+    OutputDebugString(("transient images: " + std::to_string(transients.size()) + ", " + std::to_string(aliased_size / 1024) + " KB instead of " +
+      std::to_string(dedicated_size / 1024) + " KB\n").c_str());
+  }
+
+  for (size_t i = 0; i < transients.size(); ++i)
+  {
+    transients[i].image = transient_images.images[i];
+    for (uint32_t earlier : transient_images.follows[i])
+      transients[i].aliases.push_back(transients[earlier].resource);
+  }
+  return true;
+}
+
+void VKTextureFinal::RetireTransientImages(TransientImageSet& transient_images)
+{
+  // the memory goes on its own, the images bound to it are destroyed in the same release
+  for (size_t i = 0; i < transient_images.images.size(); ++i)
+  {
+    VkImageView view = i < transient_images.views.size() ? transient_images.views[i] : VK_NULL_HANDLE;
+    m_retired_images.push_back({ transient_images.images[i], VK_NULL_HANDLE, view, m_frame_number + m_virtual_frames_count });
+  }
+  for (VkDeviceMemory memory : transient_images.memories)
+    m_retired_images.push_back({ VK_NULL_HANDLE, memory, VK_NULL_HANDLE, m_frame_number + m_virtual_frames_count });
+
+  transient_images.signature = 0;
+  transient_images.images.clear();
+  transient_images.views.clear();
+  transient_images.follows.clear();
+  transient_images.memories.clear();
+}
+
 bool VKTextureFinal::CreateSampler(VkSampler* sampler)
 {
   VkSamplerCreateInfo sampler_create_info = {
@@ -524,7 +1180,7 @@ bool VKTextureFinal::CreateSampler(VkSampler* sampler)
     0,                                       // VkSamplerCreateFlags
     VK_FILTER_LINEAR,                        // magFilter
     VK_FILTER_LINEAR,                        // minFilter
-    VK_SAMPLER_MIPMAP_MODE_NEAREST,          // mipmapMode
+    VK_SAMPLER_MIPMAP_MODE_LINEAR,           // mipmapMode
     VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,   // addressModeU
     VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,   // addressModeV
     VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,   // addressModeW
@@ -534,7 +1190,7 @@ bool VKTextureFinal::CreateSampler(VkSampler* sampler)
     VK_FALSE,                                // compareEnable
     VK_COMPARE_OP_ALWAYS,                    // compareOp
     0.0f,                                    // minLod
-    0.0f,                                    // maxLod
+    VK_LOD_CLAMP_NONE,                       // maxLod, the view decides which levels exist
     VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK, // borderColor
     VK_FALSE                                 // unnormalizedCoordinates
   };
@@ -542,31 +1198,400 @@ bool VKTextureFinal::CreateSampler(VkSampler* sampler)
   return vkCreateSampler(m_device, &sampler_create_info, nullptr, sampler) == VK_SUCCESS;
 }
 
-bool VKTextureFinal::CopyTextureData(char* texture_data, uint32_t data_size, uint32_t width, uint32_t height)
+RenderGraph::Resource VKTextureFinal::ImportStagingBuffer(RenderGraph& graph, VkBuffer staging_buffer)
 {
-  // Prepare data in staging buffer
+  // host writes are flushed before the submit, and submitting makes them visible to the device without a barrier
+  return graph.ImportBuffer(staging_buffer, 0, VK_WHOLE_SIZE, VK_PIPELINE_STAGE_HOST_BIT, 0);
+}
 
-  void* staging_buffer_memory_pointer;
-  if (vkMapMemory(m_device, m_staging_buffer_info.memory, 0, data_size, 0, &staging_buffer_memory_pointer) != VK_SUCCESS)
+bool VKTextureFinal::CopyTextureData(VkImage image, const char* rgba, uint32_t width, uint32_t height)
+{
+  // images bigger than the staging buffer (atlas pages) go up in bands of whole rows
+  VkDeviceSize row_size = static_cast<VkDeviceSize>(width) * 4;
+  uint32_t     band_rows = static_cast<uint32_t>(m_staging_buffer_info.size / row_size);
+  if (band_rows == 0)
   {
-    assert("Could not map memory and upload texture data to a staging buffer!", "Vulkan", Assert::Error);
+    assert("Texture rows do not fit into the staging buffer!", "Vulkan", Assert::Error);
     return false;
   }
 
-  memcpy(staging_buffer_memory_pointer, texture_data, data_size);
-
-  VkMappedMemoryRange flush_range = {
-    VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, // VkStructureType
-    nullptr,                               // pNext
-    m_staging_buffer_info.memory,          // VkDeviceMemory
-    0,                                     // offset
-    data_size                              // size
+  VkImageSubresourceRange image_subresource_range = {
+    VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
+    0,                         // baseMipLevel
+    1,                         // levelCount
+    0,                         // baseArrayLayer
+    1                          // layerCount
   };
-  vkFlushMappedMemoryRanges(m_device, 1, &flush_range);
 
-  vkUnmapMemory(m_device, m_staging_buffer_info.memory);
+  for (uint32_t first_row = 0; first_row < height; first_row += band_rows)
+  {
+    uint32_t     row_count = std::min(band_rows, height - first_row);
+    VkDeviceSize data_size = row_size * row_count;
+
+    // Prepare data in staging buffer
+    void* staging_buffer_memory_pointer;
+    if (vkMapMemory(m_device, m_staging_buffer_info.memory, 0, data_size, 0, &staging_buffer_memory_pointer) != VK_SUCCESS)
+    {
+      assert("Could not map memory and upload texture data to a staging buffer!", "Vulkan", Assert::Error);
+      return false;
+    }
+
+    memcpy(staging_buffer_memory_pointer, rgba + row_size * first_row, static_cast<size_t>(data_size));
+
+    VkMappedMemoryRange flush_range = {
+      VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, // VkStructureType
+      nullptr,                               // pNext
+      m_staging_buffer_info.memory,          // VkDeviceMemory
+      0,                                     // offset
+      data_size                              // size
+    };
+    vkFlushMappedMemoryRanges(m_device, 1, &flush_range);
+
+    vkUnmapMemory(m_device, m_staging_buffer_info.memory);
+
+    // Prepare command buffer to copy data from staging buffer to a vertex buffer
+    VkCommandBufferBeginInfo command_buffer_begin_info = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, // VkStructureType
+      nullptr,                                     // pNext
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, // VkCommandBufferUsageFlags
+      nullptr                                      // pInheritanceInfo
+    };
+
+    VkCommandBuffer& command_buffer = m_upload_command_buffer;
+
+    vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+
+    VkBufferImageCopy buffer_image_copy_info = {
+      0,                           // bufferOffset
+      0,                           // bufferRowLength
+      0,                           // bufferImageHeight
+      {                            // VkImageSubresourceLayers
+        VK_IMAGE_ASPECT_COLOR_BIT,   // aspectMask
+        0,                           // mipLevel
+        0,                           // baseArrayLayer
+        1                            // layerCount
+      },
+      {                            // imageOffset
+        0,                           // x
+        static_cast<int32_t>(first_row), // y
+        0                            // z
+      },
+      {                            // imageExtent
+        width,                       // width
+        row_count,                   // height
+        1                            // depth
+      }
+    };
+
+    // bands after the first find the image how the previous one left it, and only wait for that band's write
+    // the staging buffer needs no barrier, submitting makes the flushed host writes visible
+    m_image_states.Transition(image, image_subresource_range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_TRANSFER_WRITE_BIT);
+    m_image_states.Flush(command_buffer, vkCmdPipelineBarrier);
+
+    vkCmdCopyBufferToImage(command_buffer, m_staging_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_image_copy_info);
+
+    if (first_row + row_count == height)
+    {
+      m_image_states.Transition(image, image_subresource_range, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT);
+      m_image_states.Flush(command_buffer, vkCmdPipelineBarrier);
+    }
+
+    vkEndCommandBuffer(command_buffer);
+
+    uint64_t band_value;
+    if (!SubmitToTimeline(m_graphics_timeline, command_buffer, {}, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, band_value))
+      return false;
+
+    // the next band reuses the staging buffer and command buffer, frames in flight can keep going
+    if (!WaitTimeline(m_graphics_timeline, band_value))
+    {
+      assert("Problem occurred while waiting for an upload!", "Vulkan", Assert::Error);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool VKTextureFinal::CreateTextureStreaming()
+{
+  // separate staging buffer, streaming uploads stay in flight across frames
+  m_streaming_staging_buffer_info.size = 4194304;
+  if (!CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, m_streaming_staging_buffer, m_streaming_staging_buffer_info))
+    return false;
+
+  if (!AllocateCommandBuffers(m_graphics_command_pool, 1, &m_streaming_command_buffer))
+    return false;
+
+  return StreamTexture("images/crusty.jpg");
+}
+
+bool VKTextureFinal::StreamTexture(const std::string& file_name)
+{
+  int width = 0, height = 0, components = 0;
+  if (!read_image_info(file_name, &width, &height, &components))
+  {
+    assert("Could not read texture header!", "Vulkan", Assert::Error);
+    return false;
+  }
+
+  std::unique_ptr<StreamedTexture> texture(new StreamedTexture());
+  texture->file_name = file_name;
+  texture->format = SelectTextureFormat(components, texture->bc_format);
+  texture->bc_quality = m_texture_compression_quality;
+  texture->width = static_cast<uint32_t>(width);
+  texture->height = static_cast<uint32_t>(height);
+  texture->mip_count = mip_level_count(width, height);
+  texture->mip_data.resize(texture->mip_count);
+  texture->first_loaded_mip = texture->mip_count;
+  texture->resident_mip = texture->mip_count;
+  texture->image = VK_NULL_HANDLE;
+  texture->memory = VK_NULL_HANDLE;
+  texture->view = VK_NULL_HANDLE;
+
+  // the texture lives on the heap, so the pointer stays valid while m_streamed_textures grows
+  StreamedTexture* loading_texture = texture.get();
+  texture->loader = threadPool.Submit([this, loading_texture]() { return LoadStreamedTexture(*loading_texture); });
+
+  m_streamed_textures.push_back(std::move(texture));
+  return true;
+}
+
+bool VKTextureFinal::LoadStreamedTexture(StreamedTexture& texture)
+{
+  // worker thread, only fills mip_data and never touches Vulkan objects
+  int width = 0, height = 0;
+  std::vector<std::vector<char>> rgba_levels = read_image_mips(texture.file_name, &width, &height);
+  if (rgba_levels.empty() || (static_cast<uint32_t>(width) != texture.width) || (static_cast<uint32_t>(height) != texture.height))
+  {
+    OutputDebugString("Streamed texture could not be decoded\n");
+    return false;
+  }
+
+  // smallest level first, so something sharper than the placeholder shows up right away
+  for (uint32_t i = texture.mip_count; i-- > 0;)
+  {
+    if (texture.format == VK_FORMAT_R8G8B8A8_UNORM)
+      texture.mip_data[i] = std::move(rgba_levels[i]);
+    else
+      texture.mip_data[i] = encode_bc(rgba_levels[i].data(), mip_level_extent(texture.width, i), mip_level_extent(texture.height, i), texture.bc_format, texture.bc_quality);
+
+    texture.first_loaded_mip.store(i, std::memory_order_release);
+  }
+
+  return true;
+}
+
+VkDeviceSize VKTextureFinal::GetStreamedTextureSize(const StreamedTexture& texture, uint32_t first_mip)
+{
+  // computed from the format, levels don't have to be loaded yet
+  VkDeviceSize size = 0;
+  for (uint32_t i = first_mip; i < texture.mip_count; ++i)
+  {
+    uint32_t width = mip_level_extent(texture.width, i);
+    uint32_t height = mip_level_extent(texture.height, i);
+
+    if (texture.format == VK_FORMAT_R8G8B8A8_UNORM)
+      size += static_cast<VkDeviceSize>(width) * height * 4;
+    else
+      size += bc_encoded_size(texture.bc_format, width, height);
+  }
+  return size;
+}
+
+bool VKTextureFinal::UpdateStreamedTextures()
+{
+  ReleaseRetiredImages(false);
+
+  // one upload in flight at a time, the next one reuses the staging buffer and command buffer
+  if (!TimelineReached(m_graphics_timeline, m_streaming_value))
+    return true;
+
+  // hand the budget out one level at a time, always to the texture that is currently the blurriest
+  // the smallest level is always granted, otherwise there would be nothing to sample
+  std::vector<uint32_t> budget_mips(m_streamed_textures.size());
+  std::vector<bool>     budget_exhausted(m_streamed_textures.size(), false);
+  VkDeviceSize          budget_used = 0;
+
+  for (size_t i = 0; i < m_streamed_textures.size(); ++i)
+  {
+    budget_mips[i] = m_streamed_textures[i]->mip_count - 1;
+    budget_used += GetStreamedTextureSize(*m_streamed_textures[i], budget_mips[i]);
+  }
+
+  for (;;)
+  {
+    size_t   blurriest = m_streamed_textures.size();
+    uint32_t blurriest_extent = UINT32_MAX;
+
+    for (size_t i = 0; i < m_streamed_textures.size(); ++i)
+    {
+      const StreamedTexture& texture = *m_streamed_textures[i];
+      if (budget_exhausted[i] || (budget_mips[i] == 0))
+        continue;
+
+      uint32_t extent = std::max(mip_level_extent(texture.width, budget_mips[i]), mip_level_extent(texture.height, budget_mips[i]));
+      if (extent < blurriest_extent)
+      {
+        blurriest = i;
+        blurriest_extent = extent;
+      }
+    }
+
+    if (blurriest == m_streamed_textures.size())
+      break;
+
+    const StreamedTexture& texture = *m_streamed_textures[blurriest];
+    VkDeviceSize level_size = GetStreamedTextureSize(texture, budget_mips[blurriest] - 1) - GetStreamedTextureSize(texture, budget_mips[blurriest]);
+
+    // a level that can't go through the staging buffer in one piece is never streamed
+    if ((budget_used + level_size > m_texture_streaming_budget) || (level_size > m_streaming_staging_buffer_info.size))
+    {
+      budget_exhausted[blurriest] = true;
+      continue;
+    }
+
+    budget_used += level_size;
+    --budget_mips[blurriest];
+  }
+
+  for (size_t i = 0; i < m_streamed_textures.size(); ++i)
+  {
+    StreamedTexture& texture = *m_streamed_textures[i];
+    uint32_t target_mip = std::max(budget_mips[i], texture.first_loaded_mip.load(std::memory_order_acquire));
+
+    if (target_mip == texture.resident_mip)
+      continue;
+
+    uint32_t new_resident_mip = target_mip;
+    if (target_mip < texture.resident_mip)
+    {
+      // take as many new levels as fit into the staging buffer, smallest first
+      VkDeviceSize upload_size = 0;
+      new_resident_mip = texture.resident_mip;
+      while (new_resident_mip > target_mip)
+      {
+        VkDeviceSize level_size = (texture.mip_data[new_resident_mip - 1].size() + 15) & ~static_cast<VkDeviceSize>(15);
+        if (upload_size + level_size > m_streaming_staging_buffer_info.size)
+          break;
+
+        upload_size += level_size;
+        --new_resident_mip;
+      }
+
+      if (new_resident_mip == texture.resident_mip)
+        continue;
+    }
+
+    // one rebuild per frame keeps the per frame cost bounded
+    return RebuildStreamedTexture(texture, new_resident_mip);
+  }
+
+  return true;
+}
+
+bool VKTextureFinal::RebuildStreamedTexture(StreamedTexture& texture, uint32_t new_resident_mip)
+{
+  // images can't change their level count, so growing or shrinking means a new image
+  // levels both images share are copied on the GPU, new levels come from the staging buffer
+  uint32_t level_count = texture.mip_count - new_resident_mip;
+  VkImage        image = VK_NULL_HANDLE;
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkImageView    view = VK_NULL_HANDLE;
+
+  if (!CreateImage(mip_level_extent(texture.width, new_resident_mip), mip_level_extent(texture.height, new_resident_mip), level_count, texture.format, &image))
+  {
+    assert("Could not create streamed texture image!", "Vulkan", Assert::Error);
+    return false;
+  }
+  m_image_states.Track(image, level_count);
+
+  if (!AllocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memory))
+  {
+    m_image_states.Forget(image);
+    vkDestroyImage(m_device, image, nullptr);
+    return false;
+  }
+
+  if (vkBindImageMemory(m_device, image, memory, 0) != VK_SUCCESS)
+  {
+    assert("Could not bind memory to an image!", "Vulkan", Assert::Error);
+    m_image_states.Forget(image);
+    vkDestroyImage(m_device, image, nullptr);
+    vkFreeMemory(m_device, memory, nullptr);
+    return false;
+  }
+
+  if (!CreateImageView(image, texture.format, level_count, &view))
+  {
+    assert("Could not create image view!", "Vulkan", Assert::Error);
+    m_image_states.Forget(image);
+    vkDestroyImage(m_device, image, nullptr);
+    vkFreeMemory(m_device, memory, nullptr);
+    return false;
+  }
+
+  std::vector<VkBufferImageCopy> upload_regions;
+  if (new_resident_mip < texture.resident_mip)
+  {
+    void* staging_buffer_memory_pointer;
+    if (vkMapMemory(m_device, m_streaming_staging_buffer_info.memory, 0, m_streaming_staging_buffer_info.size, 0, &staging_buffer_memory_pointer) != VK_SUCCESS)
+    {
+      assert("Could not map memory and upload texture data to a staging buffer!", "Vulkan", Assert::Error);
+      m_image_states.Forget(image);
+      vkDestroyImageView(m_device, view, nullptr);
+      vkDestroyImage(m_device, image, nullptr);
+      vkFreeMemory(m_device, memory, nullptr);
+      return false;
+    }
+
+    VkDeviceSize offset = 0;
+    for (uint32_t mip = new_resident_mip; mip < texture.resident_mip; ++mip)
+    {
+      const std::vector<char>& level = texture.mip_data[mip];
+      memcpy(static_cast<char*>(staging_buffer_memory_pointer) + offset, level.data(), level.size());
+
+      VkBufferImageCopy buffer_image_copy_info = {
+        offset,                      // bufferOffset
+        0,                           // bufferRowLength
+        0,                           // bufferImageHeight
+        {                            // VkImageSubresourceLayers
+          VK_IMAGE_ASPECT_COLOR_BIT,   // aspectMask
+          mip - new_resident_mip,      // mipLevel
+          0,                           // baseArrayLayer
+          1                            // layerCount
+        },
+        {                            // imageOffset
+          0,                           // x
+          0,                           // y
+          0                            // z
+        },
+        {                            // imageExtent
+          mip_level_extent(texture.width, mip),  // width
+          mip_level_extent(texture.height, mip), // height
+          1                                      // depth
+        }
+      };
+      upload_regions.push_back(buffer_image_copy_info);
+
+      // offsets have to be a multiple of the texel block size, 16 covers every format used here
+      offset += (level.size() + 15) & ~static_cast<VkDeviceSize>(15);
+    }
+
+    VkMappedMemoryRange flush_range = {
+      VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,  // VkStructureType
+      nullptr,                                // pNext
+      m_streaming_staging_buffer_info.memory, // VkDeviceMemory
+      0,                                      // offset
+      VK_WHOLE_SIZE                           // size
+    };
+    vkFlushMappedMemoryRanges(m_device, 1, &flush_range);
+
+    vkUnmapMemory(m_device, m_streaming_staging_buffer_info.memory);
+  }
 
-  // Prepare command buffer to copy data from staging buffer to a vertex buffer
   VkCommandBufferBeginInfo command_buffer_begin_info = {
     VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, // VkStructureType
     nullptr,                                     // pNext
@@ -574,95 +1599,117 @@ bool VKTextureFinal::CopyTextureData(char* texture_data, uint32_t data_size, uin
     nullptr                                      // pInheritanceInfo
   };
 
-  VkCommandBuffer& command_buffer = m_virtual_frames[0].command_buffer;
-
-  vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+  vkBeginCommandBuffer(m_streaming_command_buffer, &command_buffer_begin_info);
 
-  VkImageSubresourceRange image_subresource_range = {
+  VkImageSubresourceRange new_range = {
     VK_IMAGE_ASPECT_COLOR_BIT, // aspectMask
     0,                         // baseMipLevel
-    1,                         // levelCount
+    level_count,               // levelCount
     0,                         // baseArrayLayer
     1                          // layerCount
   };
-
-  VkImageMemoryBarrier image_memory_barrier_from_undefined_to_transfer_dst = {
-    VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, // VkStructureType
-    nullptr,                                // pNext
-    0,                                      // srcAccessMask
-    VK_ACCESS_TRANSFER_WRITE_BIT,           // dstAccessMask
-    VK_IMAGE_LAYOUT_UNDEFINED,              // oldLayout
-    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,   // newLayout
-    VK_QUEUE_FAMILY_IGNORED,                // srcQueueFamilyIndex
-    VK_QUEUE_FAMILY_IGNORED,                // dstQueueFamilyIndex
-    m_texture,                              // VkImage
-    image_subresource_range                 // VkImageSubresourceRange
-  };
-  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier_from_undefined_to_transfer_dst);
-
-  VkBufferImageCopy buffer_image_copy_info = {
-    0,                           // bufferOffset
-    0,                           // bufferRowLength
-    0,                           // bufferImageHeight
-    {                            // VkImageSubresourceLayers
-      VK_IMAGE_ASPECT_COLOR_BIT,   // aspectMask
-      0,                           // mipLevel
-      0,                           // baseArrayLayer
-      1                            // layerCount
-    },                           
-    {                            // imageOffset
-      0,                           // x
-      0,                           // y
-      0                            // z
-    },                           
-    {                            // imageExtent
-      width,                       // width
-      height,                      // height
-      1                            // depth
-    }
-  };
-  vkCmdCopyBufferToImage(command_buffer, m_staging_buffer, m_texture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_image_copy_info);
-
-  VkImageMemoryBarrier image_memory_barrier_from_transfer_to_shader_read = {
-    VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,   // VkStructureType
-    nullptr,                                  // pNext
-    VK_ACCESS_TRANSFER_WRITE_BIT,             // srcAccessMask
-    VK_ACCESS_SHADER_READ_BIT,                // dstAccessMask
-    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,     // oldLayout
-    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, // newLayout
-    VK_QUEUE_FAMILY_IGNORED,                  // srcQueueFamilyIndex
-    VK_QUEUE_FAMILY_IGNORED,                  // dstQueueFamilyIndex
-    m_texture,                                // VkImage
-    image_subresource_range                   // VkImageSubresourceRange
+  VkImageSubresourceRange old_range = {
+    VK_IMAGE_ASPECT_COLOR_BIT,                // aspectMask
+    0,                                        // baseMipLevel
+    texture.mip_count - texture.resident_mip, // levelCount
+    0,                                        // baseArrayLayer
+    1                                         // layerCount
   };
-  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier_from_transfer_to_shader_read);
 
-  vkEndCommandBuffer(command_buffer);
+  // the old image may still be sampled by frames in flight, copying out of it waits for their fragment shaders
+  bool has_old_image = texture.image != VK_NULL_HANDLE;
+  std::vector<VkImageCopy> copy_regions;
+  if (has_old_image)
+  {
+    for (uint32_t mip = std::max(new_resident_mip, texture.resident_mip); mip < texture.mip_count; ++mip)
+    {
+      VkImageCopy image_copy_info = {
+        {                                      // srcSubresource
+          VK_IMAGE_ASPECT_COLOR_BIT,             // aspectMask
+          mip - texture.resident_mip,            // mipLevel
+          0,                                     // baseArrayLayer
+          1                                      // layerCount
+        },
+        { 0, 0, 0 },                           // srcOffset
+        {                                      // dstSubresource
+          VK_IMAGE_ASPECT_COLOR_BIT,             // aspectMask
+          mip - new_resident_mip,                // mipLevel
+          0,                                     // baseArrayLayer
+          1                                      // layerCount
+        },
+        { 0, 0, 0 },                           // dstOffset
+        {                                      // extent
+          mip_level_extent(texture.width, mip),  // width
+          mip_level_extent(texture.height, mip), // height
+          1                                      // depth
+        }
+      };
+      copy_regions.push_back(image_copy_info);
+    }
+  }
 
-  // Submit command buffer and copy data from staging buffer to a vertex buffer
-  VkSubmitInfo submit_info = {
-    VK_STRUCTURE_TYPE_SUBMIT_INFO, // VkStructureType
-    nullptr,                       // pNext
-    0,                             // waitSemaphoreCount
-    nullptr,                       // pWaitSemaphores
-    nullptr,                       // pWaitDstStageMask
-    1,                             // commandBufferCount
-    &command_buffer,               // pCommandBuffers
-    0,                             // signalSemaphoreCount
-    nullptr                        // pSignalSemaphores
-  };
+  // both images move in one barrier, the new mips go to sampling in a second one once they're written
+  if (has_old_image)
+    m_image_states.Transition(texture.image, old_range, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+  m_image_states.Transition(image, new_range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+  m_image_states.Flush(m_streaming_command_buffer, vkCmdPipelineBarrier);
 
-  if (vkQueueSubmit(m_graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
-  {
-    assert("Graphics queue submit failed!", "Vulkan", Assert::Error);
+  if (has_old_image)
+    vkCmdCopyImage(m_streaming_command_buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      static_cast<uint32_t>(copy_regions.size()), copy_regions.data());
+
+  // the staging buffer was flushed before, submitting makes it visible
+  if (!upload_regions.empty())
+    vkCmdCopyBufferToImage(m_streaming_command_buffer, m_streaming_staging_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      static_cast<uint32_t>(upload_regions.size()), upload_regions.data());
+
+  m_image_states.Transition(image, new_range, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+  m_image_states.Flush(m_streaming_command_buffer, vkCmdPipelineBarrier);
+
+  vkEndCommandBuffer(m_streaming_command_buffer);
+
+  // same queue as rendering, so frames submitted after this see the finished image without extra semaphores
+  if (!SubmitToTimeline(m_graphics_timeline, m_streaming_command_buffer, {}, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, m_streaming_value))
     return false;
+
+  // frames already submitted still sample the old image, it goes away once every frame slot has cycled
+  if (has_old_image)
+  {
+    m_retired_images.push_back({ texture.image, texture.memory, texture.view, m_frame_number + m_virtual_frames_count });
+    m_image_states.Forget(texture.image);
   }
 
-  vkDeviceWaitIdle(m_device);
+  texture.image = image;
+  texture.memory = memory;
+  texture.view = view;
+  texture.resident_mip = new_resident_mip;
 
   return true;
 }
 
+void VKTextureFinal::ReleaseRetiredImages(bool release_all)
+{
+  auto is_released = [this, release_all](const RetiredImage& retired)
+  {
+    if (!release_all && (retired.frame_number > m_frame_number))
+      return false;
+
+    vkDestroyImageView(m_device, retired.view, nullptr);
+    vkDestroyImage(m_device, retired.image, nullptr);
+    vkFreeMemory(m_device, retired.memory, nullptr);
+    return true;
+  };
+  m_retired_images.erase(std::remove_if(m_retired_images.begin(), m_retired_images.end(), is_released), m_retired_images.end());
+}
+
+VkImageView VKTextureFinal::GetTextureView()
+{
+  if (!m_streamed_textures.empty() && (m_streamed_textures[0]->view != VK_NULL_HANDLE))
+    return m_streamed_textures[0]->view;
+
+  return m_texture_view;
+}
+
 bool VKTextureFinal::CreateUniformBuffer()
 {
   m_uniform_buffer_info.size = 16 * sizeof(float);
@@ -724,7 +1771,7 @@ bool VKTextureFinal::CopyUniformBufferData()
   vkUnmapMemory(m_device, m_staging_buffer_info.memory); // consider not unmapping for future use
 
   // Prepare command buffer to copy data from staging buffer to a uniform buffer
-  VkCommandBuffer command_buffer = m_virtual_frames[0].command_buffer;
+  VkCommandBuffer command_buffer = m_upload_command_buffer;
 
   VkCommandBufferBeginInfo command_buffer_begin_info = {
     VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, // VkStructureType
@@ -740,44 +1787,29 @@ bool VKTextureFinal::CopyUniformBufferData()
     0,                         // dstOffset
     m_uniform_buffer_info.size // size
   };
-  vkCmdCopyBuffer(command_buffer, m_staging_buffer, m_uniform_buffer, 1, &buffer_copy_info);
 
-  VkBufferMemoryBarrier buffer_memory_barrier = {
-    VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, // VkStructureType
-    nullptr,                                 // pNext
-    VK_ACCESS_TRANSFER_WRITE_BIT,            // srcAccessMask
-    VK_ACCESS_UNIFORM_READ_BIT,              // dstAccessMask
-    VK_QUEUE_FAMILY_IGNORED,                 // srcQueueFamilyIndex
-    VK_QUEUE_FAMILY_IGNORED,                 // dstQueueFamilyIndex
-    m_uniform_buffer,                        // buffer
-    0,                                       // offset
-    VK_WHOLE_SIZE                            // size
-  };
-  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, 1, &buffer_memory_barrier, 0, nullptr);
+  // only ever copied after a device wait, nothing earlier is left to wait for
+  m_upload_graph.Reset(m_graphics_queue_family_index);
+  RenderGraph::Resource uniform = m_upload_graph.ImportBuffer(m_uniform_buffer, 0, VK_WHOLE_SIZE, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
+  RenderGraph::Pass copy = m_upload_graph.AddPass("uniform buffer", [&](VkCommandBuffer command_buffer)
+  {
+    vkCmdCopyBuffer(command_buffer, m_staging_buffer, m_uniform_buffer, 1, &buffer_copy_info);
+  });
+  m_upload_graph.Read(copy, ImportStagingBuffer(m_upload_graph, m_staging_buffer), RenderUsage::TransferRead);
+  m_upload_graph.Write(copy, uniform, RenderUsage::TransferWrite);
+  m_upload_graph.Export(uniform, RenderUsage::UniformRead);
 
-  vkEndCommandBuffer(command_buffer);
+  m_upload_graph.Compile();
+  m_upload_graph.Execute(command_buffer, vkCmdPipelineBarrier);
 
-  // Submit command buffer and copy data from staging buffer to a vertex buffer
-  VkSubmitInfo submit_info = {
-    VK_STRUCTURE_TYPE_SUBMIT_INFO,                      // VkStructureType                        sType
-    nullptr,                                            // const void                            *pNext
-    0,                                                  // uint32_t                               waitSemaphoreCount
-    nullptr,                                            // const VkSemaphore                     *pWaitSemaphores
-    nullptr,                                            // const VkPipelineStageFlags            *pWaitDstStageMask;
-    1,                                                  // uint32_t                               commandBufferCount
-    &command_buffer,                                    // const VkCommandBuffer                 *pCommandBuffers
-    0,                                                  // uint32_t                               signalSemaphoreCount
-    nullptr                                             // const VkSemaphore                     *pSignalSemaphores
-  };
+  vkEndCommandBuffer(command_buffer);
 
-  if (vkQueueSubmit(m_graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
-  {
-    assert("Graphics queue submit failed!", "Vulkan", Assert::Error);
+  // the staging buffer and command buffer are reused by the next upload
+  uint64_t upload_value;
+  if (!SubmitToTimeline(m_graphics_timeline, command_buffer, {}, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, upload_value))
     return false;
-  }
 
-  vkDeviceWaitIdle(m_device); // consider using fences & semaphores
-  return true;
+  return WaitTimeline(m_graphics_timeline, upload_value);
 }
 
 bool VKTextureFinal::CreateDescriptorSetLayout()
@@ -821,21 +1853,21 @@ bool VKTextureFinal::CreateDescriptorPool()
   VkDescriptorPoolSize pool_sizes[2] = {
     {
       VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // VkDescriptorType
-      1                                          // descriptorCount
+      m_max_virtual_frames + m_max_atlas_pages   // descriptorCount
     },
     {
       VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-      1
+      m_max_virtual_frames + m_max_atlas_pages
     }
   };
 
   VkDescriptorPoolCreateInfo descriptor_pool_create_info = {
-    VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,  // VkStructureType
-    nullptr,                                        // pNext
-    0,                                              // VkDescriptorPoolCreateFlags
-    1,                                              // maxSets
-    2,                                              // poolSizeCount
-    pool_sizes                                      // pPoolSizes
+    VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,      // VkStructureType
+    nullptr,                                            // pNext
+    VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,  // VkDescriptorPoolCreateFlags
+    m_max_virtual_frames + m_max_atlas_pages,           // maxSets
+    2,                                                  // poolSizeCount
+    pool_sizes                                          // pPoolSizes
   };
 
   if (vkCreateDescriptorPool(m_device, &descriptor_pool_create_info, nullptr, &m_descriptor_pool) != VK_SUCCESS)
@@ -857,20 +1889,37 @@ bool VKTextureFinal::AllocateDescriptorSet()
     &m_descriptor_set_layout                        // pSetLayouts
   };
 
-  if (vkAllocateDescriptorSets(m_device, &descriptor_set_allocate_info, &m_descriptor_set) != VK_SUCCESS)
-  {
-    assert("Could not allocate descriptor set!", "Vulkan", Assert::Error);
-    return false;
-  }
-
+  // the frames allocate theirs in CreateVirtualFrame, they come and go with the frame count
+  for (VkDescriptorSet& atlas_descriptor_set : m_atlas_descriptor_sets)
+    if (vkAllocateDescriptorSets(m_device, &descriptor_set_allocate_info, &atlas_descriptor_set) != VK_SUCCESS)
+    {
+      assert("Could not allocate descriptor set!", "Vulkan", Assert::Error);
+      return false;
+    }
+
   return true;
 }
 
 bool VKTextureFinal::UpdateDescriptorSet()
+{
+  for (VirtualFrame& virtual_frame : m_virtual_frames)
+    UpdateDescriptorSet(virtual_frame);
+
+  return true;
+}
+
+void VKTextureFinal::UpdateDescriptorSet(VirtualFrame& virtual_frame)
+{
+  // streaming swaps the image view, only the set of a frame that has finished may be rewritten
+  virtual_frame.descriptor_texture_view = GetTextureView();
+  WriteDescriptorSet(virtual_frame.descriptor_set, virtual_frame.descriptor_texture_view);
+}
+
+void VKTextureFinal::WriteDescriptorSet(VkDescriptorSet descriptor_set, VkImageView image_view)
 {
   VkDescriptorImageInfo image_info = {
     m_texture_sampler,                       // VkSampler
-    m_texture_view,                          // VkImageView
+    image_view,                              // VkImageView
     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL // VkImageLayout
   };
 
@@ -884,7 +1933,7 @@ bool VKTextureFinal::UpdateDescriptorSet()
     {
       VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,    // VkStructureType
       nullptr,                                   // pNext
-      m_descriptor_set,                          // dstSet
+      descriptor_set,                            // dstSet
       0,                                         // dstBinding
       0,                                         // dstArrayElement
       1,                                         // descriptorCount
@@ -896,7 +1945,7 @@ bool VKTextureFinal::UpdateDescriptorSet()
     {
       VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
       nullptr,                               
-      m_descriptor_set,
+      descriptor_set,
       1,                                     
       0,                                     
       1,                                     
@@ -908,32 +1957,42 @@ bool VKTextureFinal::UpdateDescriptorSet()
   };
 
   vkUpdateDescriptorSets(m_device, 2, descriptor_writes, 0, nullptr);
-  return true;
 }
 
 bool VKTextureFinal::CopyVertexData()
 {
+  return CopyBufferData(m_vertex_data, m_vertex_buffer_info.size, m_vertex_buffer, RenderUsage::VertexBuffer);
+}
+
+bool VKTextureFinal::CopyBufferData(const void* data, VkDeviceSize size, VkBuffer buffer, RenderUsage usage)
+{
+  if (size > m_staging_buffer_info.size)
+  {
+    assert("Buffer data does not fit into the staging buffer!", "Vulkan", Assert::Error);
+    return false;
+  }
+
   void* staging_buffer_memory_pointer;
-  if (vkMapMemory(m_device, m_staging_buffer_info.memory, 0, m_vertex_buffer_info.size, 0, &staging_buffer_memory_pointer) != VK_SUCCESS)
+  if (vkMapMemory(m_device, m_staging_buffer_info.memory, 0, size, 0, &staging_buffer_memory_pointer) != VK_SUCCESS)
   {
     assert("Could not map memory!", "Vulkan", Assert::Error);
     return false;
   }
 
-  memcpy(staging_buffer_memory_pointer, m_vertex_data, m_vertex_buffer_info.size);
+  memcpy(staging_buffer_memory_pointer, data, static_cast<size_t>(size));
 
   VkMappedMemoryRange flush_range = {
     VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, // VkStructureType
     nullptr,                               // pNext
     m_staging_buffer_info.memory,          // memory
     0,                                     // offset
-    m_vertex_buffer_info.size              // size
+    size                                   // size
   };
   vkFlushMappedMemoryRanges(m_device, 1, &flush_range);
 
   vkUnmapMemory(m_device, m_staging_buffer_info.memory);
 
-  // Prepare command buffer to copy data from staging buffer to a vertex buffer
+  // Prepare command buffer to copy data from staging buffer to the target buffer
   VkCommandBufferBeginInfo command_buffer_begin_info = {
     VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, // VkStructureType
     nullptr,                                     // pNext
@@ -941,56 +2000,243 @@ bool VKTextureFinal::CopyVertexData()
     nullptr                                      // pInheritanceInfo
   };
 
-  VkCommandBuffer command_buffer = m_virtual_frames[0].command_buffer;
+  VkCommandBuffer command_buffer = m_upload_command_buffer;
 
   vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
 
   VkBufferCopy buffer_copy_info = {
     0,                        // srcOffset
     0,                        // dstOffset
-    m_vertex_buffer_info.size // size
+    size                      // size
   };
-  vkCmdCopyBuffer(command_buffer, m_staging_buffer, m_vertex_buffer, 1, &buffer_copy_info);
 
-  VkBufferMemoryBarrier buffer_memory_barrier = {
-    VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, // VkStructureType
-    nullptr,                                 // pNext
-    VK_ACCESS_MEMORY_WRITE_BIT,              // srcAccessMask
-    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,     // dstAccessMask
-    VK_QUEUE_FAMILY_IGNORED,                 // srcQueueFamilyIndex
-    VK_QUEUE_FAMILY_IGNORED,                 // dstQueueFamilyIndex
-    m_vertex_buffer,                         // buffer
-    0,                                       // offset
-    VK_WHOLE_SIZE                            // size
-  };
-  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &buffer_memory_barrier, 0, nullptr);
+  m_upload_graph.Reset(m_graphics_queue_family_index);
+  RenderGraph::Resource target = m_upload_graph.ImportBuffer(buffer, 0, VK_WHOLE_SIZE, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
+  RenderGraph::Pass copy = m_upload_graph.AddPass("buffer", [&](VkCommandBuffer command_buffer)
+  {
+    vkCmdCopyBuffer(command_buffer, m_staging_buffer, buffer, 1, &buffer_copy_info);
+  });
+  m_upload_graph.Read(copy, ImportStagingBuffer(m_upload_graph, m_staging_buffer), RenderUsage::TransferRead);
+  m_upload_graph.Write(copy, target, RenderUsage::TransferWrite);
+  m_upload_graph.Export(target, usage);
+
+  m_upload_graph.Compile();
+  m_upload_graph.Execute(command_buffer, vkCmdPipelineBarrier);
 
   vkEndCommandBuffer(command_buffer);
 
-  // Submit command buffer and copy data from staging buffer to a vertex buffer
-  VkSubmitInfo submit_info = {
-    VK_STRUCTURE_TYPE_SUBMIT_INFO, // VkStructureType
-    nullptr,                       // pNext
-    0,                             // waitSemaphoreCount
-    nullptr,                       // pWaitSemaphores
-    nullptr,                       // pWaitDstStageMask
-    1,                             // commandBufferCount
-    &command_buffer,               // pCommandBuffers
-    0,                             // signalSemaphoreCount
-    nullptr                        // pSignalSemaphores
-  };
+  // the staging buffer and command buffer are reused by the next upload
+  uint64_t upload_value;
+  if (!SubmitToTimeline(m_graphics_timeline, command_buffer, {}, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, upload_value))
+    return false;
+
+  return WaitTimeline(m_graphics_timeline, upload_value);
+}
+
+bool VKTextureFinal::CreateSpriteBuffers()
+{
+  // quads share one static index buffer, 4 vertices and 6 indices per sprite
+  std::vector<uint32_t> indices(static_cast<size_t>(m_max_sprites) * 6);
+  for (uint32_t i = 0; i < m_max_sprites; ++i)
+  {
+    uint32_t* quad = &indices[static_cast<size_t>(i) * 6];
+    quad[0] = i * 4 + 0;
+    quad[1] = i * 4 + 1;
+    quad[2] = i * 4 + 2;
+    quad[3] = i * 4 + 2;
+    quad[4] = i * 4 + 1;
+    quad[5] = i * 4 + 3;
+  }
+
+  m_sprite_index_buffer_info.size = indices.size() * sizeof(uint32_t);
+  m_sprite_index_buffer_info.count = static_cast<uint32_t>(indices.size());
+  if (!CreateBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_sprite_index_buffer, m_sprite_index_buffer_info))
+    return false;
+
+  if (!CopyBufferData(indices.data(), m_sprite_index_buffer_info.size, m_sprite_index_buffer, RenderUsage::IndexBuffer))
+    return false;
+
+  // sprites blend over the scene, the fallback reads VertexData so they aren't drawn until their own pipeline is compiled
+  PipelineDescription sprite_pipeline_description;
+  sprite_pipeline_description.vertex_shader = "t6/t6.vert";
+  sprite_pipeline_description.fragment_shader = "t6/t6.frag";
+  sprite_pipeline_description.state.vertex_layout = GetSpriteVertexLayout();
+  sprite_pipeline_description.state.blend_enable = VK_TRUE;
+  m_sprite_pipeline = RequestPipeline(sprite_pipeline_description);
+
+  return true;
+}
+
+bool VKTextureFinal::LoadSpriteImages(const std::vector<std::string>& file_names)
+{
+  std::vector<std::vector<char>> image_data(file_names.size());
+  std::vector<AtlasImage>        images(file_names.size());
+  std::atomic<bool>              decoded(true);
+
+  threadPool.ParallelFor(file_names.size(), [&](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      image_data[i] = read_image(file_names[i], 4, &images[i].width, &images[i].height, nullptr, nullptr);
+      images[i].rgba = image_data[i].data();
+      if (image_data[i].empty())
+        decoded = false;
+    }
+  });
+
+  if (!decoded)
+  {
+    assert("Could not load sprite image!", "Vulkan", Assert::Error);
+    return false;
+  }
+
+  std::vector<AtlasPage>   pages;
+  std::vector<AtlasRegion> regions;
+  if (!build_atlas(images, m_atlas_page_size, 1, pages, regions))
+  {
+    assert("Sprite image does not fit into an atlas page!", "Vulkan", Assert::Error);
+    return false;
+  }
 
-  if (vkQueueSubmit(m_graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+  if (pages.size() > m_max_atlas_pages)
   {
-    assert("Failed to submit buffer staging command buffer!", "Vulkan", Assert::Error);
+    assert("Sprite images need more atlas pages than available!", "Vulkan", Assert::Error);
     return false;
   }
 
-  vkDeviceWaitIdle(m_device); // using a fence is a better option
+  // old pages may still be sampled by frames in flight
+  vkDeviceWaitIdle(m_device);
+  DestroyAtlasPages();
+  m_sprites.clear();
+  m_previous_sprites.clear();
+  InvalidateStaticCommandBuffers(); // the atlas descriptor sets get rewritten
+
+  for (size_t i = 0; i < pages.size(); ++i)
+  {
+    AtlasPageTexture page = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE };
+    uint32_t width = static_cast<uint32_t>(pages[i].width);
+    uint32_t height = static_cast<uint32_t>(pages[i].height);
+
+    if (!CreateImage(width, height, 1, VK_FORMAT_R8G8B8A8_UNORM, &page.image))
+    {
+      assert("Could not create atlas page image!", "Vulkan", Assert::Error);
+      return false;
+    }
+    m_image_states.Track(page.image, 1);
+    m_atlas_pages.push_back(page);
+
+    if (!AllocateImageMemory(page.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_atlas_pages.back().memory))
+      return false;
+
+    if (vkBindImageMemory(m_device, page.image, m_atlas_pages.back().memory, 0) != VK_SUCCESS)
+    {
+      assert("Could not bind memory to an image!", "Vulkan", Assert::Error);
+      return false;
+    }
+
+    if (!CreateImageView(page.image, VK_FORMAT_R8G8B8A8_UNORM, 1, &m_atlas_pages.back().view))
+    {
+      assert("Could not create image view!", "Vulkan", Assert::Error);
+      return false;
+    }
+
+    if (!CopyTextureData(page.image, pages[i].rgba.data(), width, height))
+      return false;
+
+    WriteDescriptorSet(m_atlas_descriptor_sets[i], m_atlas_pages.back().view);
+  }
+
+  m_sprite_regions = std::move(regions);
+  m_sprite_page_offsets.resize(m_atlas_pages.size() + 1);
 
+  std::vector<float> region_uvs;
+  region_uvs.reserve(m_sprite_regions.size() * 4);
+  for (const AtlasRegion& region : m_sprite_regions)
+    region_uvs.insert(region_uvs.end(), { region.u0, region.v0, region.u1, region.v1 });
+  m_sprite_region_uvs.resize(region_uvs.size());
+  float_to_unorm16(region_uvs.data(), m_sprite_region_uvs.data(), region_uvs.size());
   return true;
 }
 
+void VKTextureFinal::DestroyAtlasPages()
+{
+  for (AtlasPageTexture& page : m_atlas_pages)
+  {
+    if (page.view != VK_NULL_HANDLE)
+      vkDestroyImageView(m_device, page.view, nullptr);
+    if (page.image != VK_NULL_HANDLE)
+      vkDestroyImage(m_device, page.image, nullptr);
+    m_image_states.Forget(page.image);
+    if (page.memory != VK_NULL_HANDLE)
+      vkFreeMemory(m_device, page.memory, nullptr);
+  }
+  m_atlas_pages.clear();
+  m_sprite_regions.clear();
+  m_sprite_region_uvs.clear();
+}
+
+void VKTextureFinal::DrawSprite(uint32_t image, float x, float y, float width, float height)
+{
+  if ((image >= m_sprite_regions.size()) || (m_sprites.size() >= m_max_sprites))
+    return;
+
+  // static frames compare as the sprites come in, so finding out nothing changed never takes a pass of its own
+  Sprite sprite = { image, x, y, width, height };
+  size_t index = m_sprites.size();
+  if (m_static_command_buffers_enabled && !m_sprites_changed &&
+    ((index >= m_previous_sprites.size()) || (memcmp(&m_previous_sprites[index], &sprite, sizeof(Sprite)) != 0)))
+    m_sprites_changed = true;
+
+  m_sprites.push_back(sprite);
+}
+
+void VKTextureFinal::WriteSpriteVertices(VirtualFrame& virtual_frame)
+{
+  m_sprite_draws.clear();
+  if (m_sprites.empty())
+    return;
+
+  // counting sort by page, every quad is written straight to its final place in the mapped buffer
+  std::fill(m_sprite_page_offsets.begin(), m_sprite_page_offsets.end(), 0);
+  for (const Sprite& sprite : m_sprites)
+    ++m_sprite_page_offsets[m_sprite_regions[sprite.image].page + 1];
+
+  for (size_t page = 0; page < m_atlas_pages.size(); ++page)
+  {
+    uint32_t sprite_count = m_sprite_page_offsets[page + 1];
+    m_sprite_page_offsets[page + 1] += m_sprite_page_offsets[page];
+
+    if (sprite_count > 0)
+      m_sprite_draws.push_back({ static_cast<uint32_t>(page), m_sprite_page_offsets[page], sprite_count });
+  }
+
+  for (const Sprite& sprite : m_sprites)
+  {
+    const AtlasRegion& region = m_sprite_regions[sprite.image];
+    const Unorm16* uv = &m_sprite_region_uvs[static_cast<size_t>(sprite.image) * 4];
+    SpriteVertex* quad = virtual_frame.sprite_vertices + static_cast<size_t>(m_sprite_page_offsets[region.page]++) * 4;
+
+    float right = sprite.x + sprite.width;
+    float bottom = sprite.y + sprite.height;
+
+    // same winding as m_vertex_data, the pipeline culls back faces
+    quad[0] = { { sprite.x, sprite.y }, { uv[0], uv[1] } };
+    quad[1] = { { sprite.x, bottom }, { uv[0], uv[3] } };
+    quad[2] = { { right, sprite.y }, { uv[2], uv[1] } };
+    quad[3] = { { right, bottom }, { uv[2], uv[3] } };
+  }
+
+  // whole size keeps the range valid for any nonCoherentAtomSize
+  VkMappedMemoryRange flush_range = {
+    VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,          // VkStructureType
+    nullptr,                                        // pNext
+    virtual_frame.sprite_vertex_buffer_info.memory, // VkDeviceMemory
+    0,                                              // offset
+    VK_WHOLE_SIZE                                   // size
+  };
+  vkFlushMappedMemoryRanges(m_device, 1, &flush_range);
+}
+
 bool VKTextureFinal::OnWindowSizeChanged()
 {
   Clear();
@@ -998,12 +2244,20 @@ bool VKTextureFinal::OnWindowSizeChanged()
   if (!CreateSwapChain())
     return false;
 
-  if (m_swap_chain != VK_NULL_HANDLE)
+  // pipelines use dynamic viewports, only a new swap chain format needs a new render pass and pipelines
+  if ((m_swap_chain != VK_NULL_HANDLE) && ((m_render_pass == VK_NULL_HANDLE) || (m_render_pass_format != m_swap_chain_info.format)))
   {
+    DestroyPipelines();
+    if (m_render_pass != VK_NULL_HANDLE)
+    {
+      vkDestroyRenderPass(m_device, m_render_pass, nullptr);
+      m_render_pass = VK_NULL_HANDLE;
+    }
+
     if (!CreateRenderPass())
       return false;
 
-    if (!CreatePipeline())
+    if (!CreatePipelines())
       return false;
   }
 
@@ -1024,6 +2278,8 @@ void VKTextureFinal::Clear()
     vkDeviceWaitIdle(m_device);
 
     // release swap chain images and its related
+    for (VkImage image : m_swap_chain_info.images)
+      m_image_states.Forget(image);
     m_swap_chain_info.images.clear();
 
     for (size_t i = 0; i < m_swap_chain_info.image_views.size(); ++i)
@@ -1031,23 +2287,11 @@ void VKTextureFinal::Clear()
         vkDestroyImageView(m_device, m_swap_chain_info.image_views[i], nullptr);
     m_swap_chain_info.image_views.clear();
 
-    if (m_pipeline_layout != VK_NULL_HANDLE)
-    {
-      vkDestroyPipelineLayout(m_device, m_pipeline_layout, nullptr);
-      m_pipeline_layout = VK_NULL_HANDLE;
-    }
-
-    if (m_pipeline != VK_NULL_HANDLE)
-    {
-      vkDestroyPipeline(m_device, m_pipeline, nullptr);
-      m_pipeline = VK_NULL_HANDLE;
-    }
-
-    if (m_render_pass != VK_NULL_HANDLE)
-    {
-      vkDestroyRenderPass(m_device, m_render_pass, nullptr);
-      m_render_pass = VK_NULL_HANDLE;
-    }
+    for (VkFramebuffer frame_buffer : m_static_frame_buffers)
+      if (frame_buffer != VK_NULL_HANDLE)
+        vkDestroyFramebuffer(m_device, frame_buffer, nullptr);
+    m_static_frame_buffers.clear();
+    InvalidateStaticCommandBuffers();
   }
 }
 
@@ -1112,6 +2356,11 @@ bool VKTextureFinal::CreateSwapChain()
   if ((desired_extent.width == 0) || (desired_extent.height == 0))
     return true;
 
+  // with separate present and graphics families the images are shared by both, so presenting needs no ownership transfer
+  // (which would take an acquire barrier submitted on the present queue every frame)
+  uint32_t queue_family_indices[2] = { m_graphics_queue_family_index, m_present_queue_family_index };
+  bool     shared_images = m_graphics_queue_family_index != m_present_queue_family_index;
+
   VkSwapchainCreateInfoKHR swap_chain_create_info = { //peek VKFirstTriangleCreateInfoKHR for detail
     VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
     nullptr, 0,
@@ -1122,8 +2371,8 @@ bool VKTextureFinal::CreateSwapChain()
     desired_extent,
     1,
     desired_usage,
-    VK_SHARING_MODE_EXCLUSIVE, //exclusive: other queues can refer to images, but cannot do at once. (barrier feature in thread-like)
-    0, nullptr, //needed if Sharing mode is concurrent, need to sync many queues from different queue families to avoid thread-like problem
+    shared_images ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE, //exclusive: other queues can refer to images, but cannot do at once. (barrier feature in thread-like)
+    shared_images ? 2u : 0u, shared_images ? queue_family_indices : nullptr, //needed if Sharing mode is concurrent, need to sync many queues from different queue families to avoid thread-like problem
     desired_transform,
     VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
     desired_present_mode,
@@ -1160,7 +2409,10 @@ bool VKTextureFinal::CreateSwapChain()
 
   m_swap_chain_info.images.resize(image_count);
   for (size_t i = 0; i < image_count; ++i)
+  {
     m_swap_chain_info.images[i] = images[i];
+    m_image_states.Track(images[i], 1);
+  }
 
   return CreateSwapChainImageViews();
 }
@@ -1171,6 +2423,8 @@ uint32_t VKTextureFinal::GetSwapChainNumImages(VkSurfaceCapabilitiesKHR& surface
   //(ex) needs at least 2 for double buffer
 
   uint32_t image_count = surface_capabilities.minImageCount + 1; //asking for one more
+  if (m_swap_chain_image_count != 0)
+    image_count = std::max(m_swap_chain_image_count, surface_capabilities.minImageCount);
   if ((surface_capabilities.maxImageCount > 0) && (image_count > surface_capabilities.maxImageCount))
     image_count = surface_capabilities.maxImageCount;
 
@@ -1327,24 +2581,28 @@ bool VKTextureFinal::CreateSwapChainImageViews()
 
 bool VKTextureFinal::CreateRenderPass()
 {
+  // ops and layout come from the frame graph, which also does the transitions and waits around the pass
+  RenderGraph frame_graph;
+  RenderGraph::Attachment attachment = DeclareFrameGraph(frame_graph, VK_NULL_HANDLE, nullptr);
+
   VkAttachmentDescription attachment_descriptions[] = {
     {
       0,                                // VkAttachmentDescriptionFlags
       m_swap_chain_info.format,         // VkFormat
       VK_SAMPLE_COUNT_1_BIT,            // VkSampleCountFlagBits
-      VK_ATTACHMENT_LOAD_OP_CLEAR,      // loadOp
-      VK_ATTACHMENT_STORE_OP_STORE,     // storeOp
+      attachment.load_op,               // loadOp
+      attachment.store_op,              // storeOp
       VK_ATTACHMENT_LOAD_OP_DONT_CARE,  // stencilLoadOp
       VK_ATTACHMENT_STORE_OP_DONT_CARE, // stencilStoreOp
-      VK_IMAGE_LAYOUT_UNDEFINED,        // initialLayout
-      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR   // finalLayout
+      attachment.layout,                // initialLayout
+      attachment.layout                 // finalLayout
     }
   };
 
   VkAttachmentReference color_attachment_references[] = {
     {
       0,                                              // attachment
-      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL        // VkImageLayout
+      attachment.layout                               // VkImageLayout
     }
   };
 
@@ -1363,54 +2621,426 @@ bool VKTextureFinal::CreateRenderPass()
     }
   };
 
-  std::vector<VkSubpassDependency> dependencies = {
+  VkRenderPassCreateInfo render_pass_create_info = {
+    VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,        // VkStructureType
+    nullptr,                                          // pNext
+    0,                                                // VkRenderPassCreateFlags
+    1,                                                // attachmentCount
+    attachment_descriptions,                          // pAttachments
+    1,                                                // subpassCount
+    subpass_descriptions,                             // pSubpasses
+    0,                                                // dependencyCount
+    nullptr                                           // pDependencies
+  };
+
+  if (vkCreateRenderPass(m_device, &render_pass_create_info, nullptr, &m_render_pass) != VK_SUCCESS)
+  {
+    assert("Could not create render pass!", "Vulkan", Assert::Error);
+    return false;
+  }
+  m_render_pass_format = m_swap_chain_info.format;
+  return true;
+}
+
+bool VKTextureFinal::CreatePipelineCache()
+{
+  VkPipelineCacheCreateInfo pipeline_cache_create_info = {
+    VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO, // VkStructureType
+    nullptr,                                      // pNext
+    0,                                            // VkPipelineCacheCreateFlags
+    0,                                            // initialDataSize
+    nullptr                                       // pInitialData
+  };
+
+  // caches are synchronized internally, every worker builds against this one
+  if (vkCreatePipelineCache(m_device, &pipeline_cache_create_info, nullptr, &m_pipeline_cache) != VK_SUCCESS)
+  {
+    assert("Could not create pipeline cache!", "Vulkan", Assert::Error);
+    return false;
+  }
+
+  return true;
+}
+
+bool VKTextureFinal::CreatePipelines()
+{
+  static_assert(is_shader_embedded("t6/t6.vert") && is_shader_embedded("t6/t6.frag"), "t6 shaders are not embedded!");
+
+  PipelineDescription fallback_description;
+  fallback_description.vertex_shader = "t6/t6.vert";
+  fallback_description.fragment_shader = "t6/t6.frag";
+  fallback_description.state.vertex_layout = GetVertexDataLayout();
+
+  VkShaderModule vertex_shader_module = GetShaderModule(fallback_description.vertex_shader.c_str());
+  VkShaderModule fragment_shader_module = GetShaderModule(fallback_description.fragment_shader.c_str());
+
+  if (!vertex_shader_module || !fragment_shader_module)
+    return false;
+
+  m_pipeline = BuildPipeline(fallback_description, vertex_shader_module, fragment_shader_module, m_render_pass, m_pipeline_layout);
+  if (m_pipeline == VK_NULL_HANDLE)
+    return false;
+
+  // keys carry the render pass format, which just changed for all of them alike
+  m_pipeline_ids.clear();
+  for (size_t i = 0; i < m_pipeline_builds.size(); ++i)
+  {
+    PipelineKey key;
+    if (GetPipelineKey(m_pipeline_builds[i]->description, key))
+      m_pipeline_ids.emplace(key, static_cast<PipelineId>(i));
+    StartPipelineBuild(*m_pipeline_builds[i]);
+  }
+
+  // the background draws with a requested copy of the fallback, so a shader reload rebuilds and swaps it too
+  // it's part of the warm-up, not a miss, and later calls find it under the key it was just given
+  bool record_pipeline_misses = m_record_pipeline_misses;
+  m_record_pipeline_misses = false;
+  m_background_pipeline = RequestPipeline(fallback_description);
+  m_record_pipeline_misses = record_pipeline_misses;
+
+  // everything known is compiling in parallel now, frames only start once it's done,
+  // so the first frame draws with the same pipelines as every later one
+  auto begin = std::chrono::high_resolution_clock::now();
+  WaitForPipelineBuilds();
+  std::chrono::duration<double, std::milli> milliseconds = std::chrono::high_resolution_clock::now() - begin;
+  OutputDebugString(("Warmed up " + std::to_string(m_pipeline_builds.size()) + " pipelines in " + std::to_string(milliseconds.count()) + " ms\n").c_str());
+
+  return true;
+}
+
+bool VKTextureFinal::LoadPipelineManifest()
+{
+  // a missing manifest is fine, it fills up with whatever gets requested later
+  std::vector<PipelineDescription> descriptions;
+  load_pipeline_manifest(m_pipeline_manifest, descriptions);
+  for (const PipelineDescription& description : descriptions)
+    RequestPipeline(description);
+
+  m_record_pipeline_misses = true;
+  return true;
+}
+
+VertexLayout VKTextureFinal::GetVertexDataLayout()
+{
+  // built by the compiler, the shader check reads the embedded SPIR-V so a mismatch fails the build
+  constexpr VertexLayout vertex_layout = make_vertex_layout<VertexData>(m_vertex_data_attributes);
+  static_assert(vertex_layout_matches_spirv(vertex_layout, find_embedded_shader("t6/t6.vert")->code, find_embedded_shader("t6/t6.vert")->size / sizeof(uint32_t)),
+    "VertexData does not match the inputs of t6.vert!");
+  return vertex_layout;
+}
+
+VertexLayout VKTextureFinal::GetSpriteVertexLayout()
+{
+  constexpr VertexLayout vertex_layout = make_vertex_layout<SpriteVertex>(m_sprite_vertex_attributes);
+  static_assert(vertex_layout_matches_spirv(vertex_layout, find_embedded_shader("t6/t6.vert")->code, find_embedded_shader("t6/t6.vert")->size / sizeof(uint32_t)),
+    "SpriteVertex does not match the inputs of t6.vert!");
+  return vertex_layout;
+}
+
+bool VKTextureFinal::GetPipelineKey(const PipelineDescription& description, PipelineKey& key)
+{
+  key = PipelineKey();
+  if (!GetShaderModule(description.vertex_shader.c_str(), &key.vertex_shader_hash) ||
+    !GetShaderModule(description.fragment_shader.c_str(), &key.fragment_shader_hash))
+    return false;
+
+  key.state = description.state;
+  normalize_pipeline_state(key.state);
+  key.vertex_constants = description.vertex_constants;
+  key.fragment_constants = description.fragment_constants;
+  key.color_format = m_render_pass_format;
+  key.samples = VK_SAMPLE_COUNT_1_BIT;
+  key.subpass = 0;
+  return true;
+}
+
+PipelineId VKTextureFinal::RequestPipeline(const PipelineDescription& description)
+{
+  // a description whose shaders can't be loaded is never shared, its build fails on its own
+  PipelineKey key;
+  bool has_key = GetPipelineKey(description, key);
+  if (has_key)
+  {
+    auto existing = m_pipeline_ids.find(key);
+    if (existing != m_pipeline_ids.end())
+      return existing->second;
+  }
+
+  PipelineId id = static_cast<PipelineId>(m_pipeline_builds.size());
+  m_pipeline_builds.emplace_back(new PipelineBuild{ description, std::shared_future<VkPipeline>(), VK_NULL_HANDLE, std::shared_future<VkPipeline>() });
+  if (has_key)
+    m_pipeline_ids.emplace(key, id);
+
+  // this one compiles while frames are running and draws with the fallback until it's done
+  if (has_key && m_record_pipeline_misses)
+  {
+    OutputDebugString(("Pipeline " + description.vertex_shader + " + " + description.fragment_shader + " was not warmed up, adding it to " + m_pipeline_manifest + "\n").c_str());
+    append_pipeline_manifest(m_pipeline_manifest, description);
+  }
+
+  // without a render pass the build starts with CreatePipelines
+  if (m_render_pass != VK_NULL_HANDLE)
+    StartPipelineBuild(*m_pipeline_builds.back());
+
+  return id;
+}
+
+std::shared_future<VkPipeline> VKTextureFinal::GetPipelineFuture(PipelineId id) const
+{
+  if (id >= m_pipeline_builds.size())
+    return std::shared_future<VkPipeline>();
+  return m_pipeline_builds[id]->future;
+}
+
+void VKTextureFinal::StartPipelineBuild(PipelineBuild& build)
+{
+  build.pipeline = VK_NULL_HANDLE;
+  build.future = SubmitPipelineBuild(build.description);
+}
+
+std::shared_future<VkPipeline> VKTextureFinal::SubmitPipelineBuild(const PipelineDescription& description)
+{
+  // shader modules come from the main thread's cache, workers only see handles
+  VkShaderModule vertex_shader_module = GetShaderModule(description.vertex_shader.c_str());
+  VkShaderModule fragment_shader_module = GetShaderModule(description.fragment_shader.c_str());
+  if (!vertex_shader_module || !fragment_shader_module)
+  {
+    std::promise<VkPipeline> failed;
+    failed.set_value(VK_NULL_HANDLE);
+    return failed.get_future().share();
+  }
+
+  VkRenderPass render_pass = m_render_pass;
+  VkPipelineLayout pipeline_layout = m_pipeline_layout;
+  return threadPool.Submit([=]()
+  {
+    return BuildPipeline(description, vertex_shader_module, fragment_shader_module, render_pass, pipeline_layout);
+  }).share();
+}
+
+void VKTextureFinal::ReloadShaders()
+{
+  std::vector<ShaderWatcher::ChangedShader> changes;
+  if (!shaderWatcher.TakeChanges(changes))
+    return;
+
+  // the new code takes the name over from the embedded copy, saving without a change rebuilds nothing
+  // the old module is only let go once the new one is in, a rejected shader leaves the name as it was
+  std::vector<std::string> reloaded;
+  for (ShaderWatcher::ChangedShader& changed : changes)
+  {
+    size_t size = changed.code.size() * sizeof(uint32_t);
+    auto file = m_shader_module_files.find(changed.name);
+    bool had_module = file != m_shader_module_files.end();
+    uint64_t old_content_hash = had_module ? file->second.content_hash : 0;
+    if (had_module && (old_content_hash == hash_bytes(changed.code.data(), size)))
+      continue;
+
+    // the embedded copies are checked against their vertex layouts at compile time, reloaded ones here
+    bool layouts_match = true;
+    for (const std::unique_ptr<PipelineBuild>& build : m_pipeline_builds)
+      if ((build->description.vertex_shader == changed.name) &&
+        !vertex_layout_matches_spirv(build->description.state.vertex_layout, changed.code.data(), changed.code.size()))
+        layouts_match = false;
+    if (!layouts_match)
+    {
+      OutputDebugString((changed.name + ": inputs don't match the vertex layout of its pipelines, keeping the old shader\n").c_str());
+      continue;
+    }
+
+    if (AddShaderModule(changed.name.c_str(), changed.code.data(), size, 0) == nullptr)
+      continue;
+    if (had_module)
+      ReleaseShaderModule(old_content_hash);
+    reloaded.push_back(changed.name);
+  }
+
+  if (reloaded.empty())
+    return;
+
+  // builds that haven't started for lack of a render pass pick the new modules up when they do
+  for (std::unique_ptr<PipelineBuild>& build : m_pipeline_builds)
+  {
+    bool uses_reloaded = std::find(reloaded.begin(), reloaded.end(), build->description.vertex_shader) != reloaded.end() ||
+      std::find(reloaded.begin(), reloaded.end(), build->description.fragment_shader) != reloaded.end();
+    if (!uses_reloaded || !build->future.valid())
+      continue;
+
+    if (build->replacement.valid())
+      m_discarded_pipeline_builds.push_back(build->replacement);
+    build->replacement = SubmitPipelineBuild(build->description);
+  }
+
+  // shader hashes are part of the keys
+  m_pipeline_ids.clear();
+  for (size_t i = 0; i < m_pipeline_builds.size(); ++i)
+  {
+    PipelineKey key;
+    if (GetPipelineKey(m_pipeline_builds[i]->description, key))
+      m_pipeline_ids.emplace(key, static_cast<PipelineId>(i));
+  }
+}
+
+// called at the start of a frame, before anything is recorded, so a frame never mixes old and new pipelines
+void VKTextureFinal::SwapReloadedPipelines()
+{
+  auto is_ready = [](const std::shared_future<VkPipeline>& future)
+  {
+    return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  };
+
+  for (std::unique_ptr<PipelineBuild>& build : m_pipeline_builds)
+  {
+    if (!build->replacement.valid() || !is_ready(build->replacement))
+      continue;
+
+    // a failed rebuild keeps the pipeline that works, the compiler or validation output says why
+    VkPipeline pipeline = build->replacement.get();
+    if (pipeline != VK_NULL_HANDLE)
+    {
+      if (!is_ready(build->future))
+        m_discarded_pipeline_builds.push_back(build->future);
+      else if (build->future.get() != VK_NULL_HANDLE)
+        m_retired_pipelines.push_back({ build->future.get(), m_frame_number + m_virtual_frames_count });
+
+      build->future = build->replacement;
+      build->pipeline = pipeline;
+    }
+    build->replacement = std::shared_future<VkPipeline>();
+  }
+
+  // nothing was ever drawn with these
+  auto is_destroyed = [this, &is_ready](const std::shared_future<VkPipeline>& future)
+  {
+    if (!is_ready(future))
+      return false;
+
+    if (future.get() != VK_NULL_HANDLE)
+      vkDestroyPipeline(m_device, future.get(), nullptr);
+    return true;
+  };
+  m_discarded_pipeline_builds.erase(std::remove_if(m_discarded_pipeline_builds.begin(), m_discarded_pipeline_builds.end(), is_destroyed), m_discarded_pipeline_builds.end());
+}
+
+void VKTextureFinal::ReleaseRetiredPipelines(bool release_all)
+{
+  auto is_released = [this, release_all](const RetiredPipeline& retired)
+  {
+    if (!release_all && (retired.frame_number > m_frame_number))
+      return false;
+
+    vkDestroyPipeline(m_device, retired.pipeline, nullptr);
+    return true;
+  };
+  m_retired_pipelines.erase(std::remove_if(m_retired_pipelines.begin(), m_retired_pipelines.end(), is_released), m_retired_pipelines.end());
+
+  // a worker may still be compiling with a retired module, checking beats waiting here
+  if (!release_all && PipelineBuildsRunning())
+    return;
+
+  for (VkShaderModule shader_module : m_retired_shader_modules)
+    vkDestroyShaderModule(m_device, shader_module, nullptr);
+  m_retired_shader_modules.clear();
+}
+
+bool VKTextureFinal::PipelineBuildsRunning() const
+{
+  auto is_running = [](const std::shared_future<VkPipeline>& future)
+  {
+    return future.valid() && (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready);
+  };
+
+  for (const std::unique_ptr<PipelineBuild>& build : m_pipeline_builds)
+    if (is_running(build->future) || is_running(build->replacement))
+      return true;
+  for (const std::shared_future<VkPipeline>& future : m_discarded_pipeline_builds)
+    if (is_running(future))
+      return true;
+  return false;
+}
+
+VkPipeline VKTextureFinal::GetPipeline(PipelineId id, bool use_fallback)
+{
+  VkPipeline fallback = use_fallback ? m_pipeline : VK_NULL_HANDLE;
+  if (id >= m_pipeline_builds.size())
+    return fallback;
+
+  PipelineBuild& build = *m_pipeline_builds[id];
+  if ((build.pipeline == VK_NULL_HANDLE) && build.future.valid() &&
+    (build.future.wait_for(std::chrono::seconds(0)) == std::future_status::ready))
+    build.pipeline = build.future.get();
+
+  return build.pipeline != VK_NULL_HANDLE ? build.pipeline : fallback;
+}
+
+void VKTextureFinal::WaitForPipelineBuilds()
+{
+  for (std::unique_ptr<PipelineBuild>& build : m_pipeline_builds)
   {
-    VK_SUBPASS_EXTERNAL,                           // srcSubpass
-    0,                                             // dstSubpass
-    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,          // srcStageMask
-    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, // dstStageMask
-    VK_ACCESS_MEMORY_READ_BIT,                     // srcAccessMask
-    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,          // dstAccessMask
-    VK_DEPENDENCY_BY_REGION_BIT                    // VkDependencyFlags  
-  },
+    if (build->future.valid())
+      build->future.wait();
+    if (build->replacement.valid())
+      build->replacement.wait();
+  }
+  for (std::shared_future<VkPipeline>& future : m_discarded_pipeline_builds)
+    future.wait();
+}
+
+void VKTextureFinal::DestroyPipelines()
+{
+  WaitForPipelineBuilds();
+
+  for (std::unique_ptr<PipelineBuild>& build : m_pipeline_builds)
   {
-    0,                                              // srcSubpass
-    VK_SUBPASS_EXTERNAL,                            // dstSubpass
-    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,  // srcStageMask
-    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,           // dstStageMask
-    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,           // srcAccessMask
-    VK_ACCESS_MEMORY_READ_BIT,                      // dstAccessMask
-    VK_DEPENDENCY_BY_REGION_BIT                     // VkDependencyFlags
+    if (build->future.valid() && (build->future.get() != VK_NULL_HANDLE))
+      vkDestroyPipeline(m_device, build->future.get(), nullptr);
+    if (build->replacement.valid() && (build->replacement.get() != VK_NULL_HANDLE))
+      vkDestroyPipeline(m_device, build->replacement.get(), nullptr);
+    build->future = std::shared_future<VkPipeline>();
+    build->replacement = std::shared_future<VkPipeline>();
+    build->pipeline = VK_NULL_HANDLE;
   }
-  };
 
-  VkRenderPassCreateInfo render_pass_create_info = {
-    VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,        // VkStructureType
-    nullptr,                                          // pNext
-    0,                                                // VkRenderPassCreateFlags
-    1,                                                // attachmentCount
-    attachment_descriptions,                          // pAttachments
-    1,                                                // subpassCount
-    subpass_descriptions,                             // pSubpasses
-    static_cast<uint32_t>(dependencies.size()),       // dependencyCount
-    dependencies.data()                               // pDependencies
-  };
+  for (std::shared_future<VkPipeline>& future : m_discarded_pipeline_builds)
+    if (future.get() != VK_NULL_HANDLE)
+      vkDestroyPipeline(m_device, future.get(), nullptr);
+  m_discarded_pipeline_builds.clear();
+  ReleaseRetiredPipelines(true);
 
-  if (vkCreateRenderPass(m_device, &render_pass_create_info, nullptr, &m_render_pass) != VK_SUCCESS)
+  if (m_pipeline != VK_NULL_HANDLE)
   {
-    assert("Could not create render pass!", "Vulkan", Assert::Error);
-    return false;
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    m_pipeline = VK_NULL_HANDLE;
   }
-  return true;
 }
 
-bool VKTextureFinal::CreatePipeline()
+// only reads its arguments and the device, so it runs on any thread
+VkPipeline VKTextureFinal::BuildPipeline(const PipelineDescription& description, VkShaderModule vertex_shader_module, VkShaderModule fragment_shader_module, VkRenderPass render_pass, VkPipelineLayout pipeline_layout)
 {
-  VkShaderModule vertex_shader_module = CreateShaderModule("shaders/t6/t6_vert.spv");
-  VkShaderModule fragment_shader_module = CreateShaderModule("shaders/t6/t6_frag.spv");
+  // every value is one 32 bit word, so entry i reads data word i
+  const SpecializationConstants* stage_constants[2] = { &description.vertex_constants, &description.fragment_constants };
+  VkSpecializationMapEntry specialization_map_entries[2][SpecializationConstants::max_constants];
+  VkSpecializationInfo specialization_infos[2];
+  const VkSpecializationInfo* stage_specialization_infos[2];
+  for (int stage = 0; stage < 2; ++stage)
+  {
+    for (uint32_t i = 0; i < stage_constants[stage]->count; ++i)
+    {
+      specialization_map_entries[stage][i] = {
+        stage_constants[stage]->constant_ids[i],     // constantID
+        static_cast<uint32_t>(i * sizeof(uint32_t)), // offset
+        sizeof(uint32_t)                             // size
+      };
+    }
 
-  if (!vertex_shader_module || !fragment_shader_module)
-    return false;
+    specialization_infos[stage] = {
+      stage_constants[stage]->count,                    // mapEntryCount
+      specialization_map_entries[stage],                // const VkSpecializationMapEntry*
+      stage_constants[stage]->count * sizeof(uint32_t), // dataSize
+      stage_constants[stage]->values                    // const void*
+    };
+    stage_specialization_infos[stage] = stage_constants[stage]->count > 0 ? &specialization_infos[stage] : nullptr;
+  }
 
   VkPipelineShaderStageCreateInfo shader_stage_create_infos[2] = {
     // Vertex shader
@@ -1421,7 +3051,7 @@ bool VKTextureFinal::CreatePipeline()
       VK_SHADER_STAGE_VERTEX_BIT,                          // VkShaderStageFlagBits
       vertex_shader_module,                                // VkShaderModule
       "main",                                              // pName
-      nullptr                                              // const VkSpecializationInfo
+      stage_specialization_infos[0]                        // const VkSpecializationInfo
     },
     // Fragment shader
     {
@@ -1431,48 +3061,27 @@ bool VKTextureFinal::CreatePipeline()
       VK_SHADER_STAGE_FRAGMENT_BIT,                        // VkShaderStageFlagBits
       fragment_shader_module,                              // VkShaderModule
       "main",                                              // pName
-      nullptr                                              // const VkSpecializationInfo
-    }
-  };
-
-  VkVertexInputBindingDescription vertex_binding_descriptions[1] = {
-    {
-      0,                          // binding
-      sizeof(VertexData),         // stride
-      VK_VERTEX_INPUT_RATE_VERTEX // VkVertexInputRate
+      stage_specialization_infos[1]                        // const VkSpecializationInfo
     }
   };
 
-  VkVertexInputAttributeDescription vertex_attribute_descriptions[2] = {
-    {
-      0,                                      // location
-      vertex_binding_descriptions[0].binding, // binding
-      VK_FORMAT_R32G32B32A32_SFLOAT,          // format
-      offsetof(struct VertexData, x)          // offset
-    },
-    {
-      1,
-      vertex_binding_descriptions[0].binding,
-      VK_FORMAT_R32G32_SFLOAT,
-      offsetof(struct VertexData, u)
-    }
-  };
+  const PipelineState& state = description.state;
 
   VkPipelineVertexInputStateCreateInfo vertex_input_state_create_info = {
       VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO, // VkStructureType
       nullptr,                                                   // pNext
       0,                                                         // VkPipelineVertexInputStateCreateFlags
-      1,                                                         // vertexBindingDescriptionCount
-      vertex_binding_descriptions,                               // const VkVertexInputBindingDescription*
-      2,                                                         // vertexAttributeDescriptionCount
-      vertex_attribute_descriptions                              // const VkVertexInputAttributeDescription*
+      state.vertex_layout.binding_count,                         // vertexBindingDescriptionCount
+      state.vertex_layout.bindings,                              // const VkVertexInputBindingDescription*
+      state.vertex_layout.attribute_count,                       // vertexAttributeDescriptionCount
+      state.vertex_layout.attributes                             // const VkVertexInputAttributeDescription*
   };
 
   VkPipelineInputAssemblyStateCreateInfo input_assembly_state_create_info = {
     VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO, // VkStructureType
     nullptr,                                                     // pNext
     0,                                                           // VkPipelineInputAssemblyStateCreateFlags
-    VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,                         // VkPrimitiveTopology
+    state.topology,                                              // VkPrimitiveTopology
     VK_FALSE                                                     // primitiveRestartEnable
   };
 
@@ -1492,9 +3101,9 @@ bool VKTextureFinal::CreatePipeline()
   0,                                                          // VkPipelineRasterizationStateCreateFlags
   VK_FALSE,                                                   // depthClampEnable
   VK_FALSE,                                                   // rasterizerDiscardEnable
-  VK_POLYGON_MODE_FILL,                                       // VkPolygonMode
-  VK_CULL_MODE_BACK_BIT,                                      // VkCullModeFlags
-  VK_FRONT_FACE_COUNTER_CLOCKWISE,                            // VkFrontFace
+  state.polygon_mode,                                         // VkPolygonMode
+  state.cull_mode,                                            // VkCullModeFlags
+  state.front_face,                                           // VkFrontFace
   VK_FALSE,                                                   // depthBiasEnable
   0.0f,                                                       // depthBiasConstantFactor
   0.0f,                                                       // depthBiasClamp
@@ -1515,16 +3124,31 @@ bool VKTextureFinal::CreatePipeline()
   };
 
   VkPipelineColorBlendAttachmentState color_blend_attachment_state = {
-  VK_FALSE,                                             // blendEnable
-  VK_BLEND_FACTOR_ONE,                                  // srcColorBlendFactor
-  VK_BLEND_FACTOR_ZERO,                                 // dstColorBlendFactor
-  VK_BLEND_OP_ADD,                                      // colorBlendOp
-  VK_BLEND_FACTOR_ONE,                                  // srcAlphaBlendFactor
-  VK_BLEND_FACTOR_ZERO,                                 // dstAlphaBlendFactor
-  VK_BLEND_OP_ADD,                                      // alphaBlendOp
-  VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | // colorWriteMask
-  VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
-  };
+  state.blend_enable,                                   // blendEnable
+  state.src_color_blend_factor,                         // srcColorBlendFactor
+  state.dst_color_blend_factor,                         // dstColorBlendFactor
+  state.color_blend_op,                                 // colorBlendOp
+  state.src_alpha_blend_factor,                         // srcAlphaBlendFactor
+  state.dst_alpha_blend_factor,                         // dstAlphaBlendFactor
+  state.alpha_blend_op,                                 // alphaBlendOp
+  state.color_write_mask                                // colorWriteMask
+  };
+
+  VkPipelineDepthStencilStateCreateInfo depth_stencil_state_create_info = {
+    VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO, // VkStructureType
+    nullptr,                                                    // pNext
+    0,                                                          // VkPipelineDepthStencilStateCreateFlags
+    state.depth_test_enable,                                    // depthTestEnable
+    state.depth_write_enable,                                   // depthWriteEnable
+    state.depth_compare_op,                                     // depthCompareOp
+    VK_FALSE,                                                   // depthBoundsTestEnable
+    VK_FALSE,                                                   // stencilTestEnable
+    {},                                                         // front
+    {},                                                         // back
+    0.0f,                                                       // minDepthBounds
+    1.0f                                                        // maxDepthBounds
+  };
+  bool uses_depth = state.depth_test_enable || state.depth_write_enable;
 
   VkPipelineColorBlendStateCreateInfo color_blend_state_create_info = {
     VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO, // VkStructureType
@@ -1551,8 +3175,6 @@ bool VKTextureFinal::CreatePipeline()
     dynamic_states                                        // pDynamicStates
   };
 
-  CreatePipelineLayout();
-
   VkGraphicsPipelineCreateInfo pipeline_create_info = {
     VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,         // VkStructureType
     nullptr,                                                 // pNext
@@ -1565,44 +3187,106 @@ bool VKTextureFinal::CreatePipeline()
     &viewport_state_create_info,                             // pViewportState
     &rasterization_state_create_info,                        // pRasterizationState
     &multisample_state_create_info,                          // pMultisampleState
-    nullptr,                                                 // pDepthStencilState
+    uses_depth ? &depth_stencil_state_create_info : nullptr, // pDepthStencilState
     &color_blend_state_create_info,                          // pColorBlendState
     &dynamic_state_create_info,                              // pDynamicState
-    m_pipeline_layout,                                       // VkPipelineLayout
-    m_render_pass,                                           // VkRenderPass
+    pipeline_layout,                                         // VkPipelineLayout
+    render_pass,                                             // VkRenderPass
     0,                                                       // subpass
     VK_NULL_HANDLE,                                          // basePipelineHandle, well... pipeline can 'Inherit' pipelines...
     -1                                                       // basePipelineIndex
   };
 
-  if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &m_pipeline) != VK_SUCCESS)
+  VkPipeline pipeline;
+  if (vkCreateGraphicsPipelines(m_device, m_pipeline_cache, 1, &pipeline_create_info, nullptr, &pipeline) != VK_SUCCESS)
   {
     assert("Could not create graphics pipeline!", "Vulkan", Assert::Error);
-    return false;
+    return VK_NULL_HANDLE;
   }
 
-  vkDestroyShaderModule(m_device, vertex_shader_module, nullptr);
-  vkDestroyShaderModule(m_device, fragment_shader_module, nullptr);
+  return pipeline;
+}
 
-  return true;
+VkShaderModule VKTextureFinal::GetShaderModule(const char* name, uint64_t* content_hash)
+{
+  VkShaderModule shader_module = GetShaderModule(name);
+  if ((shader_module != nullptr) && (content_hash != nullptr))
+    *content_hash = m_shader_module_files[name].content_hash;
+  return shader_module;
 }
 
-VkShaderModule VKTextureFinal::CreateShaderModule(const char* file_name)
+VkShaderModule VKTextureFinal::GetShaderModule(const char* name)
 {
-  if (file_name == nullptr)
+  if (name == nullptr)
     return nullptr;
 
-  std::vector<char>&& code = read_binary_file(file_name);
+  auto file = m_shader_module_files.find(name);
+
+  // no file is touched for embedded shaders, a reloaded one is already in the map under its name
+  const EmbeddedShader* embedded_shader = find_embedded_shader(name);
+  if (embedded_shader != nullptr)
+  {
+    if (file != m_shader_module_files.end())
+      return m_shader_modules[file->second.content_hash].module;
+    return AddShaderModule(name, embedded_shader->code, embedded_shader->size, 0);
+  }
+
+  // anything else is a path to a .spv file, checked by write time
+  WIN32_FILE_ATTRIBUTE_DATA file_attributes;
+  uint64_t write_time = 0;
+  if (GetFileAttributesExA(name, GetFileExInfoStandard, &file_attributes))
+    write_time = (static_cast<uint64_t>(file_attributes.ftLastWriteTime.dwHighDateTime) << 32) | file_attributes.ftLastWriteTime.dwLowDateTime;
+
+  if ((file != m_shader_module_files.end()) && (file->second.write_time == write_time))
+    return m_shader_modules[file->second.content_hash].module;
+
+  std::vector<char>&& code = read_binary_file(name);
 
   if (code.empty())
     return nullptr;
 
+  if (file != m_shader_module_files.end())
+  {
+    // touched but not changed, keep the module
+    file->second.write_time = write_time;
+    if (file->second.content_hash == hash_bytes(code.data(), code.size()))
+      return m_shader_modules[file->second.content_hash].module;
+
+    // pipelines keep working without the modules they were built from, so the old one can go right away
+    ReleaseShaderModule(file->second.content_hash);
+    m_shader_module_files.erase(file);
+  }
+
+  return AddShaderModule(name, reinterpret_cast<const uint32_t*>(code.data()), code.size(), write_time);
+}
+
+VkShaderModule VKTextureFinal::AddShaderModule(const char* name, const uint32_t* code, size_t size, uint64_t write_time)
+{
+  uint64_t content_hash = hash_bytes(code, size);
+
+  auto shared_module = m_shader_modules.find(content_hash);
+  if (shared_module == m_shader_modules.end())
+  {
+    VkShaderModule shader_module = CreateShaderModule(code, size);
+    if (shader_module == nullptr)
+      return nullptr;
+
+    shared_module = m_shader_modules.emplace(content_hash, SharedShaderModule{ shader_module, 0 }).first;
+  }
+
+  ++shared_module->second.file_count;
+  m_shader_module_files[name] = { content_hash, write_time };
+  return shared_module->second.module;
+}
+
+VkShaderModule VKTextureFinal::CreateShaderModule(const uint32_t* code, size_t size)
+{
   VkShaderModuleCreateInfo shader_module_create_info = {
     VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,    // VkStructureType
     nullptr,                                        // pNext
     0,                                              // VkShaderModuleCreateFlags
-    code.size(),                                    // codeSize
-    reinterpret_cast<const uint32_t*>(code.data())  // pCode
+    size,                                           // codeSize
+    code                                            // pCode
   };
 
   VkShaderModule shader_module;
@@ -1615,6 +3299,20 @@ VkShaderModule VKTextureFinal::CreateShaderModule(const char* file_name)
   return shader_module;
 }
 
+void VKTextureFinal::ReleaseShaderModule(uint64_t content_hash)
+{
+  auto shared_module = m_shader_modules.find(content_hash);
+  if (shared_module == m_shader_modules.end())
+    return;
+
+  // a worker may still be compiling with it, so it only goes away with the retired pipelines
+  if (--shared_module->second.file_count == 0)
+  {
+    m_retired_shader_modules.push_back(shared_module->second.module);
+    m_shader_modules.erase(shared_module);
+  }
+}
+
 bool VKTextureFinal::CreatePipelineLayout()
 {
   VkPipelineLayoutCreateInfo layout_create_info = {
@@ -1642,12 +3340,38 @@ bool VKTextureFinal::Update()
   uint32_t      acquired_image_index;
   m_current_virtual_frame_index = (m_current_virtual_frame_index + 1) % m_virtual_frames_count;
 
-  if (vkWaitForFences(m_device, 1, &current_virtual_frame.fence, VK_FALSE, 1000000000) != VK_SUCCESS)
+  if (!WaitTimeline(m_graphics_timeline, current_virtual_frame.timeline_value, 1000000000))
   {
-    assert("Problem occurred while waiting for fence!", "Vulkan", Assert::Error);
+    assert("Problem occurred while waiting for the frame!", "Vulkan", Assert::Error);
+    return false;
+  }
+  ++m_frame_number;
+
+  if (!ResetFrameCommandPools(current_virtual_frame))
+    return false;
+
+  ReloadShaders();
+  SwapReloadedPipelines();
+  ReleaseRetiredPipelines(false);
+
+  if (!UpdateStreamedTextures())
     return false;
+
+  if (current_virtual_frame.descriptor_texture_view != GetTextureView())
+    UpdateDescriptorSet(current_virtual_frame);
+
+  // unchanged static frames keep the vertices written the last time this frame came around
+  if (m_static_command_buffers_enabled)
+    UpdateStaticVersion();
+  if (!m_static_command_buffers_enabled || (current_virtual_frame.sprite_vertices_version != m_static_version))
+  {
+    WriteSpriteVertices(current_virtual_frame);
+    current_virtual_frame.sprite_vertices_version = m_static_version;
   }
-  vkResetFences(m_device, 1, &current_virtual_frame.fence);
+
+  // the next frame's DrawSprite calls compare against these, both keep their capacity
+  m_previous_sprites.swap(m_sprites);
+  m_sprites.clear();
 
   switch (vkAcquireNextImageKHR(m_device, m_swap_chain, UINT64_MAX, current_virtual_frame.image_available_semaphore, VK_NULL_HANDLE, &acquired_image_index))
   {
@@ -1655,34 +3379,23 @@ bool VKTextureFinal::Update()
   case VK_SUBOPTIMAL_KHR:
     break;
   case VK_ERROR_OUT_OF_DATE_KHR:
-    return OnWindowSizeChanged();
+    // uploads batched this frame still go out, recreating the swap chain waits for them
+    return FlushTimeline(m_graphics_timeline) && OnWindowSizeChanged();
   default:
     assert("Problem occurred during swap chain image acquisition!", "Vulkan", Assert::Error);
     return false;
   }
 
-  if (!PrepareFrame(current_virtual_frame.command_buffer, acquired_image_index, current_virtual_frame.frame_buffer))
+  if (!PrepareFrame(current_virtual_frame, acquired_image_index))
     return false;
 
-  VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-
-  VkSubmitInfo submit_info = {
-    VK_STRUCTURE_TYPE_SUBMIT_INFO,                      // VkStructureType 
-    nullptr,                                            // pNext
-    1,                                                  // waitSemaphoreCount
-    &current_virtual_frame.image_available_semaphore,   // pWaitSemaphores
-    &wait_dst_stage_mask,                               // pWaitDstStageMask
-    1,                                                  // commandBufferCount
-    &current_virtual_frame.command_buffer,              // pCommandBuffers
-    1,                                                  // signalSemaphoreCount
-    &current_virtual_frame.finished_rendering_semaphore // pSignalSemaphores
-  };
-
-  if (vkQueueSubmit(m_graphics_queue, 1, &submit_info, current_virtual_frame.fence) != VK_SUCCESS)
-  {
-    assert("Failed to submit to graphics queue!", "Vulkan", Assert::Error);
+  // uploads went to the same queue before this, the barriers recorded with them are all the frame needs
+  // everything batched this frame goes out in one vkQueueSubmit, before presenting waits on it
+  if (!SubmitToTimeline(m_graphics_timeline, current_virtual_frame.command_buffer, {}, current_virtual_frame.image_available_semaphore,
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, current_virtual_frame.finished_rendering_semaphore, current_virtual_frame.timeline_value))
+    return false;
+  if (!FlushTimeline(m_graphics_timeline))
     return false;
-  }
 
   VkPresentInfoKHR present_info = {
     VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,                  // VkStructureType
@@ -1710,45 +3423,90 @@ bool VKTextureFinal::Update()
   return true;
 }
 
-bool VKTextureFinal::PrepareFrame(VkCommandBuffer command_buffer, const size_t& image_index, VkFramebuffer& frame_buffer)
+bool VKTextureFinal::PrepareFrame(VirtualFrame& virtual_frame, const size_t& image_index)
+{
+  if (m_static_command_buffers_enabled)
+    return PrepareStaticFrame(virtual_frame, image_index);
+
+  if (!AcquireFrameCommandBuffer(virtual_frame.command_pool, virtual_frame.command_buffer))
+    return false;
+
+  if (!CreateFrameBuffer(virtual_frame.frame_buffer, m_swap_chain_info.image_views[image_index]))
+    return false;
+
+  return RecordFrame(virtual_frame.command_buffer, virtual_frame, image_index, virtual_frame.frame_buffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, true);
+}
+
+bool VKTextureFinal::PrepareStaticFrame(VirtualFrame& virtual_frame, const size_t& image_index)
 {
-  if (!CreateFrameBuffer(frame_buffer, m_swap_chain_info.image_views[image_index]))
+  // every virtual frame binds its own descriptor set and vertex buffer, so it gets its own buffer per image
+  size_t virtual_frame_index = static_cast<size_t>(&virtual_frame - m_virtual_frames.data());
+  size_t static_count = m_swap_chain_info.images.size() * m_virtual_frames_count;
+
+  m_static_frame_buffers.resize(m_swap_chain_info.images.size(), VK_NULL_HANDLE);
+  while (m_static_command_buffers.size() < static_count)
+  {
+    StaticCommandBuffer static_command_buffer = { VK_NULL_HANDLE, 0 };
+    if (!AllocateCommandBuffers(m_static_command_pool, 1, &static_command_buffer.command_buffer))
+      return false;
+    m_static_command_buffers.push_back(static_command_buffer);
+  }
+
+  StaticCommandBuffer& static_command_buffer = m_static_command_buffers[image_index * m_virtual_frames_count + virtual_frame_index];
+  virtual_frame.command_buffer = static_command_buffer.command_buffer;
+  if (static_command_buffer.version == m_static_version)
+    return true;
+
+  if ((m_static_frame_buffers[image_index] == VK_NULL_HANDLE) && !CreateFrameBuffer(m_static_frame_buffers[image_index], m_swap_chain_info.image_views[image_index]))
+    return false;
+
+  // the frame's last submission was waited for, so the buffer isn't pending anymore and can be recorded over
+  // inline only, chunks come from the frame pools which are reset every frame
+  if (!RecordFrame(static_command_buffer.command_buffer, virtual_frame, image_index, m_static_frame_buffers[image_index], 0, false))
     return false;
 
+  static_command_buffer.version = m_static_version;
+  return true;
+}
+
+void VKTextureFinal::UpdateStaticVersion()
+{
+  // DrawSprite flagged any sprite that differs from last frame's, only a shorter list is left to notice
+  bool sprites_changed = m_sprites_changed || (m_sprites.size() != m_previous_sprites.size());
+  m_sprites_changed = false;
+  VkPipeline background_pipeline = GetPipeline(m_background_pipeline);
+  VkPipeline sprite_pipeline = GetPipeline(m_sprite_pipeline, false);
+  VkImageView texture_view = GetTextureView();
+
+  if (sprites_changed || (background_pipeline != m_static_pipeline) || (sprite_pipeline != m_static_sprite_pipeline) ||
+    (texture_view != m_static_texture_view))
+  {
+    m_static_pipeline = background_pipeline;
+    m_static_sprite_pipeline = sprite_pipeline;
+    m_static_texture_view = texture_view;
+    InvalidateStaticCommandBuffers();
+  }
+}
+
+void VKTextureFinal::SetStaticCommandBuffers(bool enabled)
+{
+  // what was recorded before may be out of date by now, vertices included
+  m_static_command_buffers_enabled = enabled;
+  InvalidateStaticCommandBuffers();
+}
+
+bool VKTextureFinal::RecordFrame(VkCommandBuffer command_buffer, VirtualFrame& virtual_frame, const size_t& image_index, VkFramebuffer frame_buffer,
+  VkCommandBufferUsageFlags usage, bool record_chunks)
+{
   VkCommandBufferBeginInfo command_buffer_begin_info = {
     VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, // VkStructureType
     nullptr,                                     // pNext
-    VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, // VkCommandBufferUsageFlags
+    usage,                                       // VkCommandBufferUsageFlags
     nullptr                                      // pInheritanceInfo
   };
 
   vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
 
-  VkImageSubresourceRange image_subresource_range = {
-    VK_IMAGE_ASPECT_COLOR_BIT,  // aspectMask
-    0,                          // baseMipLevel
-    1,                          // levelCount
-    0,                          // baseArrayLayer
-    1                           // layerCount
-  };
-
-  if (m_graphics_queue != m_present_queue)
-  {
-    VkImageMemoryBarrier barrier_from_present_to_draw = {
-      VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, // VkStructureType
-      nullptr,                                // pNext
-      VK_ACCESS_MEMORY_READ_BIT,              // srcAccessMask
-      VK_ACCESS_MEMORY_READ_BIT,              // dstAccessMask
-      VK_IMAGE_LAYOUT_UNDEFINED,              // oldLayout
-      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,        // newLayout
-      m_present_queue_family_index,           // srcQueueFamilyIndex
-      m_graphics_queue_family_index,          // dstQueueFamilyIndex
-      m_swap_chain_info.images[image_index],  // image
-      image_subresource_range                 // subresourceRange
-    };
-    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier_from_present_to_draw);
-  }
-
   VkClearValue clear_value = { { 1.0f, 0.8f, 0.4f, 0.0f } };
 
   VkRenderPassBeginInfo render_pass_begin_info = {
@@ -1767,9 +3525,135 @@ bool VKTextureFinal::PrepareFrame(VkCommandBuffer command_buffer, const size_t&
     &clear_value                               // pClearValues
   };
 
-  vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+  // resolved here, GetPipeline isn't safe to call from the recording threads
+  VkPipeline background_pipeline = GetPipeline(m_background_pipeline);
+  VkPipeline sprite_pipeline = m_sprite_draws.empty() ? VK_NULL_HANDLE : GetPipeline(m_sprite_pipeline, false);
+  uint32_t sprite_count = m_sprite_draws.empty() ? 0 : m_sprite_draws.back().first_sprite + m_sprite_draws.back().sprite_count;
+
+  bool recorded = true;
+  DeclareFrameGraph(m_frame_graph, m_swap_chain_info.images[image_index], [&](VkCommandBuffer command_buffer)
+  {
+    // secondary buffers are all or nothing, a subpass can't mix them with inline commands
+    size_t chunk_count = record_chunks ? GetRecordingChunkCount() : 1;
+    if (chunk_count > 1)
+    {
+      vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+      std::atomic<bool> recorded_chunks(true);
+      threadPool.ParallelFor(chunk_count, [&](size_t begin, size_t end)
+      {
+        for (size_t chunk = begin; chunk < end; ++chunk)
+          if (!RecordChunk(virtual_frame, chunk, chunk_count, background_pipeline, sprite_pipeline))
+            recorded_chunks = false;
+      });
+      recorded = recorded_chunks;
+
+      vkCmdExecuteCommands(command_buffer, static_cast<uint32_t>(chunk_count), virtual_frame.recording_command_buffers);
+    }
+    else
+    {
+      vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+      RecordDraws(command_buffer, virtual_frame.descriptor_set, virtual_frame.sprite_vertex_buffer, background_pipeline, sprite_pipeline, 0, sprite_count);
+    }
+
+    vkCmdEndRenderPass(command_buffer);
+  }, [&](std::vector<RenderGraph::TransientImage>& transients) { return AllocateTransientImages(virtual_frame, transients); });
+  m_frame_graph.Execute(command_buffer, vkCmdPipelineBarrier);
+
+  if (!recorded || (vkEndCommandBuffer(command_buffer) != VK_SUCCESS))
+  {
+    assert("Could not record command buffer!", "Vulkan", Assert::Error);
+    return false;
+  }
+
+  return true;
+}
+
+RenderGraph::Attachment VKTextureFinal::DeclareFrameGraph(RenderGraph& graph, VkImage swap_chain_image, std::function<void(VkCommandBuffer)> record_draws,
+  const RenderGraph::TransientAllocator& allocate_transients)
+{
+  VkImageSubresourceRange image_subresource_range = {
+    VK_IMAGE_ASPECT_COLOR_BIT,  // aspectMask
+    0,                          // baseMipLevel
+    1,                          // levelCount
+    0,                          // baseArrayLayer
+    1                           // layerCount
+  };
+
+  // acquired images come with whatever was shown last, drawing waits for them at color output
+  // swap chain images are concurrent when presenting happens on another family, so there's no ownership to hand over
+  graph.Reset(m_graphics_queue_family_index);
+  RenderGraph::Resource target = graph.ImportImage(m_image_states, swap_chain_image, image_subresource_range,
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+
+  RenderGraph::Pass draw = graph.AddPass("sprites", std::move(record_draws));
+  graph.Clear(draw, target);
+  graph.Export(target, RenderUsage::Present);
+
+  if (!graph.Compile(allocate_transients))
+    assert("Could not compile the frame graph!", "Vulkan", Assert::Error);
+  return graph.GetAttachment(draw, target);
+}
+
+size_t VKTextureFinal::GetRecordingChunkCount() const
+{
+  if (m_sprite_draws.empty())
+    return 1;
+
+  size_t sprite_count = m_sprite_draws.back().first_sprite + m_sprite_draws.back().sprite_count;
+  return std::max<size_t>(1, std::min(sprite_count / m_min_sprites_per_recording_chunk, m_recording_chunk_count));
+}
+
+bool VKTextureFinal::RecordChunk(VirtualFrame& virtual_frame, size_t chunk, size_t chunk_count, VkPipeline background_pipeline, VkPipeline sprite_pipeline)
+{
+  if (!AcquireFrameCommandBuffer(virtual_frame.recording_command_pools[chunk], virtual_frame.recording_command_buffers[chunk]))
+    return false;
+
+  VkCommandBuffer command_buffer = virtual_frame.recording_command_buffers[chunk];
+
+  VkCommandBufferInheritanceInfo inheritance_info = {
+    VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO, // VkStructureType
+    nullptr,                                           // pNext
+    m_render_pass,                                     // renderPass
+    0,                                                 // subpass
+    virtual_frame.frame_buffer,                        // framebuffer
+    VK_FALSE,                                          // occlusionQueryEnable
+    0,                                                 // queryFlags
+    0                                                  // pipelineStatistics
+  };
+
+  VkCommandBufferBeginInfo command_buffer_begin_info = {
+    VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,                                                    // VkStructureType
+    nullptr,                                                                                        // pNext
+    VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT, // VkCommandBufferUsageFlags
+    &inheritance_info                                                                               // pInheritanceInfo
+  };
+
+  if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS)
+  {
+    assert("Could not begin secondary command buffer!", "Vulkan", Assert::Error);
+    return false;
+  }
+
+  // even split of the sorted sprites, a page's draw gets cut where a chunk ends
+  uint32_t sprite_count = m_sprite_draws.back().first_sprite + m_sprite_draws.back().sprite_count;
+  uint32_t first_sprite = static_cast<uint32_t>(static_cast<uint64_t>(sprite_count) * chunk / chunk_count);
+  uint32_t end_sprite = static_cast<uint32_t>(static_cast<uint64_t>(sprite_count) * (chunk + 1) / chunk_count);
+  RecordDraws(command_buffer, virtual_frame.descriptor_set, virtual_frame.sprite_vertex_buffer, chunk == 0 ? background_pipeline : VK_NULL_HANDLE,
+    sprite_pipeline, first_sprite, end_sprite);
+
+  if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+  {
+    assert("Could not record secondary command buffer!", "Vulkan", Assert::Error);
+    return false;
+  }
+  return true;
+}
 
+void VKTextureFinal::RecordDraws(VkCommandBuffer command_buffer, VkDescriptorSet descriptor_set, VkBuffer sprite_vertex_buffer, VkPipeline background_pipeline,
+  VkPipeline sprite_pipeline, uint32_t first_sprite, uint32_t end_sprite)
+{
+  // state isn't inherited by secondary buffers, every chunk sets up everything it draws with
   VkViewport viewport = {
     0.0f,                                                // x
     0.0f,                                                // y
@@ -1791,38 +3675,34 @@ bool VKTextureFinal::PrepareFrame(VkCommandBuffer command_buffer, const size_t&
   vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
   VkDeviceSize offset = 0;
-  vkCmdBindVertexBuffers(command_buffer, 0, 1, &m_vertex_buffer, &offset);
-
-  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, &m_descriptor_set, 0, nullptr);
-
-  vkCmdDraw(command_buffer, m_vertex_buffer_info.count, 1, 0, 0);
+  if (background_pipeline != VK_NULL_HANDLE)
+  {
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, background_pipeline);
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, &m_vertex_buffer, &offset);
 
-  vkCmdEndRenderPass(command_buffer);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
 
-  if (m_graphics_queue != m_present_queue)
-  {
-    VkImageMemoryBarrier barrier_from_draw_to_present = {
-      VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, // VkStructureType
-      nullptr,                                // pNext
-      VK_ACCESS_MEMORY_READ_BIT,              // srcAccessMask
-      VK_ACCESS_MEMORY_READ_BIT,              // dstAccessMask
-      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,        // oldLayout
-      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,        // newLayout
-      m_graphics_queue_family_index,          // srcQueueFamilyIndex
-      m_present_queue_family_index,           // dstQueueFamilyIndex
-      m_swap_chain_info.images[image_index],  // image
-      image_subresource_range                 // subresourceRange
-    };
-    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier_from_draw_to_present);
+    vkCmdDraw(command_buffer, m_vertex_buffer_info.count, 1, 0, 0);
   }
 
-  if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+  if ((sprite_pipeline != VK_NULL_HANDLE) && (first_sprite < end_sprite))
   {
-    assert("Could not record command buffer!", "Vulkan", Assert::Error);
-    return false;
-  }
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, &sprite_vertex_buffer, &offset);
+    vkCmdBindIndexBuffer(command_buffer, m_sprite_index_buffer, 0, VK_INDEX_TYPE_UINT32);
 
-  return true;
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, sprite_pipeline);
+
+    for (const SpriteDraw& sprite_draw : m_sprite_draws)
+    {
+      uint32_t draw_first = std::max(sprite_draw.first_sprite, first_sprite);
+      uint32_t draw_end = std::min(sprite_draw.first_sprite + sprite_draw.sprite_count, end_sprite);
+      if (draw_first >= draw_end)
+        continue;
+
+      vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, &m_atlas_descriptor_sets[sprite_draw.page], 0, nullptr);
+      vkCmdDrawIndexed(command_buffer, (draw_end - draw_first) * 6, 1, draw_first * 6, 0, 0);
+    }
+  }
 }
 
 bool VKTextureFinal::CreateFrameBuffer(VkFramebuffer& frame_buffer, const VkImageView image_view)
@@ -1863,6 +3743,80 @@ void VKTextureFinal::Terminate()
   {
     vkDeviceWaitIdle(m_device);
 
+    DestroyPipelines();
+    m_pipeline_builds.clear();
+
+    if (m_render_pass != VK_NULL_HANDLE)
+    {
+      vkDestroyRenderPass(m_device, m_render_pass, nullptr);
+      m_render_pass = VK_NULL_HANDLE;
+    }
+
+    if (m_pipeline_layout != VK_NULL_HANDLE)
+    {
+      vkDestroyPipelineLayout(m_device, m_pipeline_layout, nullptr);
+      m_pipeline_layout = VK_NULL_HANDLE;
+    }
+
+    if (m_pipeline_cache != VK_NULL_HANDLE)
+    {
+      vkDestroyPipelineCache(m_device, m_pipeline_cache, nullptr);
+      m_pipeline_cache = VK_NULL_HANDLE;
+    }
+
+    // loaders write into the textures, they have to be done before those go away
+    for (std::unique_ptr<StreamedTexture>& texture : m_streamed_textures)
+    {
+      if (texture->loader.valid())
+        texture->loader.wait();
+
+      if (texture->view != VK_NULL_HANDLE)
+        vkDestroyImageView(m_device, texture->view, nullptr);
+      if (texture->image != VK_NULL_HANDLE)
+        vkDestroyImage(m_device, texture->image, nullptr);
+      if (texture->memory != VK_NULL_HANDLE)
+        vkFreeMemory(m_device, texture->memory, nullptr);
+    }
+    m_streamed_textures.clear();
+    for (VirtualFrame& virtual_frame : m_virtual_frames)
+      DestroyVirtualFrame(virtual_frame);
+    m_virtual_frames.clear();
+    ReleaseRetiredImages(true);
+    m_image_states.Clear();
+
+    if (m_streaming_staging_buffer_info.memory != VK_NULL_HANDLE)
+    {
+      vkFreeMemory(m_device, m_streaming_staging_buffer_info.memory, nullptr);
+      m_streaming_staging_buffer_info.memory = VK_NULL_HANDLE;
+    }
+
+    if (m_streaming_staging_buffer != VK_NULL_HANDLE)
+    {
+      vkDestroyBuffer(m_device, m_streaming_staging_buffer, nullptr);
+      m_streaming_staging_buffer = VK_NULL_HANDLE;
+    }
+
+    DestroyTimeline(m_graphics_timeline);
+
+    DestroyAtlasPages();
+
+    for (auto& shared_module : m_shader_modules)
+      vkDestroyShaderModule(m_device, shared_module.second.module, nullptr);
+    m_shader_modules.clear();
+    m_shader_module_files.clear();
+
+    if (m_sprite_index_buffer_info.memory != VK_NULL_HANDLE)
+    {
+      vkFreeMemory(m_device, m_sprite_index_buffer_info.memory, nullptr);
+      m_sprite_index_buffer_info.memory = VK_NULL_HANDLE;
+    }
+
+    if (m_sprite_index_buffer != VK_NULL_HANDLE)
+    {
+      vkDestroyBuffer(m_device, m_sprite_index_buffer, nullptr);
+      m_sprite_index_buffer = VK_NULL_HANDLE;
+    }
+
     if (m_swap_chain != VK_NULL_HANDLE)
     {
       vkDestroySwapchainKHR(m_device, m_swap_chain, nullptr);
@@ -1941,17 +3895,15 @@ void VKTextureFinal::Terminate()
       m_graphics_command_pool = VK_NULL_HANDLE;
     }
 
-    for (VirtualFrame& virtual_frame : m_virtual_frames)
+    if (m_static_command_pool != VK_NULL_HANDLE)
     {
-      vkDestroySemaphore(m_device, virtual_frame.image_available_semaphore, nullptr);
-      vkDestroySemaphore(m_device, virtual_frame.finished_rendering_semaphore, nullptr);
-      virtual_frame.image_available_semaphore = VK_NULL_HANDLE;
-      virtual_frame.finished_rendering_semaphore = VK_NULL_HANDLE;
-      vkDestroyFence(m_device, virtual_frame.fence, nullptr);
-      virtual_frame.fence = VK_NULL_HANDLE;
-      vkDestroyFramebuffer(m_device, virtual_frame.frame_buffer, nullptr);
-      virtual_frame.frame_buffer = VK_NULL_HANDLE;
+      vkDestroyCommandPool(m_device, m_static_command_pool, nullptr);
+      m_static_command_pool = VK_NULL_HANDLE;
     }
+    m_static_command_buffers.clear();
+
+    // last, the timelines and frames above hand their fences and semaphores back first
+    DestroySyncPools();
   }
 }
 
@@ -1,16 +1,48 @@
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "vkbase.h"
+#include "bcencoder.h"
+#include "atlaspacker.h"
+#include "pipelinestate.h"
+#include "rendergraph.h"
+#include "pipelinemanifest.h"
+#include "vertexpacking.h"
+#include "shaderwatcher.h"
+#include "syncpool.h"
+#include "timelinesemaphore.h"
+
+typedef uint32_t PipelineId;
 
 class VKTextureFinal : public VKBase
 {
 private:
   struct VertexData
   {
-    float x, y, z, w;
-    float u, v;
+    VertexVector<float, 4> position;
+    VertexVector<float, 2> uv;
+  };
+  constexpr static VertexAttribute m_vertex_data_attributes[] = {
+    VERTEX_ATTRIBUTE(VertexData, position, 0),
+    VERTEX_ATTRIBUTE(VertexData, uv, 1)
+  };
+  // sprites are rewritten every frame, so they get the small format: z and w are left out and
+  // come in as 0 and 1, uvs are unorm16 taken from the atlas regions, 12 bytes instead of 24
+  struct SpriteVertex
+  {
+    VertexVector<float, 2>   position;
+    VertexVector<Unorm16, 2> uv;
+  };
+  constexpr static VertexAttribute m_sprite_vertex_attributes[] = {
+    VERTEX_ATTRIBUTE(SpriteVertex, position, 0),
+    VERTEX_ATTRIBUTE(SpriteVertex, uv, 1)
   };
   constexpr static VertexData m_vertex_data[] = {
     {
@@ -50,34 +82,227 @@ private:
   VkBuffer   m_staging_buffer;
   BufferInfo m_staging_buffer_info;
 
-  constexpr static size_t m_virtual_frames_count = 3;
+  // frames recorded ahead of the gpu and swap chain images, fewer means lower latency and more keeps the gpu busier
+  // both can change at runtime with SetFramesInFlight, every per frame resource is then made again for the new count
+  constexpr static size_t m_max_virtual_frames = 4;
+  size_t   m_virtual_frames_count = 3;
+  uint32_t m_swap_chain_image_count = 0; // 0 = one more than the surface's minimum
+
+  // big sprite lists get split into chunks recorded into secondary command buffers on the thread pool
+  // every chunk has its own pool per frame, so no two threads ever record from the same pool
+  constexpr static size_t m_max_recording_chunks = 16;
+  constexpr static size_t m_min_sprites_per_recording_chunk = 8192;
+  size_t m_recording_chunk_count = 1;
+
+  // every frame records from its own transient pools, reset in one go once the frame's last submission has finished
+  // command buffers stay allocated across resets and get handed out in order, more only when a frame needs more
+  struct FrameCommandPool
+  {
+    VkCommandPool                pool;
+    VkCommandBufferLevel         level;
+    std::vector<VkCommandBuffer> command_buffers;
+    size_t                       used;
+  };
+
+  // the frame graph's transient images, kept for as long as the graph keeps asking for the same ones
+  // images whose passes don't overlap share bytes of one allocation per memory type
+  struct TransientImageSet
+  {
+    uint64_t                           signature; // 0 = nothing allocated
+    std::vector<VkImage>               images;    // in the order the graph listed them
+    std::vector<VkImageView>           views;
+    std::vector<std::vector<uint32_t>> follows;   // earlier images each one reuses memory of
+    std::vector<VkDeviceMemory>        memories;
+  };
+
   struct VirtualFrame
   {
     VkSemaphore     image_available_semaphore;
     VkSemaphore     finished_rendering_semaphore;
-    VkFence         fence;
-    VkCommandBuffer command_buffer;
+    uint32_t        image_available_slot;       // where the semaphores sit in m_semaphore_pool
+    uint32_t        finished_rendering_slot;
+    uint64_t        timeline_value; // graphics timeline value of its last submission, its resources are free once that's reached
+    VkCommandBuffer command_buffer; // from command_pool, valid until the frame comes around again
     VkFramebuffer   frame_buffer;
-  } m_virtual_frames[m_virtual_frames_count];
-  size_t m_current_virtual_frame_index = 0;
+    VkDescriptorSet descriptor_set; // one per frame, so a set is only rewritten once its frame has finished
+    VkImageView     descriptor_texture_view;
+    VkBuffer        sprite_vertex_buffer;
+    BufferInfo      sprite_vertex_buffer_info;
+    SpriteVertex*   sprite_vertices; // persistently mapped
+    uint64_t        sprite_vertices_version; // m_static_version the vertices were written at
+    FrameCommandPool command_pool;
+    FrameCommandPool recording_command_pools[m_max_recording_chunks];
+    VkCommandBuffer  recording_command_buffers[m_max_recording_chunks]; // secondary, one per chunk
+    TransientImageSet transient_images;
+  };
+  std::vector<VirtualFrame> m_virtual_frames;
+  size_t   m_current_virtual_frame_index = 0;
+  uint64_t m_frame_number = 0;
 
+  // 1x1 placeholder, bound until a streamed texture has levels resident
   VkImage        m_texture;
   VkDeviceMemory m_texture_memory;
   VkImageView    m_texture_view;
   VkSampler      m_texture_sampler;
 
+  bool      m_texture_compression_bc = false;               // device can sample BC formats
+  BCQuality m_texture_compression_quality = BCQuality::Fast; // taken by each texture when it starts streaming
+
+  // streamed textures get decoded in the background and become resident smallest mip first
+  // the image only ever holds levels [resident_mip, mip_count), so evicted top mips really free memory
+  struct StreamedTexture
+  {
+    std::string                    file_name;
+    VkFormat                       format;
+    BCFormat                       bc_format;
+    BCQuality                      bc_quality;       // copied at creation, the loader never reads the setting itself
+    uint32_t                       width;
+    uint32_t                       height;
+    uint32_t                       mip_count;
+    std::vector<std::vector<char>> mip_data;         // written by the loader, level i is valid once first_loaded_mip <= i
+    std::atomic<uint32_t>          first_loaded_mip; // mip_count until the loader published a level
+    std::future<bool>              loader;
+    uint32_t                       resident_mip;     // mip_count when nothing is resident
+    VkImage                        image;
+    VkDeviceMemory                 memory;
+    VkImageView                    view;
+  };
+  std::vector<std::unique_ptr<StreamedTexture>> m_streamed_textures;
+
+  struct RetiredImage
+  {
+    VkImage        image;
+    VkDeviceMemory memory;
+    VkImageView    view;
+    uint64_t       frame_number; // frame after which nothing references it anymore
+  };
+  std::vector<RetiredImage> m_retired_images;
+
+  VkDeviceSize    m_texture_streaming_budget = 64 * 1024 * 1024;
+  VkBuffer        m_streaming_staging_buffer;
+  BufferInfo      m_streaming_staging_buffer_info;
+  VkCommandBuffer m_streaming_command_buffer;
+  uint64_t        m_streaming_value = 0; // graphics timeline value of the upload in flight
+
+  // sprites are packed into atlas pages, each frame they become quads in the frame's vertex buffer
+  // sorted by page, so drawing all of them costs one descriptor bind and one draw per page
+  struct Sprite
+  {
+    uint32_t image;
+    float    x, y;
+    float    width, height;
+  };
+  struct SpriteDraw
+  {
+    uint32_t page;
+    uint32_t first_sprite;
+    uint32_t sprite_count;
+  };
+  struct AtlasPageTexture
+  {
+    VkImage        image;
+    VkDeviceMemory memory;
+    VkImageView    view;
+  };
+  constexpr static uint32_t m_max_sprites = 100000;
+  constexpr static uint32_t m_max_atlas_pages = 8;
+  constexpr static int      m_atlas_page_size = 2048;
+  std::vector<AtlasRegion>      m_sprite_regions;
+  std::vector<Unorm16>          m_sprite_region_uvs; // u0 v0 u1 v1 of every region, packed once per atlas
+  std::vector<AtlasPageTexture> m_atlas_pages;
+  VkDescriptorSet               m_atlas_descriptor_sets[m_max_atlas_pages]; // allocated once, reused when the atlas is rebuilt
+  std::vector<Sprite>           m_sprites;
+  std::vector<Sprite>           m_previous_sprites; // last frame's, static mode only redraws when these change
+  std::vector<SpriteDraw>       m_sprite_draws;
+  std::vector<uint32_t>         m_sprite_page_offsets;
+  VkBuffer                      m_sprite_index_buffer;
+  BufferInfo                    m_sprite_index_buffer_info;
+
   VkBuffer   m_uniform_buffer;
   BufferInfo m_uniform_buffer_info;
 
-  VkDescriptorSet       m_descriptor_set;
   VkDescriptorSetLayout m_descriptor_set_layout;
   VkDescriptorPool      m_descriptor_pool;
 
-  uint32_t      m_graphics_queue_family_index;
-  uint32_t      m_present_queue_family_index;
-  VkQueue       m_graphics_queue;
-  VkQueue       m_present_queue;
-  VkCommandPool m_graphics_command_pool;
+  // every submission to a queue advances that queue's timeline by one, work is known by the value it signals
+  // with VK_KHR_timeline_semaphore the value is a timeline semaphore's, without it every flush signals a fence of its own
+  // and waiting for another queue happens on the host before submitting
+  // submissions collect in a batch that goes to the queue as one vkQueueSubmit when the frame is done, or earlier when
+  // something waits for a value in it
+  struct PendingSubmit
+  {
+    VkCommandBuffer                   command_buffer;
+    std::vector<VkSemaphore>          wait_semaphores;
+    std::vector<VkPipelineStageFlags> wait_stages;
+    std::vector<uint64_t>             wait_values; // 0 for binary semaphores
+    std::vector<VkSemaphore>          signal_semaphores;
+    std::vector<uint64_t>             signal_values;
+  };
+  struct SubmittedFence
+  {
+    uint64_t value;
+    VkFence  fence;
+    uint32_t slot;  // in m_fence_pool
+  };
+  struct QueueTimeline
+  {
+    VkQueue                                       queue;
+    VkSemaphore                                   semaphore;             // VK_NULL_HANDLE when falling back to fences
+    uint64_t                                      submitted;             // value of the last submission
+    uint64_t                                      flushed;               // value of the last submission that reached the queue
+    uint64_t                                      completed;             // highest value known to be finished
+    std::vector<PendingSubmit>                    batch;                 // the first batched entries are waiting for the next flush
+    size_t                                        batched;
+    std::deque<SubmittedFence>                    pending_fences;        // fallback only, oldest first, the fences come from m_fence_pool
+    std::vector<VkTimelineSemaphoreSubmitInfoKHR> timeline_submit_infos; // scratch for FlushTimeline, one per batched entry
+    std::vector<VkSubmitInfo>                     submit_infos;
+  };
+  struct TimelineWait
+  {
+    QueueTimeline*       timeline;
+    uint64_t             value;
+    VkPipelineStageFlags stage;
+  };
+  bool                              m_timeline_semaphores = false;
+  QueueTimeline                     m_graphics_timeline;
+  PFN_vkGetSemaphoreCounterValueKHR vkGetSemaphoreCounterValueKHR = nullptr;
+  PFN_vkWaitSemaphoresKHR           vkWaitSemaphoresKHR = nullptr;
+
+  // every fence and binary semaphore comes from here, uploads and readbacks on any thread take one and give it back
+  constexpr static uint32_t m_reserved_fences = 16;
+  SyncPool<VkFence>         m_fence_pool;
+  SyncPool<VkSemaphore>     m_semaphore_pool;
+
+  uint32_t        m_graphics_queue_family_index;
+  uint32_t        m_present_queue_family_index;
+  VkQueue         m_graphics_queue;
+  VkQueue         m_present_queue;
+  VkCommandPool   m_graphics_command_pool;
+  VkCommandBuffer m_upload_command_buffer; // setup copies, each one waits for the device before the next
+
+  // barriers and layouts come from these, the graphs are rebuilt for every frame and every buffer upload
+  // image uploads transition through the tracker directly, graphs start every image from the state it was last left in,
+  // and either way only what isn't there already gets moved
+  RenderGraph       m_frame_graph;
+  RenderGraph       m_upload_graph;
+  ImageStateTracker m_image_states;
+
+  // static mode records a frame once and resubmits it for as long as sprites, pipelines, textures and swap chain stay the same
+  // the version goes up whenever any of them changes, and buffers recorded at an older one are recorded again
+  struct StaticCommandBuffer
+  {
+    VkCommandBuffer command_buffer;
+    uint64_t        version; // 0 = never recorded
+  };
+  bool                             m_static_command_buffers_enabled = false;
+  uint64_t                         m_static_version = 1;
+  bool                             m_sprites_changed = false; // set by DrawSprite, sprites differ from m_previous_sprites
+  VkPipeline                       m_static_pipeline = VK_NULL_HANDLE; // the background's
+  VkPipeline                       m_static_sprite_pipeline = VK_NULL_HANDLE;
+  VkImageView                      m_static_texture_view = VK_NULL_HANDLE;
+  VkCommandPool                    m_static_command_pool;
+  std::vector<VkFramebuffer>       m_static_frame_buffers;   // one per swap chain image
+  std::vector<StaticCommandBuffer> m_static_command_buffers; // swap chain image * m_virtual_frames_count + virtual frame
 
   struct SwapChainInfo
   {
@@ -91,6 +316,50 @@ private:
   VkPipeline       m_pipeline;
   VkPipelineLayout m_pipeline_layout;
 
+  // shader modules outlive the pipelines built from them, keyed by name and shared by content
+  // embedded shaders only change when the shader watcher recompiles their source, for .spv paths a rebuild only checks the file's write time
+  struct ShaderModuleFile
+  {
+    uint64_t content_hash;
+    uint64_t write_time; // 0 for embedded shaders
+  };
+  struct SharedShaderModule
+  {
+    VkShaderModule module;
+    uint32_t       file_count; // paths whose current content is this module
+  };
+  std::unordered_map<std::string, ShaderModuleFile> m_shader_module_files;
+  std::unordered_map<uint64_t, SharedShaderModule>  m_shader_modules;
+  std::vector<VkShaderModule>                       m_retired_shader_modules; // destroyed once no build is running
+
+  // requested pipelines compile on the thread pool against one shared cache
+  // m_pipeline is built synchronously and gets drawn with while a requested one is still compiling
+  // requests with the same key get the same id, so a state is only ever compiled once
+  // a reloaded shader rebuilds its pipelines in the background, each is swapped in at the start of
+  // the frame after it's ready and the one it replaces lives on until every frame slot has cycled
+  struct PipelineBuild
+  {
+    PipelineDescription            description;
+    std::shared_future<VkPipeline> future;      // invalid until there is a render pass to build against
+    VkPipeline                     pipeline;    // taken from future once it is ready
+    std::shared_future<VkPipeline> replacement; // valid while a rebuild after a shader reload is running
+  };
+  struct RetiredPipeline
+  {
+    VkPipeline pipeline;
+    uint64_t   frame_number; // frame after which nothing references it anymore
+  };
+  VkPipelineCache                             m_pipeline_cache;
+  VkFormat                                    m_render_pass_format;
+  std::vector<std::unique_ptr<PipelineBuild>> m_pipeline_builds; // indexed by PipelineId
+  std::unordered_map<PipelineKey, PipelineId, PipelineKeyHash> m_pipeline_ids;
+  PipelineId                                  m_background_pipeline = ~PipelineId(0); // requested by CreatePipelines, the fallback until then
+  PipelineId                                  m_sprite_pipeline;
+  std::vector<RetiredPipeline>                m_retired_pipelines;
+  std::string                                 m_pipeline_manifest = "pipelines.manifest";
+  bool                                        m_record_pipeline_misses = false; // set once the manifest is loaded
+  std::vector<std::shared_future<VkPipeline>> m_discarded_pipeline_builds; // replacements overtaken by a newer reload
+
   virtual bool Initialize() override;
   virtual bool CreateDevice() override;
   bool CheckPhysicalDeviceProperties(VkPhysicalDevice physical_device,
@@ -102,23 +371,60 @@ private:
   bool AllocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlagBits property, VkDeviceMemory* memory);
   bool CreateStagingBuffer();
   bool CreateCommandBuffers();
-  bool CreateCommandPool(uint32_t queue_family_index, VkCommandPool* pool);
-  bool AllocateCommandBuffers(VkCommandPool pool, uint32_t count, VkCommandBuffer* command_buffers);
-  bool CreateSemaphores();
-  bool CreateFences();
+  bool CreateCommandPool(uint32_t queue_family_index, VkCommandPool* pool,
+    VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+  bool AllocateCommandBuffers(VkCommandPool pool, uint32_t count, VkCommandBuffer* command_buffers, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  bool CreateFrameCommandPool(FrameCommandPool& frame_pool, VkCommandBufferLevel level);
+  bool AcquireFrameCommandBuffer(FrameCommandPool& frame_pool, VkCommandBuffer& command_buffer);
+  bool ResetFrameCommandPools(VirtualFrame& virtual_frame);
+  void DestroyFrameCommandPool(FrameCommandPool& frame_pool);
+  bool CreateSyncPools();
+  void DestroySyncPools();
+  bool CreateVirtualFrames();
+  bool CreateVirtualFrame(VirtualFrame& virtual_frame);
+  void DestroyVirtualFrame(VirtualFrame& virtual_frame);
+  bool CreateTimelines();
+  bool CreateTimeline(VkQueue queue, QueueTimeline& timeline);
+  // binary semaphores are for the swap chain, value is what the submission signals on the timeline once it's flushed
+  bool SubmitToTimeline(QueueTimeline& timeline, VkCommandBuffer command_buffer, const std::vector<TimelineWait>& waits, VkSemaphore wait_semaphore,
+    VkPipelineStageFlags wait_stage, VkSemaphore signal_semaphore, uint64_t& value);
+  bool FlushTimeline(QueueTimeline& timeline);
+  bool TimelineReached(QueueTimeline& timeline, uint64_t value); // never blocks, and never flushes
+  bool WaitTimeline(QueueTimeline& timeline, uint64_t value, uint64_t timeout = UINT64_MAX);
+  void DestroyTimeline(QueueTimeline& timeline);
   bool CreateTexture();
-  bool CreateImage(uint32_t width, uint32_t height, VkImage* image);
+  VkFormat SelectTextureFormat(int components, BCFormat& bc_format);
+  bool CreateImage(uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format, VkImage* image,
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
   bool AllocateImageMemory(VkImage image, VkMemoryPropertyFlagBits property, VkDeviceMemory* memory);
-  bool CreateImageView(VkImage image, VkImageView* image_view);
+  bool CreateImageView(VkImage image, VkFormat format, uint32_t mip_levels, VkImageView* image_view, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+  uint32_t GetMemoryType(uint32_t memory_type_bits, VkMemoryPropertyFlags property);
+  bool AllocateTransientImages(VirtualFrame& virtual_frame, std::vector<RenderGraph::TransientImage>& transients);
+  void RetireTransientImages(TransientImageSet& transient_images);
   bool CreateSampler(VkSampler* sampler);
-  bool CopyTextureData(char* texture_data, uint32_t data_size, uint32_t width, uint32_t height);
+  RenderGraph::Resource ImportStagingBuffer(RenderGraph& graph, VkBuffer staging_buffer);
+  bool CopyTextureData(VkImage image, const char* rgba, uint32_t width, uint32_t height);
+  bool CreateTextureStreaming();
+  bool StreamTexture(const std::string& file_name);
+  bool LoadStreamedTexture(StreamedTexture& texture);
+  VkDeviceSize GetStreamedTextureSize(const StreamedTexture& texture, uint32_t first_mip);
+  bool UpdateStreamedTextures();
+  bool RebuildStreamedTexture(StreamedTexture& texture, uint32_t new_resident_mip);
+  void ReleaseRetiredImages(bool release_all);
+  VkImageView GetTextureView();
   bool CreateUniformBuffer();
   bool CopyUniformBufferData();
   bool CreateDescriptorSetLayout();
   bool CreateDescriptorPool();
   bool AllocateDescriptorSet();
   bool UpdateDescriptorSet();
+  void UpdateDescriptorSet(VirtualFrame& virtual_frame);
+  void WriteDescriptorSet(VkDescriptorSet descriptor_set, VkImageView image_view);
   bool CopyVertexData();
+  bool CopyBufferData(const void* data, VkDeviceSize size, VkBuffer buffer, RenderUsage usage);
+  bool CreateSpriteBuffers();
+  void WriteSpriteVertices(VirtualFrame& virtual_frame);
+  void DestroyAtlasPages();
   bool OnWindowSizeChanged();
   void Clear();
   bool CreateSwapChain();
@@ -130,15 +436,70 @@ private:
   VkPresentModeKHR GetSwapChainPresentMode(std::vector<VkPresentModeKHR>& present_modes);
   bool CreateSwapChainImageViews();
   bool CreateRenderPass();
-  bool CreatePipeline();
-  VkShaderModule CreateShaderModule(const char* shader_code);
+  bool CreatePipelineCache();
+  bool LoadPipelineManifest();
+  bool CreatePipelines();
+  static VertexLayout GetVertexDataLayout();
+  static VertexLayout GetSpriteVertexLayout();
+  bool GetPipelineKey(const PipelineDescription& description, PipelineKey& key);
+  void StartPipelineBuild(PipelineBuild& build);
+  std::shared_future<VkPipeline> SubmitPipelineBuild(const PipelineDescription& description);
+  void ReloadShaders();
+  void SwapReloadedPipelines();
+  void ReleaseRetiredPipelines(bool release_all);
+  bool PipelineBuildsRunning() const;
+  VkPipeline BuildPipeline(const PipelineDescription& description, VkShaderModule vertex_shader_module, VkShaderModule fragment_shader_module, VkRenderPass render_pass, VkPipelineLayout pipeline_layout);
+  // m_pipeline until the build is done, which only fits descriptions with VertexData's layout, anything else
+  // asks for VK_NULL_HANDLE instead and skips its draws until then
+  VkPipeline GetPipeline(PipelineId id, bool use_fallback = true);
+  void WaitForPipelineBuilds();
+  void DestroyPipelines();
+  VkShaderModule GetShaderModule(const char* name);
+  VkShaderModule GetShaderModule(const char* name, uint64_t* content_hash);
+  VkShaderModule AddShaderModule(const char* name, const uint32_t* code, size_t size, uint64_t write_time);
+  VkShaderModule CreateShaderModule(const uint32_t* code, size_t size);
+  void ReleaseShaderModule(uint64_t content_hash);
   bool CreatePipelineLayout();
   virtual bool Update() override;
-  bool PrepareFrame(VkCommandBuffer command_buffer, const size_t& image_index, VkFramebuffer& frame_buffer);
+  bool PrepareFrame(VirtualFrame& virtual_frame, const size_t& image_index);
+  bool PrepareStaticFrame(VirtualFrame& virtual_frame, const size_t& image_index);
+  void UpdateStaticVersion();
+  void InvalidateStaticCommandBuffers() { ++m_static_version; }
+  bool RecordFrame(VkCommandBuffer command_buffer, VirtualFrame& virtual_frame, const size_t& image_index, VkFramebuffer frame_buffer,
+    VkCommandBufferUsageFlags usage, bool record_chunks);
+  RenderGraph::Attachment DeclareFrameGraph(RenderGraph& graph, VkImage swap_chain_image, std::function<void(VkCommandBuffer)> record_draws,
+    const RenderGraph::TransientAllocator& allocate_transients = nullptr);
+  size_t GetRecordingChunkCount() const;
+  bool RecordChunk(VirtualFrame& virtual_frame, size_t chunk, size_t chunk_count, VkPipeline background_pipeline, VkPipeline sprite_pipeline);
+  // a null background pipeline leaves the background out, only the first chunk draws it, a null sprite pipeline leaves the sprites out
+  void RecordDraws(VkCommandBuffer command_buffer, VkDescriptorSet descriptor_set, VkBuffer sprite_vertex_buffer, VkPipeline background_pipeline,
+    VkPipeline sprite_pipeline, uint32_t first_sprite, uint32_t end_sprite);
   bool CreateFrameBuffer(VkFramebuffer& frame_buffer, const VkImageView image_view);
   virtual void Terminate() override;
 
 public:
+  void SetTextureStreamingBudget(VkDeviceSize budget) { m_texture_streaming_budget = budget; }
+  // Fast encodes several times quicker, Quality gives better endpoints and BC7 for alpha, textures already streaming keep theirs
+  void SetTextureCompressionQuality(BCQuality quality) { m_texture_compression_quality = quality; }
+  // 1-2 frames for interactive use, 3-4 when throughput matters more than latency, up to m_max_virtual_frames
+  // swap_chain_images of 0 keeps the default, the surface clamps it, waits for the device so call it outside of frame work
+  bool SetFramesInFlight(uint32_t frames_in_flight, uint32_t swap_chain_images = 0);
+  // for mostly static content, frames that draw the same sprites as before resubmit command buffers recorded earlier
+  void SetStaticCommandBuffers(bool enabled);
+
+  // packs the images into atlas pages, sprite ids are indices into file_names
+  // replaces the previous atlas, waits for the device so call it outside of frame work
+  bool LoadSpriteImages(const std::vector<std::string>& file_names);
+  // queues one sprite for the next frame, position and size are in the same space as the textured quad
+  void DrawSprite(uint32_t image, float x, float y, float width, float height);
+
+  // returns right away, the pipeline compiles on a worker and draws with the id use the fallback until then
+  // a state that was requested before returns the same id without compiling anything
+  // ids stay valid when the render pass changes, the pipeline is simply compiled again
+  PipelineId RequestPipeline(const PipelineDescription& description);
+  // invalid while there is no render pass yet, resolves to VK_NULL_HANDLE when the build failed
+  std::shared_future<VkPipeline> GetPipelineFuture(PipelineId id) const;
+
   friend bool Initialize();
   friend bool Update();
   friend void Terminate();
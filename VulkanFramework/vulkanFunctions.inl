@@ -151,6 +151,7 @@ LOAD_DEVICE_LEVEL(vkDestroyDescriptorSetLayout)
 LOAD_DEVICE_LEVEL(vkCreateDescriptorPool)
 LOAD_DEVICE_LEVEL(vkDestroyDescriptorPool)
 LOAD_DEVICE_LEVEL(vkAllocateDescriptorSets)
+LOAD_DEVICE_LEVEL(vkFreeDescriptorSets)
 LOAD_DEVICE_LEVEL(vkUpdateDescriptorSets)
 LOAD_DEVICE_LEVEL(vkCreateRenderPass)
 LOAD_DEVICE_LEVEL(vkDestroyRenderPass)
@@ -160,6 +161,8 @@ LOAD_DEVICE_LEVEL(vkCreatePipelineLayout)
 LOAD_DEVICE_LEVEL(vkDestroyPipelineLayout)
 LOAD_DEVICE_LEVEL(vkCreateGraphicsPipelines)
 LOAD_DEVICE_LEVEL(vkDestroyPipeline)
+LOAD_DEVICE_LEVEL(vkCreatePipelineCache)
+LOAD_DEVICE_LEVEL(vkDestroyPipelineCache)
 LOAD_DEVICE_LEVEL(vkCreateBuffer)
 LOAD_DEVICE_LEVEL(vkDestroyBuffer)
 LOAD_DEVICE_LEVEL(vkGetBufferMemoryRequirements)
@@ -177,11 +180,17 @@ LOAD_DEVICE_LEVEL(vkDestroyFence)
 LOAD_DEVICE_LEVEL(vkCreateFramebuffer)
 LOAD_DEVICE_LEVEL(vkDestroyFramebuffer)
 LOAD_DEVICE_LEVEL(vkCmdCopyBufferToImage)
+LOAD_DEVICE_LEVEL(vkCmdCopyImage)
+LOAD_DEVICE_LEVEL(vkGetFenceStatus)
 LOAD_DEVICE_LEVEL(vkCmdBeginRenderPass)
 LOAD_DEVICE_LEVEL(vkCmdBindPipeline)
 LOAD_DEVICE_LEVEL(vkCmdBindVertexBuffers)
 LOAD_DEVICE_LEVEL(vkCmdBindDescriptorSets)
+LOAD_DEVICE_LEVEL(vkCmdBindIndexBuffer)
 LOAD_DEVICE_LEVEL(vkCmdDraw)
+LOAD_DEVICE_LEVEL(vkCmdDrawIndexed)
+LOAD_DEVICE_LEVEL(vkCmdExecuteCommands)
+LOAD_DEVICE_LEVEL(vkResetCommandPool)
 LOAD_DEVICE_LEVEL(vkCmdEndRenderPass)
 LOAD_DEVICE_LEVEL(vkCmdSetViewport)
 LOAD_DEVICE_LEVEL(vkCmdSetScissor)
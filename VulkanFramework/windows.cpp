@@ -10,6 +10,12 @@
 
 #include "system.h"
 #include "time.h"
+#include "threadpool.h"
+#include "pixelconvert.h"
+#include "vertexpacking.h"
+#include "transientplanner.h"
+#include "imagecache.h"
+#include "shaderwatcher.h"
 #include "myvulkan.h"
 
 void UpdateClientRect(const HWND& hwnd)
@@ -30,6 +36,50 @@ void UpdateClientRect(const HWND& hwnd)
   winAPI.m_height = winAPI.screen_client.bottom - winAPI.screen_client.top;
 }
 
+#if VK_CURRENT_MODE == VK_TEXTURE_FINAL
+// sample controls, G switches between a few sprites and a grid big enough to be recorded in chunks
+// S resubmits the command buffers recorded earlier while the sprites stay the same, 1-4 set the frames in flight
+// B drops the texture streaming budget low enough that the sharpest mips get evicted
+static uint32_t sprite_grid_size = 4;
+static bool     static_command_buffers = false;
+static bool     low_streaming_budget = false;
+
+void OnKeyDown(WPARAM key)
+{
+  switch (key)
+  {
+  case 'G':
+    sprite_grid_size = (sprite_grid_size == 4) ? 300 : 4;
+    break;
+  case 'S':
+    static_command_buffers = !static_command_buffers;
+    vulkan.SetStaticCommandBuffers(static_command_buffers);
+    break;
+  case '1':
+  case '2':
+  case '3':
+  case '4':
+    // messages are handled between frames, so waiting for the device in there is fine
+    if (!vulkan.SetFramesInFlight(static_cast<uint32_t>(key - '0')))
+      engine.Quit();
+    break;
+  case 'B':
+    low_streaming_budget = !low_streaming_budget;
+    vulkan.SetTextureStreamingBudget(low_streaming_budget ? 256 * 1024 : 64 * 1024 * 1024);
+    break;
+  }
+}
+
+void DrawSprites()
+{
+  // a grid over the textured quad, every sprite shows the whole image
+  float step = 1.4f / sprite_grid_size;
+  for (uint32_t y = 0; y < sprite_grid_size; ++y)
+    for (uint32_t x = 0; x < sprite_grid_size; ++x)
+      vulkan.DrawSprite(0, -0.7f + x * step, -0.7f + y * step, step * 0.75f, step * 0.75f);
+}
+#endif
+
 LRESULT CALLBACK MainWindowCallback(HWND hwnd, UINT u_msg, WPARAM w_param, LPARAM l_param)
 {
   switch (u_msg)
@@ -52,6 +102,14 @@ LRESULT CALLBACK MainWindowCallback(HWND hwnd, UINT u_msg, WPARAM w_param, LPARA
     UpdateClientRect(hwnd);
     break;
 
+#if VK_CURRENT_MODE == VK_TEXTURE_FINAL
+  case WM_KEYDOWN:
+    // bit 30 is set for auto repeats, holding a key toggles once
+    if (!(l_param & (1 << 30)))
+      OnKeyDown(w_param);
+    break;
+#endif
+
   case WM_CLOSE:
   case WM_DESTROY:
     engine.Quit();
@@ -95,8 +153,29 @@ bool Initialize()
   _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF); //memory leak check
 #endif
 
+  threadPool.Initialize();
+  imageCache.Initialize();
+  shaderWatcher.Initialize();
+
+#if PIXEL_KERNEL_BENCHMARK
+  benchmark_pixel_kernels(4 * 1024 * 1024);
+#endif
+#if VERTEX_PACKING_BENCHMARK
+  benchmark_vertex_packing(4 * 1024 * 1024);
+#endif
+#if TRANSIENT_PLANNER_SELF_CHECK
+  if (!check_transient_planner()) return false;
+#endif
+
   if (!vulkan.BaseInitialize()) return false;
+#if (VK_CURRENT_MODE == VK_TEXTURE_FINAL) && defined(NDEBUG)
+  // debug builds keep the fast encoder for quicker startup
+  vulkan.SetTextureCompressionQuality(BCQuality::Quality);
+#endif
   if (!vulkan.Initialize()) return false;
+#if VK_CURRENT_MODE == VK_TEXTURE_FINAL
+  if (!vulkan.LoadSpriteImages({ "images/crusty.jpg" })) return false;
+#endif
 
   return true;
 }
@@ -108,6 +187,9 @@ void Begin()
 
 bool Update()
 {
+#if VK_CURRENT_MODE == VK_TEXTURE_FINAL
+  DrawSprites();
+#endif
   if (!vulkan.Update()) return false;
   timer.Update(); // should be at last, always!
 
@@ -122,6 +204,9 @@ void Terminate()
 {
   vulkan.Terminate();
   vulkan.BaseTerminate();
+  threadPool.Terminate();
+  imageCache.Terminate();
+  shaderWatcher.Terminate();
 }
 
 int CALLBACK WinMain(HINSTANCE h_instance, HINSTANCE, LPSTR, int)
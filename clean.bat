@@ -21,4 +21,13 @@ rmdir "VulkanFramework\Release" /s /q
 del "VulkanFramework\x64\*" /s /q
 rmdir "VulkanFramework\x64" /s /q
 
+del "ShaderBuilder\Debug\*" /s /q
+rmdir "ShaderBuilder\Debug" /s /q
+
+del "ShaderBuilder\Release\*" /s /q
+rmdir "ShaderBuilder\Release" /s /q
+
+del "ShaderBuilder\x64\*" /s /q
+rmdir "ShaderBuilder\x64" /s /q
+
 #pause
\ No newline at end of file